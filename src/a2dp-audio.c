@@ -13,6 +13,7 @@
 #include <ctype.h>
 #include <endian.h>
 #include <errno.h>
+#include <limits.h>
 #include <fcntl.h>
 #include <math.h>
 #include <poll.h>
@@ -23,6 +24,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sbc/sbc.h>
@@ -44,9 +46,11 @@
 #endif
 
 #include "a2dp.h"
+#include "a2dp-capture.h"
 #include "a2dp-codecs.h"
 #include "a2dp-rtp.h"
 #include "audio.h"
+#include "ba-adapter.h"
 #include "bluealsa.h"
 #if ENABLE_APTX || ENABLE_APTX_HD
 # include "codec-aptx.h"
@@ -56,7 +60,28 @@
 #include "shared/defs.h"
 #include "shared/ffb.h"
 #include "shared/log.h"
+#include "shared/mempool.h"
 #include "shared/rt.h"
+#include "shared/trace.h"
+
+/* Overdue time (in milliseconds) of the incoming PCM data, above which
+ * the A2DP source stream is considered as being underrun. */
+#define A2DP_UNDERRUN_THRESHOLD 20
+
+/**
+ * State of the A2DP sink low-power mode. */
+enum a2dp_sink_batch {
+	/* waiting for the first packet */
+	A2DP_SINK_BATCH_IDLE = 0,
+	/* letting packets accumulate in the BT socket */
+	A2DP_SINK_BATCH_WAIT,
+	/* reading packets without polling */
+	A2DP_SINK_BATCH_DRAIN,
+};
+
+/* Interval (in milliseconds) between cached silence packets sent during
+ * the keep-alive period. */
+#define A2DP_KEEP_ALIVE_SILENCE_INTERVAL 100
 
 /**
  * Common IO thread data. */
@@ -66,10 +91,29 @@ struct io_thread_data {
 	int timeout;
 	/* transfer bit rate synchronization */
 	struct asrsync asrs;
+	/* time point when the stream start has been deferred */
+	struct timespec start_ts;
 	/* history of BT socket COUTQ bytes */
 	struct { int v[16]; size_t i; } coutq;
 	/* local counter for RTP sequence number */
 	uint16_t rtp_seq_number;
+	/* low-power mode state of the sink */
+	enum a2dp_sink_batch sink_batch;
+	/* time point when the batch period has been started */
+	struct timespec sink_batch_ts;
+	/* number of packets sent behind the back of the encoder loop */
+	uint16_t rtp_seq_shift;
+	/* RTP timestamp advance of these packets */
+	uint32_t rtp_ts_shift;
+	/* keep-alive period with the cached silence */
+	struct {
+		struct timespec ts0;
+		bool active;
+		/* cache packets written to the BT socket */
+		bool capture;
+		/* transferred frames when the packet has been cached */
+		uint32_t frames;
+	} keep_alive;
 	/* determine whether transport is locked */
 	bool t_locked;
 	/* determine whether audio is paused */
@@ -133,34 +177,53 @@ static void ba_transport_pcm_scale(
 ssize_t ba_transport_pcm_flush(struct ba_transport_pcm *pcm) {
 	ssize_t rv = splice(pcm->fd, NULL, config.null_fd, NULL, 1024 * 32, SPLICE_F_NONBLOCK);
 	if (rv > 0)
-		rv /= BA_TRANSPORT_PCM_FORMAT_BYTES(pcm->format);
+		rv /= BA_TRANSPORT_PCM_FORMAT_BYTES(ba_transport_pcm_fifo_format(pcm));
 	else if (rv == -1 && errno == EAGAIN)
 		rv = 0;
 	return rv;
 }
 
 /**
- * Read PCM signal from the transport PCM FIFO. */
+ * Read PCM signal from the transport PCM FIFO.
+ *
+ * If the FIFO format has a higher resolution than the PCM format, the
+ * signal is requantized with dither. In such case, the number of samples
+ * read at once is limited. */
 ssize_t ba_transport_pcm_read(
 		struct ba_transport_pcm *pcm,
 		void *buffer,
 		size_t samples) {
 
-	const size_t sample_size = BA_TRANSPORT_PCM_FORMAT_BYTES(pcm->format);
+	const uint16_t fifo_format = ba_transport_pcm_fifo_format(pcm);
+	const size_t sample_size = BA_TRANSPORT_PCM_FORMAT_BYTES(fifo_format);
+	int32_t tmp[4096];
+	void *head = buffer;
 	ssize_t ret;
 
+	if (fifo_format != pcm->format) {
+		if (samples > ARRAYSIZE(tmp))
+			samples = ARRAYSIZE(tmp);
+		head = tmp;
+	}
+
 	/* If the passed file descriptor is invalid (e.g. -1) is means, that other
 	 * thread (the controller) has closed the connection. If the connection was
 	 * closed during this call, we will still read correct data, because Linux
 	 * kernel does not decrement file descriptor reference counter until the
 	 * read returns. */
-	while ((ret = read(pcm->fd, buffer, samples * sample_size)) == -1 &&
+	while ((ret = read(pcm->fd, head, samples * sample_size)) == -1 &&
 			errno == EINTR)
 		continue;
 
 	if (ret > 0) {
 		samples = ret / sample_size;
+		if (fifo_format != pcm->format) {
+			if (fifo_format == BA_TRANSPORT_PCM_FORMAT_S24_4LE)
+				audio_s24_4le_to_s32_4le(tmp, tmp, samples);
+			audio_s32_4le_to_s16_2le_dither(buffer, tmp, pcm->channels, samples, &pcm->dither);
+		}
 		ba_transport_pcm_scale(pcm, buffer, samples);
+		pcm->stats.frames += samples / pcm->channels;
 		return samples;
 	}
 
@@ -221,12 +284,175 @@ ssize_t ba_transport_pcm_write(
 
 	/* It is guaranteed, that this function will write data atomically. */
 	ret = samples;
+	pcm->stats.frames += samples / pcm->channels;
 
 final:
 	pthread_setcancelstate(oldstate, NULL);
 	return ret;
 }
 
+/**
+ * Write decoded PCM signal to the A2DP sink PCM FIFO.
+ *
+ * In the fixed format mode, the format of the PCM might differ from the
+ * format of the decoder output, in which case samples are converted before
+ * being written to the FIFO.
+ *
+ * @param format The format of the decoded PCM signal. */
+static ssize_t a2dp_sink_pcm_write(struct ba_transport_pcm *pcm,
+		void *buffer, size_t samples, uint16_t format) {
+
+	if (format == pcm->format)
+		return ba_transport_pcm_write(pcm, buffer, samples);
+
+	int32_t tmp[4096];
+	size_t written = 0;
+	ssize_t ret;
+
+	while (written < samples) {
+
+		size_t len = samples - written;
+		if (len > ARRAYSIZE(tmp))
+			len = ARRAYSIZE(tmp);
+
+		switch (format) {
+		case BA_TRANSPORT_PCM_FORMAT_S16_2LE:
+			audio_s16_2le_to_s32_4le(tmp, (int16_t *)buffer + written, len);
+			break;
+		case BA_TRANSPORT_PCM_FORMAT_S24_4LE:
+			audio_s24_4le_to_s32_4le(tmp, (int32_t *)buffer + written, len);
+			break;
+		default:
+			g_assert_not_reached();
+		}
+
+		if ((ret = ba_transport_pcm_write(pcm, tmp, len)) <= 0)
+			return ret;
+
+		written += len;
+	}
+
+	return written;
+}
+
+/**
+ * Get the time needed to reach the PCM start threshold.
+ *
+ * The amount of buffered audio is calculated as a sum of the data queued in
+ * the PCM FIFO and the data already read into the IO buffer. In order not to
+ * stall the stream forever (e.g. the client writes less data than the start
+ * threshold), the overall wait time is limited to the start threshold.
+ *
+ * @return The number of milliseconds to wait before the stream can be
+ *   started, or 0 if the stream shall be started right away. */
+static int a2dp_pcm_start_threshold_wait(const struct ba_transport_pcm *pcm,
+		struct io_thread_data *io, const ffb_t *buffer) {
+
+	const unsigned int threshold = pcm->start_threshold;
+	const size_t frame_size = BA_TRANSPORT_PCM_FORMAT_BYTES(ba_transport_pcm_fifo_format(pcm)) * pcm->channels;
+	int queued = 0;
+
+	if (threshold == 0)
+		return 0;
+
+	if (ioctl(pcm->fd, FIONREAD, &queued) == -1 || queued <= 0)
+		return 0;
+
+	const size_t frames = queued / frame_size + ffb_len_out(buffer) / pcm->channels;
+	const unsigned int buffered = frames * 1000 / pcm->sampling;
+	if (buffered >= threshold)
+		return 0;
+
+	struct timespec ts;
+	gettimestamp(&ts);
+
+	if (io->start_ts.tv_sec == 0 && io->start_ts.tv_nsec == 0)
+		io->start_ts = ts;
+
+	difftimespec(&io->start_ts, &ts, &ts);
+	const unsigned int elapsed = ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	if (elapsed >= threshold)
+		return 0;
+
+	const unsigned int missing = threshold - buffered;
+	return missing < threshold - elapsed ? missing : threshold - elapsed;
+}
+
+/**
+ * Insert silence in front of the newly read PCM samples.
+ *
+ * The amount of silence is limited by the free space of the buffer.
+ *
+ * @return The number of inserted samples. */
+static size_t a2dp_pcm_insert_silence(struct ba_transport_pcm *pcm,
+		ffb_t *buffer, size_t samples, unsigned int msec) {
+
+	size_t silence = (size_t)msec * pcm->sampling / 1000 * pcm->channels;
+	const size_t room = ffb_len_in(buffer) - samples;
+
+	if (silence > room)
+		silence = room - room % pcm->channels;
+
+	uint8_t *tail = buffer->tail;
+	memmove(tail + silence * buffer->size, tail, samples * buffer->size);
+	memset(tail, 0, silence * buffer->size);
+
+	pcm->stats.silence_frames += silence / pcm->channels;
+	return silence;
+}
+
+static ssize_t a2dp_write_bt(struct io_thread_data *io, ffb_t *buffer);
+
+/**
+ * Stream the cached silence during the keep-alive period.
+ *
+ * The silence packet is encoded only once per transport. In order to do so,
+ * the IO buffer is filled with silence which shall be passed to the encoder
+ * by the caller. The last packet written to the BT socket afterwards is then
+ * cached by the a2dp_write_bt() and it is resent on every subsequent call.
+ * The RTP sequence number and timestamp of the resent packet are advanced,
+ * so the sink will see a continuous stream.
+ *
+ * @return The number of silence samples in the IO buffer, 0 if the cached
+ *   packet has been sent, or -1 if the keep-alive period has expired. */
+static ssize_t a2dp_keep_alive_silence(struct ba_transport_pcm *pcm,
+		struct io_thread_data *io, ffb_t *buffer) {
+
+	struct ba_transport *t = io->th->t;
+	struct timespec ts;
+
+	gettimestamp(&ts);
+	difftimespec(&io->keep_alive.ts0, &ts, &ts);
+	if (config.a2dp.keep_alive >= 0 && ts.tv_sec >= config.a2dp.keep_alive)
+		return -1;
+
+	if (t->a2dp.silence_len == 0 || t->a2dp.silence_len > t->mtu_write ||
+			t->a2dp.silence_frames == 0) {
+		/* Residual samples are a tail of the closed stream, which would
+		 * have been lost anyway, so they can be safely dropped. */
+		ffb_rewind(buffer);
+		const size_t samples = ffb_len_in(buffer) - ffb_len_in(buffer) % pcm->channels;
+		memset(buffer->data, 0, samples * buffer->size);
+		ffb_seek(buffer, samples);
+		io->keep_alive.capture = true;
+		return samples;
+	}
+
+	ffb_t packet = {
+		.data = t->a2dp.silence,
+		.tail = t->a2dp.silence + t->a2dp.silence_len,
+		.nmemb = t->a2dp.silence_len,
+		.size = sizeof(uint8_t) };
+
+	/* RTP timestamp is advanced in the same way as in the encoder loop */
+	io->rtp_seq_shift++;
+	io->rtp_ts_shift += t->a2dp.silence_frames * 10000 / pcm->sampling;
+	if (a2dp_write_bt(io, &packet) == -1)
+		return -1;
+
+	return 0;
+}
+
 /**
  * Poll and read PCM signal from the transport PCM FIFO.
  *
@@ -240,18 +466,48 @@ static ssize_t a2dp_poll_and_read_pcm(struct ba_transport_pcm *pcm,
 		{ th->pipe[0], POLLIN, 0 },
 		{ -1, POLLIN, 0 }};
 
+	/* All packets of the encoded silence have been written by now. Since the
+	 * encoder loop has already accounted for the last one, we can get the
+	 * number of PCM frames encoded in the cached packet. */
+	if (io->keep_alive.capture) {
+		pcm->t->a2dp.silence_frames = io->asrs.frames - io->keep_alive.frames;
+		io->keep_alive.capture = false;
+	}
+
 	/* Allow escaping from the poll() by thread cancellation. */
 	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 
+	ssize_t samples;
+
 repoll:
 
 	/* Add PCM socket to the poll if transport is active. */
 	fds[1].fd = io->t_paused ? -1 : pcm->fd;
+	int timeout = io->timeout;
+
+	/* Before the stream is started, wait until the start threshold is reached.
+	 * However, do not wait when the keep-alive or sync timeout is in effect,
+	 * because in such case the client will not write more data. */
+	int start_wait = 0;
+	if (fds[1].fd != -1 && io->asrs.frames == 0 && io->timeout == -1 &&
+			(start_wait = a2dp_pcm_start_threshold_wait(pcm, io, buffer)) > 0) {
+		fds[1].fd = -1;
+		timeout = start_wait;
+	}
 
 	/* Poll for reading with keep-alive and sync timeout. */
-	switch (poll(fds, ARRAYSIZE(fds), io->timeout)) {
+	switch (poll(fds, ARRAYSIZE(fds), timeout)) {
 	case 0:
-		pthread_cond_signal(&pcm->synced);
+		if (start_wait > 0)
+			goto repoll;
+		if (io->keep_alive.active) {
+			if ((samples = a2dp_keep_alive_silence(pcm, io, buffer)) > 0)
+				goto silence;
+			if (samples == 0)
+				goto repoll;
+			io->keep_alive.active = false;
+		}
+		ba_transport_pcm_drain_synced(pcm);
 		io->timeout = -1;
 		io->t_locked = !ba_transport_thread_cleanup_lock(th);
 		if (pcm->fd == -1)
@@ -273,6 +529,7 @@ repoll:
 			io->t_paused = false;
 			io->asrs.frames = 0;
 			io->timeout = -1;
+			io->keep_alive.active = false;
 			goto repoll;
 		case BA_TRANSPORT_SIGNAL_PCM_CLOSE:
 			/* reuse PCM read disconnection logic */
@@ -291,11 +548,25 @@ repoll:
 		}
 	}
 
-	ssize_t samples;
+	/* The FIFO might have been empty when the start threshold was checked
+	 * last time, so we have been woken up by the first client write. Check
+	 * the threshold once more, because otherwise the stream would have been
+	 * started with just a single write of data buffered. */
+	if (io->asrs.frames == 0 && io->timeout == -1 &&
+			a2dp_pcm_start_threshold_wait(pcm, io, buffer) > 0)
+		goto repoll;
+
 	switch (samples = ba_transport_pcm_read(pcm, buffer->tail, ffb_len_in(buffer))) {
 	case 0:
 		io->timeout = config.a2dp.keep_alive * 1000;
 		debug("Keep-alive polling: %d", io->timeout);
+		if (config.a2dp.keep_alive_silence && io->timeout != 0) {
+			gettimestamp(&io->keep_alive.ts0);
+			io->keep_alive.active = true;
+			io->timeout = A2DP_KEEP_ALIVE_SILENCE_INTERVAL;
+			if ((samples = a2dp_keep_alive_silence(pcm, io, buffer)) > 0)
+				goto silence;
+		}
 		goto repoll;
 	case -1:
 		if (errno == EAGAIN)
@@ -305,18 +576,47 @@ repoll:
 
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
+	trace2(pcm_read, pcm->fd, samples);
+
+	/* If PCM data has arrived past the moment when it should have been sent
+	 * to the BT device, the stream has been underrun. By default, the late
+	 * data is sent in a burst in order to catch up. Upon client request,
+	 * restart the time synchronization, so the stream will be paced from now
+	 * on, or fill the gap with silence, so the stream clock keeps running. */
+	unsigned int overdue;
+	if (io->asrs.frames != 0 &&
+			(overdue = asrsync_get_overdue_msec(&io->asrs)) > A2DP_UNDERRUN_THRESHOLD) {
+		pcm->stats.underruns++;
+		switch (pcm->underrun_policy) {
+		case BA_TRANSPORT_PCM_UNDERRUN_NONE:
+			break;
+		case BA_TRANSPORT_PCM_UNDERRUN_RESYNC:
+			io->asrs.frames = 0;
+			break;
+		case BA_TRANSPORT_PCM_UNDERRUN_SILENCE:
+			samples += a2dp_pcm_insert_silence(pcm, buffer, samples, overdue);
+			break;
+		}
+	}
+
 	/* When the thread is created, there might be no data in the FIFO. In fact
 	 * there might be no data for a long time - until client starts playback.
 	 * In order to correctly calculate time drift, the zero time point has to
 	 * be obtained after the stream has started. */
-	if (io->asrs.frames == 0)
+	if (io->asrs.frames == 0) {
 		asrsync_init(&io->asrs, pcm->sampling);
+		io->start_ts.tv_sec = io->start_ts.tv_nsec = 0;
+	}
 
 	/* update PCM buffer */
 	ffb_seek(buffer, samples);
 
 	/* return overall number of samples */
 	return ffb_len_out(buffer);
+
+silence:
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	return samples;
 }
 
 /**
@@ -356,18 +656,54 @@ static ssize_t a2dp_poll_and_read_bt(struct io_thread_data *io, ffb_t *buffer) {
 	/* Allow escaping from the poll() by thread cancellation. */
 	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 
+	ssize_t len;
+
 repoll:
 
 	/* Add BT socket to the poll if transport is active. */
 	fds[1].fd = io->t_paused ? -1 : t->bt_fd;
+	int timeout = -1;
+
+	/* In the low-power mode, packets are left in the BT socket for the batch
+	 * period after the first one has arrived. Then, all of them are read in
+	 * a single burst without polling in between. */
+	if (fds[1].fd != -1)
+		switch (io->sink_batch) {
+		case A2DP_SINK_BATCH_IDLE:
+			break;
+		case A2DP_SINK_BATCH_WAIT: {
+			/* The batch period is not restarted when the poll has been
+			 * interrupted, so events can not postpone the delivery. */
+			struct timespec ts;
+			gettimestamp(&ts);
+			difftimespec(&io->sink_batch_ts, &ts, &ts);
+			const unsigned int elapsed = ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+			if (elapsed >= config.a2dp.sink_batch) {
+				io->sink_batch = A2DP_SINK_BATCH_DRAIN;
+				goto read;
+			}
+			fds[1].fd = -1;
+			timeout = config.a2dp.sink_batch - elapsed;
+			break;
+		}
+		case A2DP_SINK_BATCH_DRAIN:
+			goto read;
+		}
 
-	if (poll(fds, ARRAYSIZE(fds), -1) == -1) {
+	switch (poll(fds, ARRAYSIZE(fds), timeout)) {
+	case 0:
+		t->stats.wakeups++;
+		io->sink_batch = A2DP_SINK_BATCH_DRAIN;
+		goto repoll;
+	case -1:
 		if (errno == EINTR)
 			goto repoll;
 		error("Transport poll error: %s", strerror(errno));
 		return -1;
 	}
 
+	t->stats.wakeups++;
+
 	if (fds[0].revents & POLLIN) {
 		/* dispatch incoming event */
 		switch (ba_transport_thread_recv_signal(th)) {
@@ -383,14 +719,32 @@ repoll:
 		}
 	}
 
-	ssize_t len;
+	if (config.a2dp.sink_batch > 0 && fds[1].revents & POLLIN) {
+		gettimestamp(&io->sink_batch_ts);
+		io->sink_batch = A2DP_SINK_BATCH_WAIT;
+		goto repoll;
+	}
+
+read:
 	if ((len = read(fds[1].fd, buffer->tail, ffb_len_in(buffer))) == -1) {
-		debug("BT read error: %s", strerror(errno));
+		/* in the low-power mode it means that the socket has been drained */
+		if (!(io->sink_batch == A2DP_SINK_BATCH_DRAIN && errno == EAGAIN))
+			debug("BT read error: %s", strerror(errno));
+		io->sink_batch = A2DP_SINK_BATCH_IDLE;
 		goto repoll;
 	}
 
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
+	trace2(bt_read, fds[1].fd, len);
+	if (len > 0) {
+		t->stats.bt_rx_bytes += len;
+		ba_transport_stats_update(t);
+	}
+
+	if (len > 0 && t->a2dp.capture != NULL)
+		a2dp_capture_write(t->a2dp.capture, A2DP_CAPTURE_DIR_RX, buffer->tail, len);
+
 	/* it seems that zero is never returned... */
 	if (len == 0) {
 		debug("BT socket has been closed: %d", fds[1].fd);
@@ -413,10 +767,22 @@ static ssize_t a2dp_write_bt(struct io_thread_data *io, ffb_t *buffer) {
 
 	struct ba_transport *t = io->th->t;
 	struct pollfd pfd = { t->bt_fd, POLLOUT, 0 };
+	rtp_header_t *rtp_header = buffer->data;
+	const uint16_t seq_number = rtp_header->seq_number;
+	const uint32_t timestamp = rtp_header->timestamp;
 	int coutq = 0;
 	int oldstate;
 	ssize_t ret;
 
+	/* Packets resent during the keep-alive period are not accounted for in
+	 * the RTP sequence number and timestamp maintained by the encoder loop. */
+	const bool rtp_shift = (io->rtp_seq_shift != 0 || io->rtp_ts_shift != 0) &&
+		t->type.codec != A2DP_CODEC_VENDOR_APTX;
+	if (rtp_shift) {
+		rtp_header->seq_number = htobe16(be16toh(seq_number) + io->rtp_seq_shift);
+		rtp_header->timestamp = htobe32(be32toh(timestamp) + io->rtp_ts_shift);
+	}
+
 	/* BT socket is opened in the non-blocking mode. However, this function
 	 * forcefully operates in a blocking mode - it uses poll() when writing
 	 * to the BT socket would block. Hence, it is required to provide a way
@@ -434,6 +800,7 @@ retry:
 		case EINTR:
 			goto retry;
 		case EAGAIN:
+			trace2(bt_eagain, pfd.fd, ffb_len_out(buffer));
 			poll(&pfd, 1, -1);
 			/* set coutq to some arbitrary big value */
 			coutq = 1024 * 16;
@@ -446,6 +813,31 @@ retry:
 			ret = 0;
 		}
 
+	if (rtp_shift) {
+		rtp_header->seq_number = seq_number;
+		rtp_header->timestamp = timestamp;
+	}
+
+	trace3(bt_write, pfd.fd, ret, coutq);
+	if (ret > 0) {
+		t->stats.bt_tx_bytes += ret;
+		ba_transport_stats_update(t);
+	}
+	t->stats.bt_queued = coutq;
+
+	if (ret > 0 && t->a2dp.capture != NULL)
+		a2dp_capture_write(t->a2dp.capture, A2DP_CAPTURE_DIR_TX, buffer->data, ret);
+
+	uint8_t *silence;
+	if (ret > 0 && io->keep_alive.capture &&
+			(silence = mempool_realloc(t->a2dp.silence, ret)) != NULL) {
+		memcpy(silence, buffer->data, ret);
+		t->a2dp.silence = silence;
+		t->a2dp.silence_len = ret;
+		t->a2dp.silence_frames = 0;
+		io->keep_alive.frames = io->asrs.frames;
+	}
+
 	io->coutq.i = (io->coutq.i + 1) % ARRAYSIZE(io->coutq.v);
 	io->coutq.v[io->coutq.i] = coutq;
 
@@ -484,10 +876,22 @@ static uint8_t *a2dp_init_rtp(void *s, rtp_header_t **hdr,
  * Validate RTP header and get payload.
  *
  * @param hdr The pointer to data with RTP header to validate.
+ * @param len The length of the data pointed by the hdr.
+ * @param phdr_size The size of the RTP payload header which has to be
+ *   available just after the RTP header.
  * @param io The IO thread data - used for storing RTP sequence number.
  * @return On success, this function returns pointer to data just after
  *   the RTP header - RTP header payload. On failure, NULL is returned. */
-static void *a2dp_validate_rtp(const rtp_header_t *hdr, struct io_thread_data *io) {
+static void *a2dp_validate_rtp(const rtp_header_t *hdr, size_t len,
+		size_t phdr_size, struct io_thread_data *io) {
+
+	/* Data read from the BT socket are untrusted. Make sure, that the RTP
+	 * header (including CSRC list) and payload header are not truncated. */
+	if (len < RTP_HEADER_LEN ||
+			len < RTP_HEADER_LEN + hdr->cc * sizeof(hdr->csrc[0]) + phdr_size) {
+		warn("Truncated RTP packet: %zu", len);
+		return NULL;
+	}
 
 #if ENABLE_PAYLOADCHECK
 	if (hdr->paytype < 96) {
@@ -498,8 +902,11 @@ static void *a2dp_validate_rtp(const rtp_header_t *hdr, struct io_thread_data *i
 
 	uint16_t seq_number = be16toh(hdr->seq_number);
 	if (++io->rtp_seq_number != seq_number) {
-		if (io->rtp_seq_number != 0)
+		if (io->rtp_seq_number != 0) {
+			trace2(rtp_loss, seq_number, io->rtp_seq_number);
+			io->th->t->stats.rtp_lost += (uint16_t)(seq_number - io->rtp_seq_number);
 			warn("Missing RTP packet: %u != %u", seq_number, io->rtp_seq_number);
+		}
 		io->rtp_seq_number = seq_number;
 	}
 
@@ -536,7 +943,10 @@ static void *a2dp_sink_sbc(struct ba_transport_thread *th) {
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &bt);
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &pcm);
 
-	if (ffb_init_int16_t(&pcm, sbc_get_codesize(&sbc)) == -1 ||
+	/* Buffer for all SBC frames carried by a single RTP packet, so the
+	 * decoded PCM can be written to the FIFO with a single call. */
+	const size_t sbc_pcm_samples = sbc_get_codesize(&sbc) / sizeof(int16_t);
+	if (ffb_init_int16_t(&pcm, sbc_pcm_samples * RTP_MEDIA_MAX_FRAMES) == -1 ||
 			ffb_init_uint8_t(&bt, t->mtu_read) == -1) {
 		error("Couldn't create data buffers: %s", strerror(errno));
 		goto fail_ffb;
@@ -566,7 +976,8 @@ static void *a2dp_sink_sbc(struct ba_transport_thread *th) {
 		}
 
 		const rtp_media_header_t *rtp_media_header;
-		if ((rtp_media_header = a2dp_validate_rtp(bt.data, &io)) == NULL)
+		if ((rtp_media_header = a2dp_validate_rtp(bt.data, len,
+						sizeof(*rtp_media_header), &io)) == NULL)
 			continue;
 
 		const uint8_t *rtp_payload = (uint8_t *)(rtp_media_header + 1);
@@ -580,7 +991,7 @@ static void *a2dp_sink_sbc(struct ba_transport_thread *th) {
 			size_t decoded;
 
 			if ((len = sbc_decode(&sbc, rtp_payload, rtp_payload_len,
-							pcm.data, ffb_blen_in(&pcm), &decoded)) < 0) {
+							pcm.tail, ffb_blen_in(&pcm), &decoded)) < 0) {
 				error("SBC decoding error: %s", strerror(-len));
 				break;
 			}
@@ -595,12 +1006,16 @@ static void *a2dp_sink_sbc(struct ba_transport_thread *th) {
 			rtp_payload += len;
 			rtp_payload_len -= len;
 
-			const size_t samples = decoded / sizeof(int16_t);
-			if (ba_transport_pcm_write(&t->a2dp.pcm, pcm.data, samples) == -1)
-				error("FIFO write error: %s", strerror(errno));
+			ffb_seek(&pcm, decoded / sizeof(int16_t));
 
 		}
 
+		if (ffb_len_out(&pcm) > 0 &&
+				a2dp_sink_pcm_write(&t->a2dp.pcm, pcm.data, ffb_len_out(&pcm),
+					BA_TRANSPORT_PCM_FORMAT_S16_2LE) == -1)
+			error("FIFO write error: %s", strerror(errno));
+		ffb_rewind(&pcm);
+
 	}
 
 fail:
@@ -647,7 +1062,21 @@ static void *a2dp_source_sbc(struct ba_transport_thread *th) {
 	const unsigned int samplerate = t->a2dp.pcm.sampling;
 
 	/* initialize SBC encoder bit-pool */
-	sbc.bitpool = sbc_a2dp_get_bitpool(configuration, config.sbc_quality);
+	unsigned int sbc_quality = config.sbc_quality;
+	sbc.bitpool = sbc_a2dp_get_bitpool(configuration, sbc_quality);
+
+	if (config.hci_bitrate_limit != 0) {
+		/* Lower the encoder quality if the aggregate bitrate of
+		 * the adapter would exceed configured limit otherwise. */
+		const unsigned int load = ba_adapter_get_bitrate(t->d->a, t);
+		while (sbc_quality > SBC_QUALITY_LOW &&
+				load + 8 * sbc_get_frame_length(&sbc) * samplerate * channels /
+					sbc_pcm_samples > config.hci_bitrate_limit)
+			sbc.bitpool = sbc_a2dp_get_bitpool(configuration, --sbc_quality);
+		if (sbc_quality != config.sbc_quality)
+			info("Adapter load %u kbps: Lowering SBC quality: %u -> %u",
+					load / 1000, config.sbc_quality, sbc_quality);
+	}
 
 #if DEBUG
 	sbc_print_internals(&sbc);
@@ -709,11 +1138,13 @@ static void *a2dp_source_sbc(struct ba_transport_thread *th) {
 			ssize_t len;
 			ssize_t encoded;
 
+			trace2(encode_begin, A2DP_CODEC_SBC, input_len);
 			if ((len = sbc_encode(&sbc, input, input_len * sizeof(int16_t),
 							bt.tail, output_len, &encoded)) < 0) {
 				error("SBC encoding error: %s", strerror(-len));
 				break;
 			}
+			trace2(encode_end, A2DP_CODEC_SBC, encoded);
 
 			len = len / sizeof(int16_t);
 			input += len;
@@ -847,7 +1278,8 @@ static void *a2dp_sink_mpeg(struct ba_transport_thread *th) {
 		}
 
 		const rtp_mpeg_audio_header_t *rtp_mpeg_header;
-		if ((rtp_mpeg_header = a2dp_validate_rtp(bt.data, &io)) == NULL)
+		if ((rtp_mpeg_header = a2dp_validate_rtp(bt.data, len,
+						sizeof(*rtp_mpeg_header), &io)) == NULL)
 			continue;
 
 		uint8_t *rtp_mpeg = (uint8_t *)(rtp_mpeg_header + 1);
@@ -876,7 +1308,8 @@ decode:
 		}
 
 		const size_t samples = len / sizeof(int16_t);
-		if (ba_transport_pcm_write(&t->a2dp.pcm, pcm.data, samples) == -1)
+		if (a2dp_sink_pcm_write(&t->a2dp.pcm, pcm.data, samples,
+					BA_TRANSPORT_PCM_FORMAT_S16_2LE) == -1)
 			error("FIFO write error: %s", strerror(errno));
 
 		if (len > 0) {
@@ -896,7 +1329,8 @@ decode:
 		}
 
 		if (channels == 1) {
-			if (ba_transport_pcm_write(&t->a2dp.pcm, pcm_l, samples) == -1)
+			if (a2dp_sink_pcm_write(&t->a2dp.pcm, pcm_l, samples,
+						BA_TRANSPORT_PCM_FORMAT_S16_2LE) == -1)
 				error("FIFO write error: %s", strerror(errno));
 		}
 		else {
@@ -907,7 +1341,8 @@ decode:
 				((int16_t *)pcm.data)[i * 2 + 1] = pcm_r[i];
 			}
 
-			if (ba_transport_pcm_write(&t->a2dp.pcm, pcm.data, samples) == -1)
+			if (a2dp_sink_pcm_write(&t->a2dp.pcm, pcm.data, samples,
+						BA_TRANSPORT_PCM_FORMAT_S16_2LE) == -1)
 				error("FIFO write error: %s", strerror(errno));
 
 		}
@@ -1069,12 +1504,14 @@ static void *a2dp_source_mp3(struct ba_transport_thread *th) {
 		size_t pcm_frames = samples / channels;
 		ssize_t len;
 
+		trace2(encode_begin, A2DP_CODEC_MPEG12, samples);
 		if ((len = channels == 1 ?
 					lame_encode_buffer(handle, pcm.data, NULL, pcm_frames, bt.tail, ffb_len_in(&bt)) :
 					lame_encode_buffer_interleaved(handle, pcm.data, pcm_frames, bt.tail, ffb_len_in(&bt))) < 0) {
 			error("LAME encoding error: %s", lame_encode_strerror(len));
 			continue;
 		}
+		trace2(encode_end, A2DP_CODEC_MPEG12, len);
 
 		if (len > 0) {
 
@@ -1198,8 +1635,18 @@ static void *a2dp_sink_aac(struct ba_transport_thread *th) {
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &latm);
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &pcm);
 
+	/* AAC frame is limited to 6144 bits per channel, however, the actual
+	 * size follows the configured bitrate. The LATM buffer shall be able to
+	 * hold the biggest frame plus one more RTP fragment, so it will not be
+	 * resized while reassembling fragmented frames. */
+	const a2dp_aac_t *configuration = (a2dp_aac_t *)t->a2dp.configuration;
+	const size_t aac_frame_len = AAC_GET_BITRATE(*configuration) / 8 * 1024 / t->a2dp.pcm.sampling;
+	size_t latm_nmemb = 6144 / 8 * channels;
+	if (aac_frame_len > latm_nmemb)
+		latm_nmemb = aac_frame_len;
+
 	if (ffb_init_int16_t(&pcm, 2048 * channels) == -1 ||
-			ffb_init_uint8_t(&latm, t->mtu_read) == -1 ||
+			ffb_init_uint8_t(&latm, latm_nmemb + t->mtu_read) == -1 ||
 			ffb_init_uint8_t(&bt, t->mtu_read) == -1) {
 		error("Couldn't create data buffers: %s", strerror(errno));
 		goto fail_ffb;
@@ -1225,7 +1672,7 @@ static void *a2dp_sink_aac(struct ba_transport_thread *th) {
 		}
 
 		const uint8_t *rtp_latm;
-		if ((rtp_latm = a2dp_validate_rtp(bt.data, &io)) == NULL)
+		if ((rtp_latm = a2dp_validate_rtp(bt.data, len, 0, &io)) == NULL)
 			continue;
 
 		const rtp_header_t *rtp_header = (rtp_header_t *)bt.data;
@@ -1243,26 +1690,40 @@ static void *a2dp_sink_aac(struct ba_transport_thread *th) {
 			}
 		}
 
-		if (ffb_len_in(&latm) < rtp_latm_len) {
-			debug("Resizing LATM buffer: %zd -> %zd", latm.size, latm.size + t->mtu_read);
-			size_t prev_len = ffb_len_out(&latm);
-			ffb_init_uint8_t(&latm, latm.nmemb + t->mtu_read);
-			ffb_seek(&latm, prev_len);
-		}
+		const bool fragment = markbit_quirk != 1 && !rtp_header->markbit;
 
-		memcpy(latm.tail, rtp_latm, rtp_latm_len);
-		ffb_seek(&latm, rtp_latm_len);
+		/* Unfragmented LATM frame is passed to the decoder straight from the
+		 * BT buffer. Only fragments are reassembled in the LATM buffer. */
+		uint8_t *latm_data = (uint8_t *)rtp_latm;
+		size_t latm_len = rtp_latm_len;
+
+		if (fragment || ffb_len_out(&latm) > 0) {
+
+			if (ffb_len_in(&latm) < rtp_latm_len) {
+				debug("Resizing LATM buffer: %zd -> %zd", latm.nmemb, latm.nmemb + t->mtu_read);
+				size_t prev_len = ffb_len_out(&latm);
+				ffb_init_uint8_t(&latm, latm.nmemb + t->mtu_read);
+				ffb_seek(&latm, prev_len);
+			}
+
+			memcpy(latm.tail, rtp_latm, rtp_latm_len);
+			ffb_seek(&latm, rtp_latm_len);
+
+			if (fragment) {
+				debug("Fragmented RTP packet [%u]: LATM len: %zd", io.rtp_seq_number, rtp_latm_len);
+				continue;
+			}
+
+			latm_data = latm.data;
+			latm_len = ffb_len_out(&latm);
 
-		if (markbit_quirk != 1 && !rtp_header->markbit) {
-			debug("Fragmented RTP packet [%u]: LATM len: %zd", io.rtp_seq_number, rtp_latm_len);
-			continue;
 		}
 
-		unsigned int data_len = ffb_len_out(&latm);
-		unsigned int valid = ffb_len_out(&latm);
+		unsigned int data_len = latm_len;
+		unsigned int valid = latm_len;
 		CStreamInfo *aacinf;
 
-		if ((err = aacDecoder_Fill(handle, (uint8_t **)&latm.data, &data_len, &valid)) != AAC_DEC_OK)
+		if ((err = aacDecoder_Fill(handle, &latm_data, &data_len, &valid)) != AAC_DEC_OK)
 			error("AAC buffer fill error: %s", aacdec_strerror(err));
 		else if ((err = aacDecoder_DecodeFrame(handle, pcm.tail, ffb_blen_in(&pcm), 0)) != AAC_DEC_OK)
 			error("AAC decode frame error: %s", aacdec_strerror(err));
@@ -1270,7 +1731,8 @@ static void *a2dp_sink_aac(struct ba_transport_thread *th) {
 			error("Couldn't get AAC stream info");
 		else {
 			const size_t samples = aacinf->frameSize * aacinf->numChannels;
-			if (ba_transport_pcm_write(&t->a2dp.pcm, pcm.data, samples) == -1)
+			if (a2dp_sink_pcm_write(&t->a2dp.pcm, pcm.data, samples,
+						BA_TRANSPORT_PCM_FORMAT_S16_2LE) == -1)
 				error("FIFO write error: %s", strerror(errno));
 		}
 
@@ -1452,8 +1914,10 @@ static void *a2dp_source_aac(struct ba_transport_thread *th) {
 
 		while ((in_args.numInSamples = ffb_len_out(&pcm)) > 0) {
 
+			trace2(encode_begin, A2DP_CODEC_MPEG24, in_args.numInSamples);
 			if ((err = aacEncEncode(handle, &in_buf, &out_buf, &in_args, &out_args)) != AACENC_OK)
 				error("AAC encoding error: %s", aacenc_strerror(err));
+			trace2(encode_end, A2DP_CODEC_MPEG24, out_args.numOutBytes);
 
 			if (out_args.numOutBytes > 0) {
 
@@ -1592,7 +2056,7 @@ static void *a2dp_sink_aptx(struct ba_transport_thread *th) {
 
 			if ((len = aptxdec_decode(handle, input, input_len, pcm.tail, &decoded)) <= 0) {
 				error("Apt-X decoding error: %s", strerror(errno));
-				continue;
+				break;
 			}
 
 			input += len;
@@ -1601,7 +2065,8 @@ static void *a2dp_sink_aptx(struct ba_transport_thread *th) {
 
 		}
 
-		if (ba_transport_pcm_write(&t->a2dp.pcm, pcm.data, ffb_len_out(&pcm)) == -1)
+		if (a2dp_sink_pcm_write(&t->a2dp.pcm, pcm.data, ffb_len_out(&pcm),
+					BA_TRANSPORT_PCM_FORMAT_S16_2LE) == -1)
 			error("FIFO write error: %s", strerror(errno));
 
 	}
@@ -1673,29 +2138,25 @@ static void *a2dp_source_aptx(struct ba_transport_thread *th) {
 		/* encode and transfer obtained data */
 		while (input_samples >= aptx_pcm_samples) {
 
-			size_t output_len = ffb_len_in(&bt);
-			size_t pcm_samples = 0;
+			size_t encoded = ffb_len_in(&bt);
+			ssize_t pcm_samples;
 
 			/* Generate as many apt-X frames as possible to fill the output buffer
 			 * without overflowing it. The size of the output buffer is based on
-			 * the socket MTU, so such a transfer should be most efficient. */
-			while (input_samples >= aptx_pcm_samples && output_len >= aptx_code_len) {
-
-				size_t encoded = output_len;
-				ssize_t len;
-
-				if ((len = aptxenc_encode(handle, input, input_samples, bt.tail, &encoded)) <= 0) {
-					error("Apt-X encoding error: %s", strerror(errno));
-					break;
-				}
-
-				input += len;
-				input_samples -= len;
-				ffb_seek(&bt, encoded);
-				output_len -= encoded;
-				pcm_samples += len;
-
+			 * the socket MTU, so such a transfer should be most efficient. The
+			 * encoder processes the whole buffer with a single call. */
+			trace2(encode_begin, A2DP_CODEC_VENDOR_APTX, input_samples);
+			if ((pcm_samples = aptxenc_encode(handle, input, input_samples, bt.tail, &encoded)) <= 0) {
+				error("Apt-X encoding error: %s", strerror(errno));
+				/* drop PCM data which can not be encoded */
+				input_samples = 0;
+				break;
 			}
+			trace2(encode_end, A2DP_CODEC_VENDOR_APTX, encoded);
+
+			input += pcm_samples;
+			input_samples -= pcm_samples;
+			ffb_seek(&bt, encoded);
 
 			if (a2dp_write_bt(&io, &bt) == -1) {
 				debug("BT socket disconnected: %d", t->bt_fd);
@@ -1788,7 +2249,7 @@ static void *a2dp_sink_aptx_hd(struct ba_transport_thread *th) {
 		}
 
 		const uint8_t *rtp_payload;
-		if ((rtp_payload = a2dp_validate_rtp(bt.data, &io)) == NULL)
+		if ((rtp_payload = a2dp_validate_rtp(bt.data, len, 0, &io)) == NULL)
 			continue;
 
 		size_t rtp_payload_len = len - (rtp_payload - (uint8_t *)bt.data);
@@ -1801,7 +2262,7 @@ static void *a2dp_sink_aptx_hd(struct ba_transport_thread *th) {
 
 			if ((len = aptxhddec_decode(handle, rtp_payload, rtp_payload_len, pcm.tail, &decoded)) <= 0) {
 				error("Apt-X decoding error: %s", strerror(errno));
-				continue;
+				break;
 			}
 
 			rtp_payload += len;
@@ -1810,7 +2271,8 @@ static void *a2dp_sink_aptx_hd(struct ba_transport_thread *th) {
 
 		}
 
-		if (ba_transport_pcm_write(&t->a2dp.pcm, pcm.data, ffb_len_out(&pcm)) == -1)
+		if (a2dp_sink_pcm_write(&t->a2dp.pcm, pcm.data, ffb_len_out(&pcm),
+					BA_TRANSPORT_PCM_FORMAT_S24_4LE) == -1)
 			error("FIFO write error: %s", strerror(errno));
 
 	}
@@ -1893,29 +2355,25 @@ static void *a2dp_source_aptx_hd(struct ba_transport_thread *th) {
 			/* anchor for RTP payload */
 			bt.tail = rtp_payload;
 
-			size_t output_len = ffb_len_in(&bt);
-			size_t pcm_samples = 0;
+			size_t encoded = ffb_len_in(&bt);
+			ssize_t pcm_samples;
 
 			/* Generate as many apt-X frames as possible to fill the output buffer
 			 * without overflowing it. The size of the output buffer is based on
-			 * the socket MTU, so such a transfer should be most efficient. */
-			while (input_samples >= aptx_pcm_samples && output_len >= aptx_code_len) {
-
-				size_t encoded = output_len;
-				ssize_t len;
-
-				if ((len = aptxhdenc_encode(handle, input, input_samples, bt.tail, &encoded)) <= 0) {
-					error("Apt-X HD encoding error: %s", strerror(errno));
-					break;
-				}
-
-				input += len;
-				input_samples -= len;
-				ffb_seek(&bt, encoded);
-				output_len -= encoded;
-				pcm_samples += len;
-
+			 * the socket MTU, so such a transfer should be most efficient. The
+			 * encoder processes the whole buffer with a single call. */
+			trace2(encode_begin, A2DP_CODEC_VENDOR_APTX_HD, input_samples);
+			if ((pcm_samples = aptxhdenc_encode(handle, input, input_samples, bt.tail, &encoded)) <= 0) {
+				error("Apt-X HD encoding error: %s", strerror(errno));
+				/* drop PCM data which can not be encoded */
+				input_samples = 0;
+				break;
 			}
+			trace2(encode_end, A2DP_CODEC_VENDOR_APTX_HD, encoded);
+
+			input += pcm_samples;
+			input_samples -= pcm_samples;
+			ffb_seek(&bt, encoded);
 
 			if (a2dp_write_bt(&io, &bt) == -1) {
 				debug("BT socket disconnected: %d", t->bt_fd);
@@ -1998,7 +2456,10 @@ static void *a2dp_sink_ldac(struct ba_transport_thread *th) {
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &bt);
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &pcm);
 
-	if (ffb_init_int32_t(&pcm, LDACBT_MAX_LSU * channels) == -1 ||
+	/* Buffer for all LDAC frames carried by a single RTP packet, so the
+	 * decoded PCM can be written to the FIFO with a single call. */
+	const size_t ldac_pcm_samples = LDACBT_MAX_LSU * channels;
+	if (ffb_init_int32_t(&pcm, ldac_pcm_samples * RTP_MEDIA_MAX_FRAMES) == -1 ||
 			ffb_init_uint8_t(&bt, t->mtu_read) == -1) {
 		error("Couldn't create data buffers: %s", strerror(errno));
 		goto fail_ffb;
@@ -2022,7 +2483,8 @@ static void *a2dp_sink_ldac(struct ba_transport_thread *th) {
 		}
 
 		const rtp_media_header_t *rtp_media_header;
-		if ((rtp_media_header = a2dp_validate_rtp(bt.data, &io)) == NULL)
+		if ((rtp_media_header = a2dp_validate_rtp(bt.data, len,
+						sizeof(*rtp_media_header), &io)) == NULL)
 			continue;
 
 		const uint8_t *rtp_payload = (uint8_t *)(rtp_media_header + 1);
@@ -2034,7 +2496,12 @@ static void *a2dp_sink_ldac(struct ba_transport_thread *th) {
 			int used;
 			int decoded;
 
-			if (ldacBT_decode(handle, (void *)rtp_payload, pcm.data,
+			/* LDAC decoder does not take the output buffer size, so make sure
+			 * that the buffer can hold the biggest possible frame. */
+			if (ffb_len_in(&pcm) < ldac_pcm_samples)
+				break;
+
+			if (ldacBT_decode(handle, (void *)rtp_payload, pcm.tail,
 						LDACBT_SMPL_FMT_S32, rtp_payload_len, &used, &decoded) != 0) {
 				error("LDAC decoding error: %s", ldacBT_strerror(ldacBT_get_error_code(handle)));
 				break;
@@ -2043,12 +2510,16 @@ static void *a2dp_sink_ldac(struct ba_transport_thread *th) {
 			rtp_payload += used;
 			rtp_payload_len -= used;
 
-			const size_t samples = decoded / sample_size;
-			if (ba_transport_pcm_write(&t->a2dp.pcm, pcm.data, samples) == -1)
-				error("FIFO write error: %s", strerror(errno));
+			ffb_seek(&pcm, decoded / sample_size);
 
 		}
 
+		if (ffb_len_out(&pcm) > 0 &&
+				a2dp_sink_pcm_write(&t->a2dp.pcm, pcm.data, ffb_len_out(&pcm),
+					BA_TRANSPORT_PCM_FORMAT_S32_4LE) == -1)
+			error("FIFO write error: %s", strerror(errno));
+		ffb_rewind(&pcm);
+
 	}
 
 fail:
@@ -2100,7 +2571,26 @@ static void *a2dp_source_ldac(struct ba_transport_thread *th) {
 	const unsigned int samplerate = t->a2dp.pcm.sampling;
 	const size_t ldac_pcm_samples = LDACBT_ENC_LSU * channels;
 
-	if (ldacBT_init_handle_encode(handle, t->mtu_write, config.ldac_eqmid,
+	int eqmid = config.ldac_eqmid;
+	if (config.hci_bitrate_limit != 0) {
+		/* Nominal LDAC bitrates (kbps) for 44.1 kHz and 48 kHz families. */
+		static const unsigned int bitrates[][LDACBT_EQMID_NUM] = {
+			[0] = { [LDACBT_EQMID_HQ] = 909, [LDACBT_EQMID_SQ] = 606, [LDACBT_EQMID_MQ] = 303 },
+			[1] = { [LDACBT_EQMID_HQ] = 990, [LDACBT_EQMID_SQ] = 660, [LDACBT_EQMID_MQ] = 330 },
+		};
+		const unsigned int *bitrate = bitrates[samplerate % 44100 != 0];
+		/* Lower the encoder quality if the aggregate bitrate of
+		 * the adapter would exceed configured limit otherwise. */
+		const unsigned int load = ba_adapter_get_bitrate(t->d->a, t);
+		while (eqmid < LDACBT_EQMID_MQ &&
+				load + bitrate[eqmid] * 1000 > config.hci_bitrate_limit)
+			eqmid++;
+		if (eqmid != config.ldac_eqmid)
+			info("Adapter load %u kbps: Lowering LDAC quality: %d -> %d",
+					load / 1000, config.ldac_eqmid, eqmid);
+	}
+
+	if (ldacBT_init_handle_encode(handle, t->mtu_write, eqmid,
 				configuration->channel_mode, LDACBT_SMPL_FMT_S32, samplerate) == -1) {
 		error("Couldn't initialize LDAC encoder: %s", ldacBT_strerror(ldacBT_get_error_code(handle)));
 		goto fail_init;
@@ -2148,7 +2638,7 @@ static void *a2dp_source_ldac(struct ba_transport_thread *th) {
 			goto fail;
 		}
 
-		int16_t *input = pcm.data;
+		int32_t *input = pcm.data;
 		size_t input_len = samples;
 
 		/* encode and transfer obtained data */
@@ -2161,10 +2651,12 @@ static void *a2dp_source_ldac(struct ba_transport_thread *th) {
 			int encoded;
 			int frames;
 
+			trace2(encode_begin, A2DP_CODEC_VENDOR_LDAC, input_len);
 			if (ldacBT_encode(handle, input, &used, bt.tail, &encoded, &frames) != 0) {
 				error("LDAC encoding error: %s", ldacBT_strerror(ldacBT_get_error_code(handle)));
 				break;
 			}
+			trace2(encode_end, A2DP_CODEC_VENDOR_LDAC, encoded);
 
 			rtp_media_header->frame_count = frames;
 
@@ -2225,7 +2717,11 @@ fail_open_ldac:
 
 #if DEBUG
 /**
- * Dump incoming BT data to a file. */
+ * Dump incoming BT data to a file.
+ *
+ * Every BT packet is preceded with its length encoded as a 16-bit big-endian
+ * integer, so the dump (prefixed with a codec selector byte) can be used as
+ * a seed for the fuzz-a2dp harness. */
 static void *a2dp_sink_dump(struct ba_transport_thread *th) {
 
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
@@ -2268,6 +2764,8 @@ static void *a2dp_sink_dump(struct ba_transport_thread *th) {
 			goto fail;
 		}
 		debug("BT read: %zd", len);
+		const uint8_t hdr[2] = { len >> 8, len & 0xFF };
+		fwrite(hdr, 1, sizeof(hdr), f);
 		fwrite(bt.data, 1, len, f);
 	}
 
@@ -2283,11 +2781,45 @@ fail_open:
 }
 #endif
 
+/**
+ * Start capturing BT traffic of the given transport.
+ *
+ * Every transport start creates new capture file in the directory given by
+ * the global configuration. If capturing is not enabled, this function does
+ * nothing. */
+static void a2dp_audio_capture_start(struct ba_transport *t) {
+
+	const bdaddr_t *addr = &t->d->addr;
+	char path[PATH_MAX];
+
+	/* close capture from the previous transport start (if any) */
+	a2dp_capture_close(t->a2dp.capture);
+	t->a2dp.capture = NULL;
+
+	if (config.a2dp.capture_dir == NULL)
+		return;
+
+	snprintf(path, sizeof(path),
+			"%s/ba-%02X%02X%02X%02X%02X%02X-a2dp-%s-%s-%ld.bacap",
+			config.a2dp.capture_dir,
+			addr->b[5], addr->b[4], addr->b[3], addr->b[2], addr->b[1], addr->b[0],
+			t->type.profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE ? "source" : "sink",
+			ba_transport_codecs_a2dp_to_string(t->type.codec), (long)time(NULL));
+
+	if ((t->a2dp.capture = a2dp_capture_open(path, t->type.profile, t->type.codec,
+					t->mtu_read, t->mtu_write, t->a2dp.configuration,
+					t->a2dp.codec->capabilities_size)) == NULL)
+		error("Couldn't create A2DP capture file: %s: %s", path, strerror(errno));
+
+}
+
 int a2dp_audio_thread_create(struct ba_transport *t) {
 
 	struct ba_transport_thread *th_enc = &t->thread_enc;
 	struct ba_transport_thread *th_dec = &t->thread_dec;
 
+	a2dp_audio_capture_start(t);
+
 	if (t->type.profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE)
 		switch (t->type.codec) {
 		case A2DP_CODEC_SBC:
@@ -0,0 +1,208 @@
+/*
+ * BlueALSA - a2dp-capture.c
+ * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "a2dp-capture.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shared/log.h"
+#include "shared/rt.h"
+
+static struct a2dp_capture *a2dp_capture_new(FILE *f) {
+
+	struct a2dp_capture *c;
+	if ((c = calloc(1, sizeof(*c))) == NULL)
+		return NULL;
+
+	c->f = f;
+	pthread_mutex_init(&c->mutex, NULL);
+	gettimestamp(&c->ts0);
+
+	return c;
+}
+
+/**
+ * Create new capture file.
+ *
+ * @param path Path to the capture file.
+ * @param profile BlueALSA transport profile.
+ * @param codec_id A2DP codec ID.
+ * @param mtu_read Transport reading MTU.
+ * @param mtu_write Transport writing MTU.
+ * @param configuration A2DP codec configuration blob.
+ * @param configuration_size Size of the configuration blob.
+ * @return On success this function returns capture handler. Otherwise,
+ *   NULL is returned and errno is set to indicate the error. */
+struct a2dp_capture *a2dp_capture_open(const char *path, uint16_t profile,
+		uint16_t codec_id, size_t mtu_read, size_t mtu_write,
+		const void *configuration, size_t configuration_size) {
+
+	struct a2dp_capture *c = NULL;
+	FILE *f;
+
+	if (configuration_size > sizeof(c->configuration))
+		return errno = EINVAL, NULL;
+
+	if ((f = fopen(path, "wb")) == NULL)
+		return NULL;
+
+	struct a2dp_capture_header header = {
+		.version = htole16(A2DP_CAPTURE_VERSION),
+		.profile = htole16(profile),
+		.codec_id = htole16(codec_id),
+		.mtu_read = htole16(mtu_read),
+		.mtu_write = htole16(mtu_write),
+		.configuration_size = htole16(configuration_size),
+	};
+
+	memcpy(header.magic, A2DP_CAPTURE_MAGIC, sizeof(header.magic));
+
+	if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+			fwrite(configuration, 1, configuration_size, f) != configuration_size)
+		goto fail;
+
+	if ((c = a2dp_capture_new(f)) == NULL)
+		goto fail;
+
+	c->profile = profile;
+	c->codec_id = codec_id;
+	c->mtu_read = mtu_read;
+	c->mtu_write = mtu_write;
+	memcpy(c->configuration, configuration, configuration_size);
+	c->configuration_size = configuration_size;
+
+	debug("Opened A2DP capture file: %s", path);
+	return c;
+
+fail:
+	fclose(f);
+	return NULL;
+}
+
+/**
+ * Open existing capture file for replay.
+ *
+ * @param path Path to the capture file.
+ * @return On success this function returns capture handler with all the
+ *   capture properties set. Otherwise, NULL is returned and errno is set
+ *   to indicate the error. */
+struct a2dp_capture *a2dp_capture_open_replay(const char *path) {
+
+	struct a2dp_capture_header header;
+	struct a2dp_capture *c;
+	FILE *f;
+
+	if ((f = fopen(path, "rb")) == NULL)
+		return NULL;
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+			memcmp(header.magic, A2DP_CAPTURE_MAGIC, sizeof(header.magic)) != 0 ||
+			le16toh(header.version) != A2DP_CAPTURE_VERSION)
+		goto fail_format;
+
+	if ((c = a2dp_capture_new(f)) == NULL)
+		goto fail;
+
+	c->profile = le16toh(header.profile);
+	c->codec_id = le16toh(header.codec_id);
+	c->mtu_read = le16toh(header.mtu_read);
+	c->mtu_write = le16toh(header.mtu_write);
+	c->configuration_size = le16toh(header.configuration_size);
+
+	if (c->configuration_size > sizeof(c->configuration) ||
+			fread(c->configuration, 1, c->configuration_size, f) != c->configuration_size) {
+		a2dp_capture_close(c);
+		return errno = EINVAL, NULL;
+	}
+
+	return c;
+
+fail_format:
+	errno = EINVAL;
+fail:
+	fclose(f);
+	return NULL;
+}
+
+void a2dp_capture_close(struct a2dp_capture *c) {
+	if (c == NULL)
+		return;
+	fclose(c->f);
+	pthread_mutex_destroy(&c->mutex);
+	free(c);
+}
+
+/**
+ * Write BT packet to the capture file.
+ *
+ * This function is thread-safe, so it can be called by the encoder and
+ * decoder IO threads of the same transport at the same time. */
+int a2dp_capture_write(struct a2dp_capture *c, enum a2dp_capture_dir dir,
+		const void *data, size_t len) {
+
+	struct timespec ts;
+	int rv = 0;
+
+	gettimestamp(&ts);
+	difftimespec(&c->ts0, &ts, &ts);
+
+	const struct a2dp_capture_record record = {
+		.timestamp = htole64(ts.tv_sec * 1000000000ULL + ts.tv_nsec),
+		.length = htole16(len),
+		.direction = dir,
+	};
+
+	pthread_mutex_lock(&c->mutex);
+	if (fwrite(&record, sizeof(record), 1, c->f) != 1 ||
+			fwrite(data, 1, len, c->f) != len)
+		rv = -1;
+	pthread_mutex_unlock(&c->mutex);
+
+	return rv;
+}
+
+/**
+ * Read next BT packet from the capture file.
+ *
+ * @param c Capture handler opened with a2dp_capture_open_replay().
+ * @param dir Address where the packet direction will be stored.
+ * @param ts Address where the packet time-stamp (relative to the capture
+ *   start) will be stored.
+ * @param buffer Buffer for the packet data.
+ * @param size Size of the buffer. If the packet is bigger than the buffer,
+ *   it will be truncated.
+ * @return On success this function returns the number of bytes stored in
+ *   the buffer. Upon end of the capture, zero is returned. On error, -1 is
+ *   returned and errno is set to indicate the error. */
+ssize_t a2dp_capture_read(struct a2dp_capture *c, enum a2dp_capture_dir *dir,
+		struct timespec *ts, void *buffer, size_t size) {
+
+	struct a2dp_capture_record record;
+
+	if (fread(&record, sizeof(record), 1, c->f) != 1)
+		return ferror(c->f) ? -1 : 0;
+
+	const uint64_t timestamp = le64toh(record.timestamp);
+	const size_t len = le16toh(record.length);
+
+	*dir = record.direction;
+	ts->tv_sec = timestamp / 1000000000;
+	ts->tv_nsec = timestamp % 1000000000;
+
+	const size_t n = len < size ? len : size;
+	if (fread(buffer, 1, n, c->f) != n ||
+			(len > n && fseek(c->f, len - n, SEEK_CUR) == -1))
+		return errno = EIO, -1;
+
+	return n;
+}
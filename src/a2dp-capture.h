@@ -0,0 +1,84 @@
+/*
+ * BlueALSA - a2dp-capture.h
+ * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef BLUEALSA_A2DPCAPTURE_H_
+#define BLUEALSA_A2DPCAPTURE_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
+
+/* Capture file starts with the header followed by the codec configuration
+ * blob. Then, there is a sequence of records, each one followed by the BT
+ * packet data. All multi-byte values are stored in the little-endian byte
+ * order. */
+#define A2DP_CAPTURE_MAGIC   "BACP"
+#define A2DP_CAPTURE_VERSION 1
+
+enum a2dp_capture_dir {
+	/* packet received from the BT socket */
+	A2DP_CAPTURE_DIR_RX = 0,
+	/* packet written to the BT socket */
+	A2DP_CAPTURE_DIR_TX = 1,
+};
+
+struct a2dp_capture_header {
+	char magic[4];
+	uint16_t version;
+	/* BlueALSA transport profile */
+	uint16_t profile;
+	/* A2DP codec ID */
+	uint16_t codec_id;
+	uint16_t mtu_read;
+	uint16_t mtu_write;
+	uint16_t configuration_size;
+} __attribute__ ((packed));
+
+struct a2dp_capture_record {
+	/* time since capture start in nanoseconds */
+	uint64_t timestamp;
+	uint16_t length;
+	uint8_t direction;
+	uint8_t reserved;
+} __attribute__ ((packed));
+
+struct a2dp_capture {
+
+	FILE *f;
+	/* serialize writes from encoder and decoder threads */
+	pthread_mutex_t mutex;
+	/* capture start time-stamp */
+	struct timespec ts0;
+
+	/* capture properties (host byte order) */
+	uint16_t profile;
+	uint16_t codec_id;
+	size_t mtu_read;
+	size_t mtu_write;
+	uint8_t configuration[32];
+	size_t configuration_size;
+
+};
+
+struct a2dp_capture *a2dp_capture_open(const char *path, uint16_t profile,
+		uint16_t codec_id, size_t mtu_read, size_t mtu_write,
+		const void *configuration, size_t configuration_size);
+struct a2dp_capture *a2dp_capture_open_replay(const char *path);
+void a2dp_capture_close(struct a2dp_capture *c);
+
+int a2dp_capture_write(struct a2dp_capture *c, enum a2dp_capture_dir dir,
+		const void *data, size_t len);
+ssize_t a2dp_capture_read(struct a2dp_capture *c, enum a2dp_capture_dir *dir,
+		struct timespec *ts, void *buffer, size_t size);
+
+#endif
@@ -57,6 +57,10 @@ typedef struct rtp_media_header {
 #endif
 } __attribute__ ((packed)) rtp_media_header_t;
 
+/**
+ * The maximum number of frames in a single media payload. */
+#define RTP_MEDIA_MAX_FRAMES 15
+
 /**
  * MPEG audio payload header.
  * See: https://tools.ietf.org/html/rfc2250 */
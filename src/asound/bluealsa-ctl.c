@@ -52,6 +52,8 @@ struct bt_dev {
 	char name[sizeof(((struct ctl_elem *)0)->name)];
 	int battery_level;
 	int mask;
+	/* battery element has been added for this device */
+	bool battery_elem;
 };
 
 struct bluealsa_ctl {
@@ -220,12 +222,18 @@ static struct bt_dev *bluealsa_dev_get(struct bluealsa_ctl *ctl, const struct ba
 			pcm->addr.b[5], pcm->addr.b[4], pcm->addr.b[3],
 			pcm->addr.b[2], pcm->addr.b[1], pcm->addr.b[0]);
 	dev->battery_level = -1;
+	dev->battery_elem = false;
 
 	/* Sort device list by an object path, so the bluealsa_dev_get_id() will
 	 * return consistent IDs ordering in case of name duplications. */
 	qsort(dev_list, ctl->dev_list_size, sizeof(*dev_list), bluealsa_bt_dev_cmp);
 
 	bluealsa_dev_fetch_name(ctl, dev);
+	/* Battery level is fetched only once, when the device is added to the
+	 * cache. All subsequent changes are pushed via the D-Bus signal. */
+	if (ctl->battery)
+		bluealsa_dev_fetch_battery(ctl, dev);
+
 	return dev;
 }
 
@@ -333,8 +341,10 @@ static int bluealsa_create_elem_list(struct bluealsa_ctl *ctl) {
 
 	/* Clear device mask, so we can distinguish currently used and unused (old)
 	 * device entries - we are not invalidating device list after PCM remove. */
-	for (i = 0; i < ctl->dev_list_size; i++)
+	for (i = 0; i < ctl->dev_list_size; i++) {
 		ctl->dev_list[i]->mask = 0;
+		ctl->dev_list[i]->battery_elem = false;
+	}
 
 	count = 0;
 
@@ -358,9 +368,9 @@ static int bluealsa_create_elem_list(struct bluealsa_ctl *ctl) {
 		bluealsa_elem_set_name(&elem_list[count], dev->name, -1);
 		count++;
 
-		/* Try to add special "battery" element. */
-		if (ctl->battery && dev->battery_level == -1 &&
-				bluealsa_dev_fetch_battery(ctl, dev) != -1) {
+		/* Add special "battery" element (once per device). */
+		if (ctl->battery && dev->battery_level != -1 && !dev->battery_elem) {
+			dev->battery_elem = true;
 			elem_list[count].type = CTL_ELEM_TYPE_BATTERY;
 			elem_list[count].dev = dev;
 			elem_list[count].pcm = pcm;
@@ -599,7 +609,7 @@ static void bluealsa_subscribe_events(snd_ctl_ext_t *ext, int subscribe) {
 		bluealsa_dbus_connection_signal_match_add(&ctl->dbus_ctx, ctl->dbus_ctx.ba_service, NULL,
 				DBUS_INTERFACE_PROPERTIES, "PropertiesChanged", "arg0='"BLUEALSA_INTERFACE_PCM"'");
 		bluealsa_dbus_connection_signal_match_add(&ctl->dbus_ctx, ctl->dbus_ctx.ba_service, NULL,
-				DBUS_INTERFACE_PROPERTIES, "PropertiesChanged", "arg0='"BLUEALSA_INTERFACE_RFCOMM"'");
+				BLUEALSA_INTERFACE_RFCOMM, "IndicatorChanged", "arg0='battery'");
 		bluealsa_dbus_connection_signal_match_add(&ctl->dbus_ctx, "org.bluez", NULL,
 				DBUS_INTERFACE_PROPERTIES, "PropertiesChanged", "arg0='org.bluez.Device1'");
 	}
@@ -690,20 +700,6 @@ static DBusHandlerResult bluealsa_dbus_msg_filter(DBusConnection *conn,
 					goto remove_add;
 			}
 
-		/* handle BlueALSA RFCOMM properties update */
-		if (strcmp(updated_interface, BLUEALSA_INTERFACE_RFCOMM) == 0)
-			for (i = 0; i < ctl->elem_list_size; i++) {
-				struct bt_dev *dev = ctl->elem_list[i].dev;
-				if (strcmp(dev->rfcomm_path, path) == 0) {
-					bluealsa_dbus_message_iter_dict(&iter, NULL,
-							bluealsa_dbus_msg_update_dev, dev);
-					if (dev->mask & SND_CTL_EVENT_MASK_ADD)
-						goto remove_add;
-					if (dev->mask & SND_CTL_EVENT_MASK_VALUE)
-						bluealsa_event_elem_updated(ctl, ctl->elem_list[i].name);
-				}
-			}
-
 		/* handle BlueALSA PCM properties update */
 		if (strcmp(updated_interface, BLUEALSA_INTERFACE_PCM) == 0)
 			for (i = 0; i < ctl->elem_list_size; i++) {
@@ -726,6 +722,40 @@ static DBusHandlerResult bluealsa_dbus_msg_filter(DBusConnection *conn,
 
 	}
 
+	/* handle BlueALSA RFCOMM indicator update */
+	if (strcmp(interface, BLUEALSA_INTERFACE_RFCOMM) == 0 &&
+			strcmp(signal, "IndicatorChanged") == 0) {
+
+		const char *indicator;
+		dbus_int32_t value;
+		if (!dbus_message_get_args(message, NULL,
+					DBUS_TYPE_STRING, &indicator,
+					DBUS_TYPE_INT32, &value,
+					DBUS_TYPE_INVALID) ||
+				strcmp(indicator, "battery") != 0)
+			return DBUS_HANDLER_RESULT_HANDLED;
+
+		for (i = 0; i < ctl->dev_list_size; i++) {
+			struct bt_dev *dev = ctl->dev_list[i];
+			if (strcmp(dev->rfcomm_path, path) != 0 ||
+					dev->battery_level == value)
+				continue;
+			/* battery element appears or disappears */
+			const bool add_remove = dev->battery_level == -1 || value == -1;
+			dev->battery_level = value;
+			if (!ctl->battery)
+				break;
+			if (add_remove)
+				goto remove_add;
+			for (size_t ii = 0; ii < ctl->elem_list_size; ii++)
+				if (ctl->elem_list[ii].dev == dev &&
+						ctl->elem_list[ii].type == CTL_ELEM_TYPE_BATTERY)
+					bluealsa_event_elem_updated(ctl, ctl->elem_list[ii].name);
+			break;
+		}
+
+	}
+
 	if (strcmp(interface, BLUEALSA_INTERFACE_MANAGER) == 0) {
 
 		if (strcmp(signal, "PCMAdded") == 0) {
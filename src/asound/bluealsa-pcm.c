@@ -37,6 +37,7 @@
 #include "shared/defs.h"
 #include "shared/log.h"
 #include "shared/rt.h"
+#include "shared/trace.h"
 
 #define BA_PAUSE_STATE_RUNNING 0
 #define BA_PAUSE_STATE_PAUSED  (1 << 0)
@@ -218,6 +219,7 @@ static void *io_thread(snd_pcm_ioplug_t *io) {
 		if (pcm->pause_state & BA_PAUSE_STATE_PENDING ||
 				pcm->io_hw_ptr == -1) {
 			debug2("Pausing IO thread: %ld", pcm->io_hw_ptr);
+			trace1(io_pause, pcm->io_hw_ptr);
 
 			pthread_mutex_lock(&pcm->mutex);
 			pcm->pause_state = BA_PAUSE_STATE_PAUSED;
@@ -232,6 +234,7 @@ static void *io_thread(snd_pcm_ioplug_t *io) {
 			pthread_mutex_unlock(&pcm->mutex);
 
 			debug2("IO thread resumed");
+			trace1(io_resume, pcm->io_hw_ptr);
 
 			if (pcm->io_hw_ptr == -1)
 				continue;
@@ -302,6 +305,7 @@ static void *io_thread(snd_pcm_ioplug_t *io) {
 			if (ret == 0)
 				goto fail;
 
+			trace2(io_read, pcm->ba_pcm_fd, frames);
 			io_thread_update_delay(pcm, io_hw_ptr);
 
 		}
@@ -320,6 +324,7 @@ static void *io_thread(snd_pcm_ioplug_t *io) {
 				len -= ret;
 			} while (len != 0);
 
+			trace2(io_write, pcm->ba_pcm_fd, frames);
 			io_thread_update_delay(pcm, io_hw_ptr);
 
 			/* synchronize playback time */
@@ -335,6 +340,7 @@ static void *io_thread(snd_pcm_ioplug_t *io) {
 sync:
 		/* Make the new HW pointer value visible to the ioplug. */
 		pcm->io_hw_ptr = io_hw_ptr;
+		trace1(io_period, io_hw_ptr);
 
 		/* Generate poll() event so application is made aware of
 		 * the HW pointer change. */
@@ -439,6 +445,25 @@ static int bluealsa_close(snd_pcm_ioplug_t *io) {
 	return 0;
 }
 
+/**
+ * Get BlueALSA PCM format code for the given ALSA PCM format. */
+static uint16_t get_ba_pcm_format(snd_pcm_format_t format) {
+	switch (format) {
+	case SND_PCM_FORMAT_U8:
+		return 0x0108;
+	case SND_PCM_FORMAT_S16_LE:
+		return 0x8210;
+	case SND_PCM_FORMAT_S24_3LE:
+		return 0x8318;
+	case SND_PCM_FORMAT_S24_LE:
+		return 0x8418;
+	case SND_PCM_FORMAT_S32_LE:
+		return 0x8420;
+	default:
+		return 0;
+	}
+}
+
 static int bluealsa_hw_params(snd_pcm_ioplug_t *io, snd_pcm_hw_params_t *params) {
 	struct bluealsa_pcm *pcm = io->private_data;
 	(void)params;
@@ -446,9 +471,20 @@ static int bluealsa_hw_params(snd_pcm_ioplug_t *io, snd_pcm_hw_params_t *params)
 
 	pcm->frame_size = (snd_pcm_format_physical_width(io->format) * io->channels) / 8;
 
+	/* If the selected format differs from the one reported by the PCM, it
+	 * is one of the higher resolution formats advertised for the A2DP source,
+	 * so it has to be explicitly requested. */
+	const uint16_t format = get_ba_pcm_format(io->format);
+
 	DBusError err = DBUS_ERROR_INIT;
-	if (!bluealsa_dbus_open_pcm(&pcm->dbus_ctx, pcm->ba_pcm.pcm_path,
-				&pcm->ba_pcm_fd, &pcm->ba_pcm_ctrl_fd, &err)) {
+	dbus_bool_t rv;
+	if (format == pcm->ba_pcm.format)
+		rv = bluealsa_dbus_open_pcm(&pcm->dbus_ctx, pcm->ba_pcm.pcm_path,
+				&pcm->ba_pcm_fd, &pcm->ba_pcm_ctrl_fd, &err);
+	else
+		rv = bluealsa_dbus_open_pcm_format(&pcm->dbus_ctx, pcm->ba_pcm.pcm_path,
+				format, &pcm->ba_pcm_fd, &pcm->ba_pcm_ctrl_fd, &err);
+	if (!rv) {
 		debug2("Couldn't open PCM: %s", err.message);
 		dbus_error_free(&err);
 		return -EBUSY;
@@ -925,9 +961,19 @@ static int bluealsa_set_hw_constraint(struct bluealsa_pcm *pcm) {
 					ARRAYSIZE(accesses), accesses)) < 0)
 		return err;
 
-	unsigned int formats[] = { get_snd_pcm_format(pcm->ba_pcm.format) };
+	unsigned int formats[3] = { get_snd_pcm_format(pcm->ba_pcm.format) };
+	size_t formats_len = 1;
+
+	/* A2DP source with 16-bit PCM format requantizes higher resolution
+	 * signal, so in such case we can advertise these formats as well. */
+	if (pcm->ba_pcm.transport & BA_PCM_TRANSPORT_A2DP_SOURCE &&
+			pcm->ba_pcm.format == 0x8210) {
+		formats[formats_len++] = SND_PCM_FORMAT_S24_LE;
+		formats[formats_len++] = SND_PCM_FORMAT_S32_LE;
+	}
+
 	if ((err = snd_pcm_ioplug_set_param_list(io, SND_PCM_IOPLUG_HW_FORMAT,
-					ARRAYSIZE(formats), formats)) < 0)
+					formats_len, formats)) < 0)
 		return err;
 
 	if ((err = snd_pcm_ioplug_set_param_minmax(io, SND_PCM_IOPLUG_HW_PERIODS,
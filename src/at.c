@@ -12,6 +12,7 @@
 #include "at.h"
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -63,49 +64,22 @@ char *at_build(char *buffer, enum bt_at_type type, const char *command,
 }
 
 /**
- * Parse AT message.
+ * Tokenize AT message in place.
  *
- * @param str String to parse.
+ * @param str Null-terminated AT message without the "AT" prefix (in case of
+ *   the AT command) or without the leading <LF> (in case of the response).
+ *   This string will be modified.
+ * @param is_command Determines whether the message is an AT command.
  * @param at Address of the AT structure, where the parsed information will
- *   be stored.
- * @return On success this function returns a pointer to the next message
- *   within the input string. If the input string contains only one message,
- *   returned value will point to the end null byte. On error, this function
- *   returns NULL. */
-char *at_parse(const char *str, struct bt_at *at) {
+ *   be stored. */
+static void at_tokenize(char *str, bool is_command, struct bt_at *at) {
 
-	char *command = at->command;
-	bool is_command = false;
-	const char *feed;
+	char *command = str;
 	char *tmp;
 
-	/* locate <CR> character, which indicates end of message */
-	if ((feed = strchr(str, '\r')) == NULL)
-		return NULL;
-
-	/* consume empty message */
-	if (feed == str)
-		return at_parse(feed + 1, at);
-
-	/* check whether we are parsing AT command */
-	if (strncasecmp(str, "AT", 2) == 0) {
-		is_command = true;
-		str += 2;
-	}
-	else {
-		/* response starts with <LF> sequence */
-		if (str[0] != '\n')
-			return NULL;
-		str += 1;
-	}
-
-	strncpy(command, str, sizeof(at->command) - 1);
+	at->command = command;
 	at->value = NULL;
 
-	/* check everything twice (we don't want to be hacked) */
-	if ((size_t)(feed - str) < sizeof(at->command))
-		command[feed - str] = '\0';
-
 	if (is_command) {
 
 		/* determine command type */
@@ -140,26 +114,234 @@ char *at_parse(const char *str, struct bt_at *at) {
 		}
 		else {
 			/* unsolicited (with empty command) result code */
-			at->value = memmove(command + 1, command, sizeof(at->command) - 1);
-			command[0] = command[sizeof(at->command) - 1] = '\0';
+			at->command = &command[strlen(command)];
+			at->value = command;
 		}
 
-		/* consume <LF> from the end of the response */
-		if (feed[1] == '\n')
-			feed++;
-
 	}
 
 	/* In the BT specification, all AT commands are in uppercase letters.
 	 * However, if someone will not respect this "convention", we will make
 	 * life easier by converting received command to all uppercase. */
-	while (*command != '\0') {
+	for (command = at->command; *command != '\0'; command++)
 		*command = toupper(*command);
-		command++;
-	}
 
 	debug("AT message: %s: command:%s, value:%s", at_type2str(at->type), at->command, at->value);
-	return (char *)&feed[1];
+}
+
+/**
+ * Parse AT message.
+ *
+ * The message is tokenized in place, so the command and the value of the
+ * parsed AT message point directly into the given string.
+ *
+ * @param str String to parse. This string will be modified.
+ * @param at Address of the AT structure, where the parsed information will
+ *   be stored.
+ * @return On success this function returns a pointer to the next message
+ *   within the input string. If the input string contains only one message,
+ *   returned value will point to the end null byte. On error, this function
+ *   returns NULL. */
+char *at_parse(char *str, struct bt_at *at) {
+
+	bool is_command = false;
+	char *feed;
+
+	/* locate <CR> character, which indicates end of message */
+	if ((feed = strchr(str, '\r')) == NULL)
+		return NULL;
+
+	/* consume empty message */
+	if (feed == str)
+		return at_parse(feed + 1, at);
+
+	/* check whether we are parsing AT command */
+	if (strncasecmp(str, "AT", 2) == 0) {
+		is_command = true;
+		str += 2;
+	}
+	else {
+		/* response starts with <LF> sequence */
+		if (str[0] != '\n')
+			return NULL;
+		str += 1;
+	}
+
+	*feed = '\0';
+	at_tokenize(str, is_command, at);
+
+	/* consume <LF> from the end of the response */
+	if (!is_command && feed[1] == '\n')
+		feed++;
+
+	return &feed[1];
+}
+
+/**
+ * Initialize streaming AT message reader.
+ *
+ * @param reader Address of the reader structure. */
+void at_reader_init(struct at_reader *reader) {
+	reader->head = reader->tail = reader->scan = 0;
+	reader->response = false;
+	reader->response_lf = false;
+	reader->discard = false;
+}
+
+/**
+ * Get free space within the AT message reader buffer.
+ *
+ * Data which have not been processed yet are moved to the beginning of the
+ * buffer, so all pointers to previously parsed messages become invalid. If
+ * the buffer is full with a single incomplete message, such message will be
+ * discarded. Hence, this function shall be called only after all complete
+ * messages were retrieved with the at_reader_next() function.
+ *
+ * @param reader Address of the reader structure.
+ * @param size Address where the size of the free space will be stored.
+ * @return Pointer to the free space, where new data shall be written. After
+ *   writing data, the at_reader_commit() function shall be called. */
+char *at_reader_get_buffer(struct at_reader *reader, size_t *size) {
+
+	if (reader->head > 0) {
+		memmove(reader->buffer, &reader->buffer[reader->head], reader->tail - reader->head);
+		reader->tail -= reader->head;
+		reader->scan -= reader->head;
+		reader->head = 0;
+	}
+
+	if (reader->tail == sizeof(reader->buffer)) {
+		warn("AT message too long: %zu", reader->tail);
+		reader->tail = reader->scan = 0;
+		reader->discard = true;
+	}
+
+	*size = sizeof(reader->buffer) - reader->tail;
+	return &reader->buffer[reader->tail];
+}
+
+/**
+ * Commit data written into the AT message reader buffer.
+ *
+ * @param reader Address of the reader structure.
+ * @param len Number of bytes written into the buffer returned by the
+ *   at_reader_get_buffer() function. */
+void at_reader_commit(struct at_reader *reader, size_t len) {
+	reader->tail += len;
+}
+
+/**
+ * Feed AT message reader with data.
+ *
+ * @param reader Address of the reader structure.
+ * @param data Address of the data to be copied into the reader.
+ * @param len Length of the data.
+ * @return This function returns the number of bytes copied into the reader
+ *   buffer, which might be less than the given length. */
+size_t at_reader_feed(struct at_reader *reader, const void *data, size_t len) {
+
+	size_t size;
+	char *buffer = at_reader_get_buffer(reader, &size);
+
+	if (len > size)
+		len = size;
+
+	memcpy(buffer, data, len);
+	at_reader_commit(reader, len);
+	return len;
+}
+
+/**
+ * Get next AT message from the reader.
+ *
+ * This function can be called with partial data (e.g. when a single AT
+ * message was split between several RFCOMM reads) and with coalesced data
+ * (e.g. when more than one AT message was received in a single read). The
+ * scan position is preserved between calls, so every byte is examined only
+ * once regardless of how the data were fragmented.
+ *
+ * @param reader Address of the reader structure.
+ * @param at Address of the AT structure, where the parsed information will
+ *   be stored. The parsed message points into the reader buffer, and it is
+ *   valid until the next at_reader_get_buffer() or at_reader_feed() call.
+ * @return On success this function returns 0. Otherwise, -1 is returned and
+ *   errno is set to indicate the error: EAGAIN - there is no complete AT
+ *   message in the buffer, EBADMSG - invalid AT message was discarded. */
+int at_reader_next(struct at_reader *reader, struct bt_at *at) {
+
+	char *buffer = reader->buffer;
+	bool is_command = false;
+	char *msg;
+	char *feed;
+
+	if (reader->scan < reader->head)
+		reader->scan = reader->head;
+
+	if (reader->discard) {
+		if ((feed = memchr(&buffer[reader->scan], '\r', reader->tail - reader->scan)) == NULL) {
+			reader->head = reader->tail = reader->scan = 0;
+			errno = EAGAIN;
+			return -1;
+		}
+		reader->head = reader->scan = feed - buffer + 1;
+		reader->discard = false;
+		errno = EBADMSG;
+		return -1;
+	}
+
+	/* skip message delimiters */
+	while (reader->head < reader->tail) {
+		const char c = buffer[reader->head];
+		if (c == '\n') {
+			if (!reader->response_lf)
+				reader->response = true;
+		}
+		else if (c == '\r')
+			reader->response = false;
+		else
+			break;
+		reader->response_lf = false;
+		reader->head++;
+	}
+
+	if (reader->head == reader->tail) {
+		reader->head = reader->tail = reader->scan = 0;
+		errno = EAGAIN;
+		return -1;
+	}
+
+	if (reader->scan < reader->head)
+		reader->scan = reader->head;
+
+	/* locate <CR> character, which indicates end of message */
+	if ((feed = memchr(&buffer[reader->scan], '\r', reader->tail - reader->scan)) == NULL) {
+		reader->scan = reader->tail;
+		errno = EAGAIN;
+		return -1;
+	}
+
+	msg = &buffer[reader->head];
+	*feed = '\0';
+
+	reader->head = reader->scan = feed - buffer + 1;
+	reader->response_lf = false;
+
+	/* check whether we are parsing AT command */
+	if (strncasecmp(msg, "AT", 2) == 0) {
+		is_command = true;
+		msg += 2;
+	}
+	else if (!reader->response) {
+		debug("Invalid AT message: %s", msg);
+		errno = EBADMSG;
+		return -1;
+	}
+	else
+		reader->response_lf = true;
+
+	reader->response = false;
+	at_tokenize(msg, is_command, at);
+	return 0;
 }
 
 /**
@@ -13,6 +13,7 @@
 #define BLUEALSA_AT_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "hfp.h"
 
@@ -26,15 +27,41 @@ enum bt_at_type {
 	__AT_TYPE_MAX
 };
 
+/**
+ * Parsed AT message. Both command and value point directly into the
+ * buffer from which the message was parsed. */
 struct bt_at {
 	enum bt_at_type type;
-	char command[256];
+	char *command;
 	char *value;
 };
 
+/**
+ * Streaming AT message reader. */
+struct at_reader {
+	char buffer[512];
+	/* offset of the first not processed byte */
+	size_t head;
+	/* offset of the end of data */
+	size_t tail;
+	/* offset up to which data was scanned for <CR> */
+	size_t scan;
+	/* leading <LF> of the response was received */
+	bool response;
+	/* trailing <LF> of the response is expected */
+	bool response_lf;
+	/* discard data up to the next <CR> */
+	bool discard;
+};
+
 char *at_build(char *buffer, enum bt_at_type type, const char *command,
 		const char *value);
-char *at_parse(const char *str, struct bt_at *at);
+char *at_parse(char *str, struct bt_at *at);
+void at_reader_init(struct at_reader *reader);
+char *at_reader_get_buffer(struct at_reader *reader, size_t *size);
+void at_reader_commit(struct at_reader *reader, size_t len);
+size_t at_reader_feed(struct at_reader *reader, const void *data, size_t len);
+int at_reader_next(struct at_reader *reader, struct bt_at *at);
 int at_parse_bia(const char *str, bool state[__HFP_IND_MAX]);
 int at_parse_cind(const char *str, enum hfp_ind map[20]);
 int at_parse_cmer(const char *str, unsigned int map[5]);
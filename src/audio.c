@@ -133,3 +133,136 @@ void audio_silence_s32_4le(int32_t *buffer, int channels, size_t frames, bool ch
 		g_assert_not_reached();
 	}
 }
+
+/**
+ * Convert S16_2LE PCM signal to S32_4LE.
+ *
+ * @param dest Address to the buffer where the converted signal should be
+ *   stored. This buffer shall be big enough to hold samples samples.
+ * @param src Address to the buffer with the S16_2LE signal.
+ * @param samples The number of samples to convert. */
+void audio_s16_2le_to_s32_4le(int32_t *dest, const int16_t *src, size_t samples) {
+	for (size_t i = 0; i < samples; i++)
+		dest[i] = (uint32_t)(uint16_t)src[i] << 16;
+}
+
+/**
+ * Convert S24_4LE PCM signal to S32_4LE.
+ *
+ * @param dest Address to the buffer where the converted signal should be
+ *   stored. This buffer shall be big enough to hold samples samples.
+ * @param src Address to the buffer with the S24_4LE signal.
+ * @param samples The number of samples to convert. */
+void audio_s24_4le_to_s32_4le(int32_t *dest, const int32_t *src, size_t samples) {
+	for (size_t i = 0; i < samples; i++)
+		dest[i] = (uint32_t)src[i] << 8;
+}
+
+/**
+ * Initialize the dithered requantization state.
+ *
+ * @param dither Address to the dither state structure.
+ * @param noise_shaping If true, the requantization noise is shaped towards
+ *   higher frequencies, where it is less audible. */
+void audio_dither_init(struct audio_dither *dither, bool noise_shaping) {
+	memset(dither, 0, sizeof(*dither));
+	dither->seed = 0x6D2B79F5;
+	dither->noise_shaping = noise_shaping;
+}
+
+/**
+ * Convert S32_4LE PCM signal to S16_2LE with TPDF dither.
+ *
+ * Triangular probability density function (TPDF) dither with the amplitude
+ * of one LSB of the output is added to the signal before the rounding, which
+ * turns the truncation distortion into a constant noise floor. Optionally,
+ * the first-order error feedback moves the noise to higher frequencies.
+ *
+ * In order to allow seamless processing of a continuous stream, the state
+ * shall be preserved between calls. The number of samples does not have to
+ * be a multiple of the number of channels.
+ *
+ * @param dest Address to the buffer where the converted signal should be
+ *   stored. It is allowed to use the same buffer as the source one.
+ * @param src Address to the buffer with the S32_4LE signal.
+ * @param channels The number of channels in the buffer.
+ * @param samples The number of samples to convert.
+ * @param dither Address to the dither state structure. */
+void audio_s32_4le_to_s16_2le_dither(int16_t *dest, const int32_t *src,
+		int channels, size_t samples, struct audio_dither *dither) {
+
+	uint32_t seed = dither->seed;
+	unsigned int ch = dither->channel;
+
+	for (size_t i = 0; i < samples; i++) {
+
+		int64_t x = src[i];
+		if (dither->noise_shaping)
+			x -= dither->error[ch];
+
+		/* xorshift32 pseudo-random number generator */
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		/* the difference of two uniform random values has TPDF */
+		const int64_t tpdf = (int64_t)(seed & 0xFFFF) - (seed >> 16);
+		int64_t y = (x + tpdf + 0x8000) >> 16;
+
+		if (y > INT16_MAX)
+			y = INT16_MAX;
+		else if (y < INT16_MIN)
+			y = INT16_MIN;
+
+		/* The error is limited, so the noise shaping filter will not
+		 * oscillate after the signal has been clipped. */
+		int64_t error = y * 0x10000 - x;
+		if (error > 0x10000)
+			error = 0x10000;
+		else if (error < -0x10000)
+			error = -0x10000;
+		dither->error[ch] = error;
+
+		dest[i] = y;
+		if (++ch >= (unsigned int)channels)
+			ch = 0;
+
+	}
+
+	dither->seed = seed;
+	dither->channel = ch;
+}
+
+/**
+ * Downsample monophonic S16_2LE PCM signal by the factor of 2.
+ *
+ * Every pair of input samples is averaged into a single output sample,
+ * which gives a simple low-pass filter before the decimation.
+ *
+ * @param dest Address to the buffer where the downsampled signal should
+ *   be stored. This buffer shall be big enough to hold frames samples.
+ * @param src Address to the buffer with 2 * frames samples.
+ * @param frames The number of PCM frames to produce. */
+void audio_downsample_2x_s16_2le(int16_t *dest, const int16_t *src, size_t frames) {
+	for (size_t i = 0; i < frames; i++)
+		dest[i] = ((int32_t)src[i * 2] + src[i * 2 + 1]) / 2;
+}
+
+/**
+ * Upsample monophonic S16_2LE PCM signal by the factor of 2.
+ *
+ * Missing samples are linearly interpolated. In order to allow seamless
+ * processing of a continuous stream, the last sample of the previous call
+ * is stored in the location pointed by the last parameter.
+ *
+ * @param dest Address to the buffer where the upsampled signal should
+ *   be stored. This buffer shall be big enough to hold 2 * frames samples.
+ * @param src Address to the buffer with frames samples.
+ * @param frames The number of input PCM frames.
+ * @param last Address to the last sample of the previous call. */
+void audio_upsample_2x_s16_2le(int16_t *dest, const int16_t *src, size_t frames, int16_t *last) {
+	for (size_t i = 0; i < frames; i++) {
+		dest[i * 2] = ((int32_t)*last + src[i]) / 2;
+		dest[i * 2 + 1] = *last = src[i];
+	}
+}
@@ -19,6 +19,19 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/**
+ * State of the dithered requantization. */
+struct audio_dither {
+	/* pseudo-random number generator state */
+	uint32_t seed;
+	/* apply first-order noise shaping */
+	bool noise_shaping;
+	/* quantization error of the last sample of every channel */
+	int32_t error[2];
+	/* channel of the next sample */
+	unsigned int channel;
+};
+
 double audio_decibel_to_loudness(double value);
 double audio_loudness_to_decibel(double value);
 
@@ -30,4 +43,14 @@ void audio_silence_s16_2le(int16_t *buffer, int channels, size_t frames, bool ch
 void audio_silence_s32_4le(int32_t *buffer, int channels, size_t frames, bool ch1, bool ch2);
 #define audio_silence_s24_4le audio_silence_s32_4le
 
+void audio_s16_2le_to_s32_4le(int32_t *dest, const int16_t *src, size_t samples);
+void audio_s24_4le_to_s32_4le(int32_t *dest, const int32_t *src, size_t samples);
+
+void audio_dither_init(struct audio_dither *dither, bool noise_shaping);
+void audio_s32_4le_to_s16_2le_dither(int16_t *dest, const int32_t *src,
+		int channels, size_t samples, struct audio_dither *dither);
+
+void audio_downsample_2x_s16_2le(int16_t *dest, const int16_t *src, size_t frames);
+void audio_upsample_2x_s16_2le(int16_t *dest, const int16_t *src, size_t frames, int16_t *last);
+
 #endif
@@ -20,6 +20,7 @@
 #include <bluetooth/hci_lib.h>
 
 #include "ba-device.h"
+#include "ba-transport.h"
 #include "bluealsa.h"
 #include "hci.h"
 #include "hfp.h"
@@ -154,6 +155,36 @@ void ba_adapter_unref(struct ba_adapter *a) {
 	free(a);
 }
 
+/**
+ * Get aggregate BT link bitrate of all active transports.
+ *
+ * @param a Adapter for which the load shall be calculated.
+ * @param exclude Transport which shall not be taken into account. This
+ *   parameter might be NULL.
+ * @return This function returns bitrate in bits per second. */
+unsigned int ba_adapter_get_bitrate(struct ba_adapter *a,
+		const struct ba_transport *exclude) {
+
+	GHashTableIter iter_d, iter_t;
+	struct ba_device *d;
+	struct ba_transport *t;
+	unsigned int bitrate = 0;
+
+	pthread_mutex_lock(&a->devices_mutex);
+	g_hash_table_iter_init(&iter_d, a->devices);
+	while (g_hash_table_iter_next(&iter_d, NULL, (gpointer)&d)) {
+		pthread_mutex_lock(&d->transports_mutex);
+		g_hash_table_iter_init(&iter_t, d->transports);
+		while (g_hash_table_iter_next(&iter_t, NULL, (gpointer)&t))
+			if (t != exclude)
+				bitrate += ba_transport_get_bitrate(t);
+		pthread_mutex_unlock(&d->transports_mutex);
+	}
+	pthread_mutex_unlock(&a->devices_mutex);
+
+	return bitrate;
+}
+
 int ba_adapter_get_hfp_features_hf(struct ba_adapter *a) {
 	int features = config.hfp.features_rfcomm_hf;
 	if (BA_TEST_ESCO_SUPPORT(a)) {
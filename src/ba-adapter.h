@@ -23,6 +23,8 @@
 #include <bluetooth/hci.h>
 #include <bluetooth/hci_lib.h>
 
+struct ba_transport;
+
 /* Data associated with BT adapter. */
 struct ba_adapter {
 
@@ -57,6 +59,9 @@ void ba_adapter_unref(struct ba_adapter *a);
 #define BA_TEST_ESCO_SUPPORT(a) \
 	((a)->hci.features[2] & LMP_TRSP_SCO && (a)->hci.features[3] & LMP_ESCO)
 
+unsigned int ba_adapter_get_bitrate(struct ba_adapter *a,
+		const struct ba_transport *exclude);
+
 int ba_adapter_get_hfp_features_hf(struct ba_adapter *a);
 int ba_adapter_get_hfp_features_ag(struct ba_adapter *a);
 
@@ -12,9 +12,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "ba-transport.h"
 #include "hci.h"
+#include "shared/defs.h"
 #include "shared/log.h"
 
 struct ba_device *ba_device_new(
@@ -38,6 +40,12 @@ struct ba_device *ba_device_new(
 
 	d->battery_level = -1;
 
+	pthread_mutex_init(&d->indicators_mtx, NULL);
+	for (size_t i = 0; i < ARRAYSIZE(d->indicators); i++)
+		d->indicators[i] = -1;
+
+	d->pcm_handover.fd = -1;
+
 	pthread_mutex_init(&d->transports_mutex, NULL);
 	d->transports = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, NULL);
 
@@ -74,6 +82,116 @@ struct ba_device *ba_device_ref(
 	return d;
 }
 
+/**
+ * Update remote device indicator.
+ *
+ * Every indicator value change is recorded in the device history, which
+ * holds up to BA_DEVICE_INDICATOR_HISTORY_SIZE most recent changes. For
+ * the battery charge indicator, the device battery level is updated as
+ * well.
+ *
+ * @param d The BT device.
+ * @param ind The indicator which should be updated.
+ * @param value New indicator value or -1 if indicator is not available.
+ * @param event If not NULL, the recorded history entry is stored here.
+ * @return This function returns true if the indicator value has been
+ *   changed, otherwise false is returned. */
+bool ba_device_indicator_update(
+		struct ba_device *d,
+		enum hfp_ind ind,
+		int value,
+		struct ba_device_indicator *event) {
+
+	if (ind <= HFP_IND_NULL || ind >= __HFP_IND_MAX)
+		return false;
+
+	pthread_mutex_lock(&d->indicators_mtx);
+
+	if (d->indicators[ind] == value) {
+		pthread_mutex_unlock(&d->indicators_mtx);
+		return false;
+	}
+
+	d->indicators[ind] = value;
+	if (ind == HFP_IND_BATTCHG)
+		d->battery_level = value;
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	const size_t size = ARRAYSIZE(d->indicators_history);
+	size_t i = (d->indicators_history_head + d->indicators_history_len) % size;
+	if (d->indicators_history_len < size)
+		d->indicators_history_len++;
+	else
+		/* history is full, drop the oldest entry */
+		d->indicators_history_head = (d->indicators_history_head + 1) % size;
+
+	struct ba_device_indicator *e = &d->indicators_history[i];
+	e->timestamp = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	e->ind = ind;
+	e->value = value;
+
+	if (event != NULL)
+		*event = *e;
+
+	pthread_mutex_unlock(&d->indicators_mtx);
+	return true;
+}
+
+/**
+ * Get remote device indicator history.
+ *
+ * @param d The BT device.
+ * @param buffer Address of the buffer where history entries (from the
+ *   oldest one) will be stored.
+ * @param size The number of entries which fits into the buffer.
+ * @return This function returns the number of stored entries. */
+size_t ba_device_indicator_history(
+		struct ba_device *d,
+		struct ba_device_indicator *buffer,
+		size_t size) {
+
+	pthread_mutex_lock(&d->indicators_mtx);
+
+	const size_t len = d->indicators_history_len;
+	const size_t skip = len > size ? len - size : 0;
+	size_t i;
+
+	for (i = skip; i < len; i++)
+		buffer[i - skip] = d->indicators_history[
+			(d->indicators_history_head + i) % ARRAYSIZE(d->indicators_history)];
+
+	pthread_mutex_unlock(&d->indicators_mtx);
+	return len - skip;
+}
+
+/**
+ * Convert indicator into a human-readable string.
+ *
+ * @param ind The HFP indicator.
+ * @return Human-readable string or NULL for unknown indicator. */
+const char *ba_device_indicator_to_string(enum hfp_ind ind) {
+	switch (ind) {
+	case HFP_IND_SERVICE:
+		return "service";
+	case HFP_IND_CALL:
+		return "call";
+	case HFP_IND_CALLSETUP:
+		return "callsetup";
+	case HFP_IND_CALLHELD:
+		return "callheld";
+	case HFP_IND_SIGNAL:
+		return "signal";
+	case HFP_IND_ROAM:
+		return "roam";
+	case HFP_IND_BATTCHG:
+		return "battery";
+	default:
+		return NULL;
+	}
+}
+
 void ba_device_destroy(struct ba_device *d) {
 
 	/* XXX: Modification-safe remove-all loop.
@@ -134,6 +252,7 @@ void ba_device_unref(struct ba_device *d) {
 	ba_adapter_unref(a);
 	g_hash_table_unref(d->transports);
 	pthread_mutex_destroy(&d->transports_mutex);
+	pthread_mutex_destroy(&d->indicators_mtx);
 	g_free(d->bluez_dbus_path);
 	g_free(d->ba_dbus_path);
 	free(d);
@@ -16,12 +16,28 @@
 #endif
 
 #include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <bluetooth/bluetooth.h>
 #include <glib.h>
 
+#include "audio.h"
 #include "ba-adapter.h"
+#include "hfp.h"
+
+/* number of indicator changes kept in the device history */
+#define BA_DEVICE_INDICATOR_HISTORY_SIZE 32
+
+struct ba_device_indicator {
+	/* real-time timestamp in microseconds */
+	uint64_t timestamp;
+	enum hfp_ind ind;
+	/* indicator value or -1 if not available; the battery
+	 * charge level is stored as a percentage in range [0, 100] */
+	int value;
+};
 
 struct ba_device {
 
@@ -38,6 +54,14 @@ struct ba_device {
 	/* battery level in range [0, 100] or -1 */
 	int8_t battery_level;
 
+	/* remote device indicators with the history of recent changes */
+	pthread_mutex_t indicators_mtx;
+	int indicators[__HFP_IND_MAX];
+	struct ba_device_indicator indicators_history[BA_DEVICE_INDICATOR_HISTORY_SIZE];
+	/* index of the oldest entry and the number of entries */
+	size_t indicators_history_head;
+	size_t indicators_history_len;
+
 	/* Apple's extension used with HFP profile */
 	struct {
 
@@ -51,6 +75,27 @@ struct ba_device {
 
 	} xapl;
 
+	/* A2DP PCM connection kept alive during the codec reconfiguration,
+	 * this structure shall be accessed from the main thread only */
+	struct {
+
+		char *ba_dbus_path;
+		uint16_t format;
+		unsigned int channels;
+		unsigned int sampling;
+		/* FIFO format and requantization state */
+		uint16_t fifo_format;
+		struct audio_dither dither;
+
+		/* PCM FIFO and PCM controller channel */
+		int fd;
+		GIOChannel *controller;
+
+		/* time-out for the new transport to take the PCM over */
+		unsigned int timeout_id;
+
+	} pcm_handover;
+
 	/* read-only list of available SEPs */
 	const GArray *seps;
 
@@ -73,6 +118,18 @@ struct ba_device *ba_device_lookup(
 struct ba_device *ba_device_ref(
 		struct ba_device *d);
 
+bool ba_device_indicator_update(
+		struct ba_device *d,
+		enum hfp_ind ind,
+		int value,
+		struct ba_device_indicator *event);
+size_t ba_device_indicator_history(
+		struct ba_device *d,
+		struct ba_device_indicator *buffer,
+		size_t size);
+
+const char *ba_device_indicator_to_string(enum hfp_ind ind);
+
 void ba_device_destroy(struct ba_device *d);
 void ba_device_unref(struct ba_device *d);
 
@@ -31,39 +31,44 @@
 #include "shared/defs.h"
 #include "shared/log.h"
 
-/**
- * Structure used for buffered reading from the RFCOMM. */
-struct at_reader {
-	struct bt_at at;
-	char buffer[256];
-	/* pointer to the next message within the buffer */
-	char *next;
-};
-
 /**
  * Read AT message.
  *
- * Upon error it is required to set the next pointer of the reader structure
- * to NULL. Otherwise, this function might fail indefinitely.
+ * Buffered AT messages are processed before reading from the RFCOMM socket,
+ * and the socket is read at most once, so this function will not block if
+ * the socket was reported as readable by poll().
  *
- * @param fd RFCOMM socket file descriptor.
+ * @param fd RFCOMM socket file descriptor or -1 if only already buffered
+ *   data shall be processed.
  * @param reader Pointer to initialized reader structure.
+ * @param at Address of the AT structure, where the parsed message will be
+ *   stored.
  * @return On success this function returns 0. Otherwise, -1 is returned and
- *   errno is set to indicate the error. */
-static int rfcomm_read_at(int fd, struct at_reader *reader) {
+ *   errno is set to indicate the error. If there is no complete AT message
+ *   available, errno is set to EAGAIN. */
+static int rfcomm_read_at(int fd, struct at_reader *reader, struct bt_at *at) {
 
-	char *buffer = reader->buffer;
-	char *msg = reader->next;
-	char *tmp;
+	char *buffer;
+	size_t size;
+	ssize_t len;
 
-	/* In case of reading more than one message from the RFCOMM, we have to
-	 * parse all of them before we can read from the socket once more. */
-	if (msg == NULL) {
+	for (;;) {
 
-		ssize_t len;
+		if (at_reader_next(reader, at) == 0)
+			return 0;
+
+		if (errno == EBADMSG) {
+			warn("Invalid AT message");
+			continue;
+		}
+
+		if (fd == -1)
+			return -1;
+
+		buffer = at_reader_get_buffer(reader, &size);
 
 retry:
-		if ((len = read(fd, buffer, sizeof(reader->buffer))) == -1) {
+		if ((len = read(fd, buffer, size)) == -1) {
 			if (errno == EINTR)
 				goto retry;
 			return -1;
@@ -74,19 +79,11 @@ retry:
 			return -1;
 		}
 
-		buffer[len] = '\0';
-		msg = buffer;
-	}
+		at_reader_commit(reader, len);
+		fd = -1;
 
-	/* parse AT message received from the RFCOMM */
-	if ((tmp = at_parse(msg, &reader->at)) == NULL) {
-		reader->next = msg;
-		errno = EBADMSG;
-		return -1;
 	}
 
-	reader->next = tmp[0] != '\0' ? tmp : NULL;
-	return 0;
 }
 
 /**
@@ -128,6 +125,25 @@ static void rfcomm_set_hfp_state(struct ba_rfcomm *r, enum hfp_slc_state state)
 	r->state = state;
 }
 
+/**
+ * Update remote device indicator and notify D-Bus clients.
+ *
+ * @param r The RFCOMM structure.
+ * @param ind The indicator which should be updated.
+ * @param value New indicator value. For the battery charge
+ *   indicator it shall be a percentage in range [0, 100]. */
+static void rfcomm_update_indicator(struct ba_rfcomm *r, enum hfp_ind ind, int value) {
+
+	struct ba_device_indicator event;
+	if (!ba_device_indicator_update(r->sco->d, ind, value, &event))
+		return;
+
+	bluealsa_dbus_rfcomm_indicator_changed(r, &event);
+	if (ind == HFP_IND_BATTCHG)
+		bluealsa_dbus_rfcomm_update(r, BA_DBUS_RFCOMM_UPDATE_BATTERY);
+
+}
+
 /**
  * Handle AT command response code. */
 static int rfcomm_handler_resp_ok_cb(struct ba_rfcomm *r, const struct bt_at *at) {
@@ -208,17 +224,15 @@ static int rfcomm_handler_cind_resp_test_cb(struct ba_rfcomm *r, const struct bt
  * RESP: Standard indicator update AT command */
 static int rfcomm_handler_cind_resp_get_cb(struct ba_rfcomm *r, const struct bt_at *at) {
 
-	struct ba_device * const d = r->sco->d;
 	char *tmp = at->value;
 	size_t i;
 
 	/* parse response for the +CIND GET command */
 	for (i = 0; i < ARRAYSIZE(r->hfp_ind_map); i++) {
-		r->hfp_ind[r->hfp_ind_map[i]] = atoi(tmp);
-		if (r->hfp_ind_map[i] == HFP_IND_BATTCHG) {
-			d->battery_level = atoi(tmp) * 100 / 5;
-			bluealsa_dbus_rfcomm_update(r, BA_DBUS_RFCOMM_UPDATE_BATTERY);
-		}
+		const enum hfp_ind ind = r->hfp_ind_map[i];
+		const int value = atoi(tmp);
+		r->hfp_ind[ind] = value;
+		rfcomm_update_indicator(r, ind, ind == HFP_IND_BATTCHG ? value * 100 / 5 : value);
 		if ((tmp = strchr(tmp, ',')) == NULL)
 			break;
 		tmp += 1;
@@ -256,21 +270,14 @@ static int rfcomm_handler_cmer_set_cb(struct ba_rfcomm *r, const struct bt_at *a
  * RESP: Standard indicator events reporting unsolicited result code */
 static int rfcomm_handler_ciev_resp_cb(struct ba_rfcomm *r, const struct bt_at *at) {
 
-	struct ba_device * const d = r->sco->d;
 	unsigned int index;
 	unsigned int value;
 
 	if (sscanf(at->value, "%u,%u", &index, &value) == 2 &&
 			--index < ARRAYSIZE(r->hfp_ind_map)) {
-		r->hfp_ind[r->hfp_ind_map[index]] = value;
-		switch (r->hfp_ind_map[index]) {
-		case HFP_IND_BATTCHG:
-			d->battery_level = value * 100 / 5;
-			bluealsa_dbus_rfcomm_update(r, BA_DBUS_RFCOMM_UPDATE_BATTERY);
-			break;
-		default:
-			break;
-		}
+		const enum hfp_ind ind = r->hfp_ind_map[index];
+		r->hfp_ind[ind] = value;
+		rfcomm_update_indicator(r, ind, ind == HFP_IND_BATTCHG ? value * 100 / 5 : (int)value);
 	}
 
 	return 0;
@@ -547,10 +554,8 @@ static int rfcomm_handler_iphoneaccev_set_cb(struct ba_rfcomm *r, const struct b
 	while (count-- && ptr != NULL)
 		switch (tmp = *strsep(&ptr, ",")) {
 		case '1':
-			if (ptr != NULL) {
-				d->battery_level = atoi(strsep(&ptr, ",")) * 100 / 9;
-				bluealsa_dbus_rfcomm_update(r, BA_DBUS_RFCOMM_UPDATE_BATTERY);
-			}
+			if (ptr != NULL)
+				rfcomm_update_indicator(r, HFP_IND_BATTCHG, atoi(strsep(&ptr, ",")) * 100 / 9);
 			break;
 		case '2':
 			if (ptr != NULL)
@@ -670,42 +675,96 @@ static const struct ba_rfcomm_handler rfcomm_handler_xapl_resp = {
 	AT_TYPE_RESP, "+XAPL", rfcomm_handler_xapl_resp_cb };
 
 /**
- * Get callback (if available) for given AT message. */
+ * Get callback (if available) for given AT message.
+ *
+ * Handlers are dispatched by the AT message type and the first character
+ * of the command following the "+" prefix, so at most a few string
+ * comparisons are required for every received AT message. */
 static ba_rfcomm_callback *rfcomm_get_callback(const struct bt_at *at) {
 
-	static const struct ba_rfcomm_handler *handlers[] = {
-		&rfcomm_handler_resp_ok,
-		&rfcomm_handler_cind_test,
-		&rfcomm_handler_cind_get,
-		&rfcomm_handler_cmer_set,
-		&rfcomm_handler_ciev_resp,
-		&rfcomm_handler_bia_set,
-		&rfcomm_handler_brsf_set,
-		&rfcomm_handler_nrec_set,
-		&rfcomm_handler_vgm_set,
-		&rfcomm_handler_vgm_resp,
-		&rfcomm_handler_vgs_set,
-		&rfcomm_handler_vgs_resp,
-		&rfcomm_handler_btrh_get,
-		&rfcomm_handler_bcc_cmd,
-		&rfcomm_handler_bcs_set,
-		&rfcomm_handler_bcs_resp,
-		&rfcomm_handler_bac_set,
-		&rfcomm_handler_iphoneaccev_set,
-		&rfcomm_handler_xapl_set,
-		&rfcomm_handler_xapl_resp,
-	};
-
+	const struct ba_rfcomm_handler *handlers[4] = { NULL };
+	const char *command = at->command;
 	size_t i;
 
-	for (i = 0; i < ARRAYSIZE(handlers); i++) {
-		if (handlers[i]->type != at->type)
-			continue;
-		if (strcmp(handlers[i]->command, at->command) != 0)
-			continue;
-		return handlers[i]->callback;
+	if (command[0] == '\0') {
+		if (at->type == AT_TYPE_RESP)
+			return rfcomm_handler_resp_ok.callback;
+		return NULL;
+	}
+
+	if (command[0] != '+')
+		return NULL;
+
+	switch (at->type) {
+	case AT_TYPE_CMD:
+		if (command[1] == 'B')
+			handlers[0] = &rfcomm_handler_bcc_cmd;
+		break;
+	case AT_TYPE_CMD_GET:
+		switch (command[1]) {
+		case 'B':
+			handlers[0] = &rfcomm_handler_btrh_get;
+			break;
+		case 'C':
+			handlers[0] = &rfcomm_handler_cind_get;
+			break;
+		}
+		break;
+	case AT_TYPE_CMD_SET:
+		switch (command[1]) {
+		case 'B':
+			handlers[0] = &rfcomm_handler_bcs_set;
+			handlers[1] = &rfcomm_handler_bac_set;
+			handlers[2] = &rfcomm_handler_bia_set;
+			handlers[3] = &rfcomm_handler_brsf_set;
+			break;
+		case 'C':
+			handlers[0] = &rfcomm_handler_cmer_set;
+			break;
+		case 'I':
+			handlers[0] = &rfcomm_handler_iphoneaccev_set;
+			break;
+		case 'N':
+			handlers[0] = &rfcomm_handler_nrec_set;
+			break;
+		case 'V':
+			handlers[0] = &rfcomm_handler_vgs_set;
+			handlers[1] = &rfcomm_handler_vgm_set;
+			break;
+		case 'X':
+			handlers[0] = &rfcomm_handler_xapl_set;
+			break;
+		}
+		break;
+	case AT_TYPE_CMD_TEST:
+		if (command[1] == 'C')
+			handlers[0] = &rfcomm_handler_cind_test;
+		break;
+	case AT_TYPE_RESP:
+		switch (command[1]) {
+		case 'B':
+			handlers[0] = &rfcomm_handler_bcs_resp;
+			break;
+		case 'C':
+			handlers[0] = &rfcomm_handler_ciev_resp;
+			break;
+		case 'V':
+			handlers[0] = &rfcomm_handler_vgs_resp;
+			handlers[1] = &rfcomm_handler_vgm_resp;
+			break;
+		case 'X':
+			handlers[0] = &rfcomm_handler_xapl_resp;
+			break;
+		}
+		break;
+	default:
+		break;
 	}
 
+	for (i = 0; i < ARRAYSIZE(handlers) && handlers[i] != NULL; i++)
+		if (strcmp(handlers[i]->command, command) == 0)
+			return handlers[i]->callback;
+
 	return NULL;
 }
 
@@ -891,13 +950,16 @@ static void *rfcomm_thread(struct ba_rfcomm *r) {
 	pthread_cleanup_push(PTHREAD_CLEANUP(rfcomm_thread_cleanup), r);
 
 	struct ba_transport * const t_sco = r->sco;
-	struct at_reader reader = { .next = NULL };
+	struct at_reader reader;
+	struct bt_at at;
 	struct pollfd pfds[] = {
 		{ r->sig_fd[0], POLLIN, 0 },
 		{ r->fd, POLLIN, 0 },
 		{ -1, POLLIN, 0 },
 	};
 
+	at_reader_init(&reader);
+
 	debug("Starting RFCOMM loop: %s", ba_transport_type_to_string(t_sco->type));
 	for (;;) {
 
@@ -1094,8 +1156,8 @@ process:
 		}
 
 		/* skip poll() since we've got unprocessed data */
-		if (reader.next != NULL)
-			goto read;
+		if (rfcomm_read_at(-1, &reader, &at) == 0)
+			goto dispatch;
 
 		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 
@@ -1146,42 +1208,40 @@ process:
 		if (pfds[1].revents & POLLIN) {
 			/* read data from the RFCOMM */
 
-read:
-			if (rfcomm_read_at(pfds[1].fd, &reader) == -1)
-				switch (errno) {
-				case EBADMSG:
-					warn("Invalid AT message: %s", reader.next);
-					reader.next = NULL;
+			bool predefined_callback;
+			if (rfcomm_read_at(pfds[1].fd, &reader, &at) == -1) {
+				/* wait for the rest of the AT message */
+				if (errno == EAGAIN)
 					continue;
-				default:
-					goto ioerror;
-				}
+				goto ioerror;
+			}
 
+dispatch:
 			/* use predefined callback, otherwise get generic one */
-			bool predefined_callback = false;
-			if (r->handler != NULL && r->handler->type == reader.at.type &&
-					strcmp(r->handler->command, reader.at.command) == 0) {
+			predefined_callback = false;
+			if (r->handler != NULL && r->handler->type == at.type &&
+					strcmp(r->handler->command, at.command) == 0) {
 				callback = r->handler->callback;
 				predefined_callback = true;
 				r->handler = NULL;
 			}
 			else
-				callback = rfcomm_get_callback(&reader.at);
+				callback = rfcomm_get_callback(&at);
 
 			if (pfds[2].fd != -1 && !predefined_callback) {
-				at_build(tmp, reader.at.type, reader.at.command, reader.at.value);
+				at_build(tmp, at.type, at.command, at.value);
 				if (write(pfds[2].fd, tmp, strlen(tmp)) == -1)
 					warn("Couldn't forward AT: %s", strerror(errno));
 			}
 
 			if (callback != NULL) {
-				if (callback(r, &reader.at) == -1)
+				if (callback(r, &at) == -1)
 					goto ioerror;
 			}
 			else if (pfds[2].fd == -1) {
 				warn("Unsupported AT message: %s: command:%s, value:%s",
-						at_type2str(reader.at.type), reader.at.command, reader.at.value);
-				if (reader.at.type != AT_TYPE_RESP)
+						at_type2str(at.type), at.command, at.value);
+				if (at.type != AT_TYPE_RESP)
 					if (rfcomm_write_at(pfds[1].fd, AT_TYPE_RESP, NULL, "ERROR") == -1)
 						goto ioerror;
 			}
@@ -1321,7 +1381,15 @@ void ba_rfcomm_destroy(struct ba_rfcomm *r) {
 		close(r->handler_fd);
 
 	if (r->sco != NULL) {
-		r->sco->d->battery_level = -1;
+		/* Indicators are no longer available. Even though the D-Bus interface
+		 * has been already removed, notify clients about that change, so they
+		 * will not keep stale indicator values (e.g. battery level). */
+		for (size_t i = HFP_IND_NULL + 1; i < __HFP_IND_MAX; i++) {
+			struct ba_device_indicator event;
+			if (ba_device_indicator_update(r->sco->d, i, -1, &event) &&
+					r->ba_dbus_path != NULL)
+				bluealsa_dbus_rfcomm_indicator_changed(r, &event);
+		}
 		ba_transport_unref(r->sco);
 	}
 
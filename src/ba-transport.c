@@ -12,10 +12,12 @@
 
 #include <errno.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include <bluetooth/bluetooth.h>
@@ -43,6 +45,9 @@
 #include "utils.h"
 #include "shared/defs.h"
 #include "shared/log.h"
+#include "shared/mempool.h"
+#include "shared/rt.h"
+#include "shared/trace.h"
 
 static const char *transport_get_dbus_path_type(
 		struct ba_transport_type type) {
@@ -78,7 +83,6 @@ static int transport_pcm_init(
 
 	pthread_mutex_init(&pcm->dbus_mtx, NULL);
 	pthread_mutex_init(&pcm->synced_mtx, NULL);
-	pthread_cond_init(&pcm->synced, NULL);
 
 	pcm->ba_dbus_path = g_strdup_printf("%s/%s/%s",
 			t->d->ba_dbus_path, transport_get_dbus_path_type(t->type),
@@ -94,7 +98,6 @@ static void transport_pcm_free(
 
 	pthread_mutex_destroy(&pcm->dbus_mtx);
 	pthread_mutex_destroy(&pcm->synced_mtx);
-	pthread_cond_destroy(&pcm->synced);
 
 	if (pcm->ba_dbus_path != NULL)
 		g_free(pcm->ba_dbus_path);
@@ -138,6 +141,7 @@ static void transport_thread_cancel(struct ba_transport_thread *th) {
 	 * make sure, that after termination, this thread handler will not
 	 * be used anymore. */
 	th->id = config.main_thread;
+	th->tid = 0;
 	th->running = false;
 
 }
@@ -172,7 +176,7 @@ static struct ba_transport *transport_new(
 	struct ba_transport *t;
 	int err;
 
-	if ((t = calloc(1, sizeof(*t))) == NULL)
+	if ((t = mempool_alloc0(sizeof(*t))) == NULL)
 		return NULL;
 
 	t->d = ba_device_ref(device);
@@ -181,6 +185,7 @@ static struct ba_transport *transport_new(
 
 	pthread_mutex_init(&t->type_mtx, NULL);
 	pthread_mutex_init(&t->bt_fd_mtx, NULL);
+	pthread_mutex_init(&t->stats_mtx, NULL);
 
 	t->bt_fd = -1;
 
@@ -236,6 +241,8 @@ struct ba_transport *ba_transport_new_a2dp(
 	t->a2dp.codec = codec;
 	t->a2dp.configuration = g_memdup(configuration, codec->capabilities_size);
 	t->a2dp.state = BLUEZ_A2DP_TRANSPORT_STATE_IDLE;
+	t->a2dp.bt_volume.queued = -1;
+	t->a2dp.bt_volume.sent = -1;
 
 	transport_pcm_init(&t->a2dp.pcm,
 			is_sink ? &t->thread_dec : &t->thread_enc,
@@ -347,6 +354,15 @@ struct ba_transport *ba_transport_ref(
 
 void ba_transport_destroy(struct ba_transport *t) {
 
+	/* The PCM which is about to be handed over to the new transport is kept
+	 * open by the D-Bus unregister procedure. Terminate the IO threads before
+	 * that, so they will not consume client audio buffered in the PCM FIFO. */
+	if (t->type.profile & BA_TRANSPORT_PROFILE_MASK_A2DP &&
+			ba_transport_pcm_is_handover(&t->a2dp.pcm)) {
+		transport_thread_cancel(&t->thread_enc);
+		transport_thread_cancel(&t->thread_dec);
+	}
+
 	/* Remove D-Bus interfaces, so no one will access
 	 * this transport during the destroy procedure. */
 	if (t->type.profile & BA_TRANSPORT_PROFILE_MASK_A2DP) {
@@ -410,6 +426,8 @@ void ba_transport_unref(struct ba_transport *t) {
 	if (t->type.profile & BA_TRANSPORT_PROFILE_MASK_A2DP) {
 		transport_pcm_free(&t->a2dp.pcm);
 		transport_pcm_free(&t->a2dp.pcm_bc);
+		a2dp_capture_close(t->a2dp.capture);
+		mempool_free(t->a2dp.silence);
 		free(t->a2dp.configuration);
 	}
 	else if (t->type.profile & BA_TRANSPORT_PROFILE_MASK_SCO) {
@@ -422,11 +440,12 @@ void ba_transport_unref(struct ba_transport *t) {
 	transport_thread_free(&t->thread_enc);
 	transport_thread_free(&t->thread_dec);
 
+	pthread_mutex_destroy(&t->stats_mtx);
 	pthread_mutex_destroy(&t->bt_fd_mtx);
 	pthread_mutex_destroy(&t->type_mtx);
 	free(t->bluez_dbus_owner);
 	free(t->bluez_dbus_path);
-	free(t);
+	mempool_free(t);
 }
 
 struct ba_transport_pcm *ba_transport_pcm_ref(struct ba_transport_pcm *pcm) {
@@ -453,9 +472,18 @@ int ba_transport_select_codec_a2dp(
 			memcmp(sep->configuration, t->a2dp.configuration, sep->capabilities_size) == 0)
 		goto final;
 
+	/* BlueZ will destroy this transport and create a new one with the
+	 * new configuration. Mark opened PCM, so its connection will not be
+	 * closed, but handed over to the new transport instead. */
+	if (config.a2dp.keep_pcm && t->a2dp.pcm.fd != -1) {
+		gettimestamp(&t->a2dp.pcm.handover_ts);
+		t->a2dp.pcm.handover = true;
+	}
+
 	GError *err = NULL;
 	if (!bluez_a2dp_set_configuration(t->a2dp.bluez_dbus_sep_path, sep, &err)) {
 		error("Couldn't set A2DP configuration: %s", err->message);
+		t->a2dp.pcm.handover = false;
 		pthread_mutex_unlock(&t->type_mtx);
 		g_error_free(err);
 		return errno = EIO, -1;
@@ -489,9 +517,19 @@ int ba_transport_select_codec_sco(
 		struct ba_rfcomm * const r = t->sco.rfcomm;
 		pthread_mutex_lock(&r->codec_selection_completed_mtx);
 
+		/* In the fixed rate mode the PCM configuration is not affected by the
+		 * codec selection, so we can keep client streams open. Only the SCO
+		 * link has to be re-established with the new codec. */
+		const bool keep_pcm = config.hfp.fixed_rate;
+		const bool reacquire = keep_pcm &&
+			t->type.profile & BA_TRANSPORT_PROFILE_MASK_AG &&
+			(t->sco.spk_pcm.fd != -1 || t->sco.mic_pcm.fd != -1);
+
 		/* release ongoing connection */
-		ba_transport_pcm_release(&t->sco.spk_pcm);
-		ba_transport_pcm_release(&t->sco.mic_pcm);
+		if (!keep_pcm) {
+			ba_transport_pcm_release(&t->sco.spk_pcm);
+			ba_transport_pcm_release(&t->sco.mic_pcm);
+		}
 		t->release(t);
 
 		switch (codec_id) {
@@ -511,6 +549,13 @@ int ba_transport_select_codec_sco(
 			return errno = EIO, -1;
 		}
 
+		/* resume audio transfer with the new codec */
+		if (reacquire) {
+			if (t->acquire(t) == -1)
+				warn("Couldn't re-acquire SCO link: %s", strerror(errno));
+			ba_transport_thread_send_signal(t->sco.spk_pcm.th, BA_TRANSPORT_SIGNAL_PING);
+		}
+
 final:
 		pthread_mutex_unlock(&t->type_mtx);
 		break;
@@ -551,6 +596,12 @@ static void ba_transport_set_codec_a2dp(struct ba_transport *t) {
 #endif
 	}
 
+	/* In the fixed format mode, decoded audio is converted by the IO thread
+	 * to the widest PCM format supported by A2DP codecs. */
+	if (config.a2dp.sink_fixed_format &&
+			t->type.profile == BA_TRANSPORT_PROFILE_A2DP_SINK)
+		t->a2dp.pcm.format = BA_TRANSPORT_PCM_FORMAT_S32_4LE;
+
 	switch (codec_id) {
 	case A2DP_CODEC_SBC:
 		t->a2dp.pcm.channels = a2dp_codec_lookup_channels(codec,
@@ -629,6 +680,16 @@ static void ba_transport_set_codec_sco(struct ba_transport *t) {
 
 	switch (t->type.codec) {
 	case HFP_CODEC_CVSD:
+#if ENABLE_MSBC
+		/* With the fixed rate mode, CVSD audio is resampled by the IO thread,
+		 * so the PCM configuration does not change upon codec switching. */
+		if (config.hfp.fixed_rate &&
+				t->type.profile & BA_TRANSPORT_PROFILE_MASK_HFP) {
+			t->sco.spk_pcm.sampling = 16000;
+			t->sco.mic_pcm.sampling = 16000;
+			return;
+		}
+#endif
 		t->sco.spk_pcm.sampling = 8000;
 		t->sco.mic_pcm.sampling = 8000;
 		return;
@@ -660,6 +721,109 @@ void ba_transport_set_codec(
 
 }
 
+/**
+ * Update BT link bitrate estimation.
+ *
+ * This function shall be called by the IO thread after the BT traffic
+ * counters have been updated. The bitrate is estimated over a window
+ * which is at least one second long.
+ *
+ * The estimation window is shared by the encoder and decoder IO threads.
+ * If the window is being updated by the other thread right now, there is
+ * no need to wait for it, so the update is simply skipped. */
+void ba_transport_stats_update(struct ba_transport *t) {
+
+	struct timespec ts, diff;
+
+	if (pthread_mutex_trylock(&t->stats_mtx) != 0)
+		return;
+
+	const uint64_t bytes = t->stats.bt_rx_bytes + t->stats.bt_tx_bytes;
+	const uint64_t wakeups = t->stats.wakeups;
+
+	gettimestamp(&ts);
+
+	if (t->stats.bt_bitrate_ts.tv_sec == 0 &&
+			t->stats.bt_bitrate_ts.tv_nsec == 0)
+		goto reset;
+
+	difftimespec(&t->stats.bt_bitrate_ts, &ts, &diff);
+	if (diff.tv_sec < 1)
+		goto final;
+
+	const uint64_t usec = diff.tv_sec * 1000000 + diff.tv_nsec / 1000;
+	t->stats.bt_bitrate = (bytes - t->stats.bt_bitrate_bytes) * 8 * 1000000 / usec;
+	t->stats.wakeup_rate = (wakeups - t->stats.wakeup_rate_wakeups) * 1000000 / usec;
+
+reset:
+	t->stats.bt_bitrate_ts = ts;
+	t->stats.bt_bitrate_bytes = bytes;
+	t->stats.wakeup_rate_wakeups = wakeups;
+final:
+	pthread_mutex_unlock(&t->stats_mtx);
+}
+
+/**
+ * Get estimated BT link bitrate.
+ *
+ * This function might be called from any thread - the estimation window
+ * is read with the stats_mtx lock held.
+ *
+ * @return This function returns bitrate in bits per second. If there was
+ *   no BT traffic for the last two seconds, zero is returned. */
+unsigned int ba_transport_get_bitrate(struct ba_transport *t) {
+
+	unsigned int bitrate = 0;
+	struct timespec ts, diff;
+
+	gettimestamp(&ts);
+
+	pthread_mutex_lock(&t->stats_mtx);
+	difftimespec(&t->stats.bt_bitrate_ts, &ts, &diff);
+	if (diff.tv_sec < 2)
+		bitrate = t->stats.bt_bitrate;
+	pthread_mutex_unlock(&t->stats_mtx);
+
+	return bitrate;
+}
+
+/**
+ * Get CPU time consumed by the transport thread.
+ *
+ * The CPU time is read from the scheduler statistics of the kernel thread,
+ * so it is safe to call this function even if the thread has already
+ * terminated - in such case zero is returned. */
+static uint64_t transport_thread_get_cpu_time(const struct ba_transport_thread *th) {
+
+	unsigned long long time = 0;
+	char path[64];
+	FILE *f;
+
+	if (th->tid == 0)
+		return 0;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", th->tid);
+	if ((f = fopen(path, "r")) == NULL)
+		return 0;
+
+	if (fscanf(f, "%llu", &time) != 1)
+		time = 0;
+
+	fclose(f);
+	return time;
+}
+
+/**
+ * Get CPU time consumed by the transport IO threads.
+ *
+ * @return This function returns the total CPU time (in nanoseconds) of
+ *   all running IO threads. Please note, that this value is not monotonic,
+ *   it is reset whenever IO threads are restarted. */
+uint64_t ba_transport_get_cpu_time(const struct ba_transport *t) {
+	return transport_thread_get_cpu_time(&t->thread_enc) +
+		transport_thread_get_cpu_time(&t->thread_dec);
+}
+
 int ba_transport_start(struct ba_transport *t) {
 
 	if (!pthread_equal(t->thread_enc.id, config.main_thread) ||
@@ -680,6 +844,10 @@ int ba_transport_start(struct ba_transport *t) {
 int ba_transport_stop(struct ba_transport *t) {
 	transport_thread_cancel(&t->thread_enc);
 	transport_thread_cancel(&t->thread_dec);
+	if (t->type.profile & BA_TRANSPORT_PROFILE_MASK_A2DP) {
+		a2dp_capture_close(t->a2dp.capture);
+		t->a2dp.capture = NULL;
+	}
 	return 0;
 }
 
@@ -725,9 +893,63 @@ int ba_transport_pcm_volume_bt_to_level(
 	return MIN(MAX(level, -96.0), 96.0) * 100;
 }
 
+static void transport_set_bt_volume(struct ba_transport *t, unsigned int volume);
+
+static void transport_set_bt_volume_finish(GObject *source, GAsyncResult *result,
+		void *userdata) {
+
+	struct ba_transport *t = (struct ba_transport *)userdata;
+	GError *err = NULL;
+
+	if (!g_dbus_set_property_finish(G_DBUS_CONNECTION(source), result, &err)) {
+		warn("Couldn't set BT device volume: %s", err->message);
+		/* volume was not applied, so allow to send it again */
+		t->a2dp.bt_volume.sent = -1;
+		g_error_free(err);
+	}
+
+	t->a2dp.bt_volume.pending = false;
+
+	/* send the most recent volume change (if any) */
+	if (t->a2dp.bt_volume.queued != -1) {
+		unsigned int volume = t->a2dp.bt_volume.queued;
+		t->a2dp.bt_volume.queued = -1;
+		transport_set_bt_volume(t, volume);
+	}
+
+	ba_transport_unref(t);
+}
+
+/**
+ * Propagate A2DP volume to BlueZ without blocking the main loop.
+ *
+ * If there is a Set call in flight, the new value is queued and it will be
+ * sent when the pending call completes. In case of subsequent changes only
+ * the last one is sent. */
+static void transport_set_bt_volume(struct ba_transport *t, unsigned int volume) {
+
+	if (t->a2dp.bt_volume.pending) {
+		t->a2dp.bt_volume.queued = volume;
+		return;
+	}
+
+	/* BlueZ already has this volume level */
+	if (t->a2dp.bt_volume.sent == (int)volume)
+		return;
+
+	debug("Setting BT device volume: %u", volume);
+	t->a2dp.bt_volume.pending = true;
+	t->a2dp.bt_volume.sent = volume;
+
+	g_dbus_set_property_async(config.dbus, t->bluez_dbus_owner, t->bluez_dbus_path,
+			BLUEZ_IFACE_MEDIA_TRANSPORT, "Volume", g_variant_new_uint16(volume),
+			transport_set_bt_volume_finish, ba_transport_ref(t));
+
+}
+
 int ba_transport_pcm_volume_update(struct ba_transport_pcm *pcm) {
 
-	const struct ba_transport *t = pcm->t;
+	struct ba_transport *t = pcm->t;
 
 	/* In case of A2DP Source or HSP/HFP Audio Gateway skip notifying Bluetooth
 	 * device if we are using software volume control. This will prevent volume
@@ -742,15 +964,8 @@ int ba_transport_pcm_volume_update(struct ba_transport_pcm *pcm) {
 		if (!pcm->volume[0].muted && !pcm->volume[1].muted)
 			level = (pcm->volume[0].level + pcm->volume[1].level) / 2;
 
-		GError *err = NULL;
 		unsigned int volume = ba_transport_pcm_volume_level_to_bt(pcm, level);
-		g_dbus_set_property(config.dbus, t->bluez_dbus_owner, t->bluez_dbus_path,
-				BLUEZ_IFACE_MEDIA_TRANSPORT, "Volume", g_variant_new_uint16(volume), &err);
-
-		if (err != NULL) {
-			warn("Couldn't set BT device volume: %s", err->message);
-			g_error_free(err);
-		}
+		transport_set_bt_volume(t, volume);
 
 	}
 	else if (t->type.profile & BA_TRANSPORT_PROFILE_MASK_SCO &&
@@ -777,60 +992,227 @@ int ba_transport_pcm_resume(struct ba_transport_pcm *pcm) {
 	return 0;
 }
 
-int ba_transport_pcm_drain(struct ba_transport_pcm *pcm) {
+/**
+ * Get the number of bytes queued in the BT socket output buffer. */
+static int transport_get_bt_outq(struct ba_transport *t) {
+
+	int outq = 0;
+
+	pthread_mutex_lock(&t->bt_fd_mtx);
+	if (t->bt_fd != -1 && ioctl(t->bt_fd, TIOCOUTQ, &outq) != -1)
+		outq = abs(t->a2dp.bt_fd_coutq_init - outq);
+	pthread_mutex_unlock(&t->bt_fd_mtx);
+
+	return outq;
+}
+
+static gboolean transport_pcm_drain_dispatch(void *userdata);
+
+/**
+ * Schedule the drain state machine dispatcher.
+ *
+ * The caller shall hold the synced_mtx lock. */
+static void transport_pcm_drain_schedule(struct ba_transport_pcm *pcm,
+		unsigned int interval) {
+	pcm->drain.source_id = g_timeout_add_full(G_PRIORITY_DEFAULT, interval,
+			transport_pcm_drain_dispatch, ba_transport_pcm_ref(pcm),
+			(GDestroyNotify)ba_transport_pcm_unref);
+}
+
+/**
+ * Complete the drain request.
+ *
+ * The caller shall hold the synced_mtx lock, which is released by this
+ * function before the completion callback is invoked. */
+static void transport_pcm_drain_complete(struct ba_transport_pcm *pcm, int err) {
+
+	ba_transport_pcm_drain_cb *callback = pcm->drain.callback;
+	void *userdata = pcm->drain.userdata;
+
+	pcm->drain.state = BA_TRANSPORT_PCM_DRAIN_IDLE;
+	pcm->drain.callback = NULL;
+	pcm->drain.userdata = NULL;
+
+	pthread_mutex_unlock(&pcm->synced_mtx);
+
+	debug("PCM drain %s: %d", err == 0 ? "completed" : "canceled", pcm->fd);
+	if (callback != NULL)
+		callback(pcm, err, userdata);
+
+}
+
+/**
+ * Drain state machine dispatcher.
+ *
+ * This function is called by the main loop, so it shall never block. */
+static gboolean transport_pcm_drain_dispatch(void *userdata) {
+
+	struct ba_transport_pcm *pcm = (struct ba_transport_pcm *)userdata;
+	struct ba_transport *t = pcm->t;
+	struct timespec now;
+	int outq;
+
+	pthread_mutex_lock(&pcm->synced_mtx);
+
+	pcm->drain.source_id = 0;
+	gettimestamp(&now);
+
+	switch (pcm->drain.state) {
+	case BA_TRANSPORT_PCM_DRAIN_IDLE:
+		pthread_mutex_unlock(&pcm->synced_mtx);
+		return G_SOURCE_REMOVE;
+
+	case BA_TRANSPORT_PCM_DRAIN_SYNC:
+		if (!pcm->drain.synced &&
+				difftimespec(&now, &pcm->drain.deadline, &(struct timespec){ 0 }) > 0) {
+			transport_pcm_drain_schedule(pcm, BA_TRANSPORT_PCM_DRAIN_POLL_INTERVAL);
+			break;
+		}
+		if (!pcm->drain.synced)
+			warn("PCM drain sync timeout: %d", pcm->fd);
+		if (!(t->type.profile & BA_TRANSPORT_PROFILE_MASK_A2DP))
+			goto complete;
+		pcm->drain.state = BA_TRANSPORT_PCM_DRAIN_OUTQ;
+		pcm->drain.deadline = now;
+		pcm->drain.deadline.tv_sec += BA_TRANSPORT_PCM_DRAIN_TIMEOUT / 1000;
+		/* fall-through */
+
+	case BA_TRANSPORT_PCM_DRAIN_OUTQ:
+		if ((outq = transport_get_bt_outq(t)) > 0 &&
+				difftimespec(&now, &pcm->drain.deadline, &(struct timespec){ 0 }) > 0) {
+			transport_pcm_drain_schedule(pcm, BA_TRANSPORT_PCM_DRAIN_POLL_INTERVAL);
+			break;
+		}
+		if (outq > 0)
+			warn("PCM drain BT queue timeout: %d: %d bytes", pcm->fd, outq);
+		/* Data sent over the air is still buffered by the remote device. Wait
+		 * for the delay reported by the AVDTP (in 1/10 of millisecond). */
+		pcm->drain.state = BA_TRANSPORT_PCM_DRAIN_DELAY;
+		if (t->a2dp.delay >= 10) {
+			transport_pcm_drain_schedule(pcm, t->a2dp.delay / 10);
+			break;
+		}
+		/* fall-through */
+
+	case BA_TRANSPORT_PCM_DRAIN_DELAY:
+complete:
+		transport_pcm_drain_complete(pcm, 0);
+		return G_SOURCE_REMOVE;
+
+	}
+
+	pthread_mutex_unlock(&pcm->synced_mtx);
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * Drain PCM asynchronously.
+ *
+ * This function returns immediately. When all PCM samples are played out by
+ * the remote device, the callback function is invoked from the main loop.
+ * The drain completes when the IO thread has processed all PCM samples, the
+ * BT socket output queue is empty and the device delay reported by the AVDTP
+ * has elapsed.
+ *
+ * @param pcm Transport PCM which shall be drained.
+ * @param callback Function invoked upon drain completion or cancellation.
+ * @param userdata Data passed to the callback function.
+ * @return On success this function returns 0. Otherwise, -1 is returned and
+ *   errno is set to indicate the error. In such case the callback function
+ *   will not be invoked. */
+int ba_transport_pcm_drain(
+		struct ba_transport_pcm *pcm,
+		ba_transport_pcm_drain_cb *callback,
+		void *userdata) {
 
 	if (pthread_equal(pcm->th->id, config.main_thread))
 		return errno = ESRCH, -1;
 
 	pthread_mutex_lock(&pcm->synced_mtx);
 
+	if (pcm->drain.state != BA_TRANSPORT_PCM_DRAIN_IDLE) {
+		pthread_mutex_unlock(&pcm->synced_mtx);
+		return errno = EBUSY, -1;
+	}
+
+	pcm->drain.state = BA_TRANSPORT_PCM_DRAIN_SYNC;
+	pcm->drain.synced = false;
+	pcm->drain.callback = callback;
+	pcm->drain.userdata = userdata;
+
+	gettimestamp(&pcm->drain.deadline);
+	pcm->drain.deadline.tv_sec += BA_TRANSPORT_PCM_DRAIN_TIMEOUT / 1000;
+
 	ba_transport_thread_send_signal(pcm->th, BA_TRANSPORT_SIGNAL_PCM_SYNC);
-	pthread_cond_wait(&pcm->synced, &pcm->synced_mtx);
+	transport_pcm_drain_schedule(pcm, BA_TRANSPORT_PCM_DRAIN_POLL_INTERVAL);
 
 	pthread_mutex_unlock(&pcm->synced_mtx);
 
-	/* TODO: Asynchronous transport release.
-	 *
-	 * Unfortunately, BlueZ does not provide API for internal buffer drain.
-	 * Also, there is no specification for Bluetooth playback drain. In order
-	 * to make sure, that all samples are played out, we have to wait some
-	 * arbitrary time before releasing transport. In order to make it right,
-	 * there is a requirement for an asynchronous release mechanism, which
-	 * is not implemented - it requires a little bit of refactoring. */
-	usleep(200000);
-
-	debug("PCM drained: %d", pcm->fd);
+	debug("PCM drain started: %d", pcm->fd);
 	return 0;
 }
 
+/**
+ * Cancel pending PCM drain request.
+ *
+ * If there is a pending drain request, its callback function is invoked
+ * with the ECANCELED error. This function shall be called from the main
+ * loop thread. */
+void ba_transport_pcm_drain_cancel(struct ba_transport_pcm *pcm) {
+
+	pthread_mutex_lock(&pcm->synced_mtx);
+
+	if (pcm->drain.state == BA_TRANSPORT_PCM_DRAIN_IDLE) {
+		pthread_mutex_unlock(&pcm->synced_mtx);
+		return;
+	}
+
+	if (pcm->drain.source_id != 0) {
+		g_source_remove(pcm->drain.source_id);
+		pcm->drain.source_id = 0;
+	}
+
+	transport_pcm_drain_complete(pcm, ECANCELED);
+
+}
+
+/**
+ * Notify that all PCM samples have been processed.
+ *
+ * This function shall be called by the transport IO thread when there is
+ * no more data in the PCM FIFO after the PCM sync signal. */
+void ba_transport_pcm_drain_synced(struct ba_transport_pcm *pcm) {
+	pthread_mutex_lock(&pcm->synced_mtx);
+	if (pcm->drain.state == BA_TRANSPORT_PCM_DRAIN_SYNC)
+		pcm->drain.synced = true;
+	pthread_mutex_unlock(&pcm->synced_mtx);
+}
+
 int ba_transport_pcm_drop(struct ba_transport_pcm *pcm) {
+	ba_transport_pcm_drain_cancel(pcm);
 	ba_transport_thread_send_signal(&pcm->t->thread_enc, BA_TRANSPORT_SIGNAL_PCM_DROP);
 	debug("PCM dropped: %d", pcm->fd);
 	return 0;
 }
 
-static int transport_acquire_bt_a2dp(struct ba_transport *t) {
-
-	GDBusMessage *msg, *rep;
-	GUnixFDList *fd_list;
-	GError *err = NULL;
-	int fd;
-
-	pthread_mutex_lock(&t->bt_fd_mtx);
-
-	/* Check whether transport is already acquired - keep-alive mode. */
-	if ((fd = t->bt_fd) != -1) {
-		debug("Reusing transport: %d", fd);
-		goto final;
-	}
-
-	msg = g_dbus_message_new_method_call(t->bluez_dbus_owner,
+static GDBusMessage *transport_acquire_bt_a2dp_msg(const struct ba_transport *t) {
+	return g_dbus_message_new_method_call(t->bluez_dbus_owner,
 			t->bluez_dbus_path, BLUEZ_IFACE_MEDIA_TRANSPORT,
 			t->a2dp.state == BLUEZ_A2DP_TRANSPORT_STATE_PENDING ? "TryAcquire" : "Acquire");
+}
 
-	if ((rep = g_dbus_connection_send_message_with_reply_sync(config.dbus, msg,
-					G_DBUS_SEND_MESSAGE_FLAGS_NONE, -1, NULL, NULL, &err)) == NULL)
-		goto fail;
+/**
+ * Set up A2DP transport with the reply to the Acquire() call.
+ *
+ * The caller shall hold the bt_fd_mtx lock.
+ *
+ * @return On success this function returns the BT socket. Otherwise, -1
+ *   is returned. */
+static int transport_acquire_bt_a2dp_reply(struct ba_transport *t, GDBusMessage *rep) {
+
+	GUnixFDList *fd_list;
+	GError *err = NULL;
+	int fd = -1;
 
 	if (g_dbus_message_get_message_type(rep) == G_DBUS_MESSAGE_TYPE_ERROR) {
 		g_dbus_message_to_gerror(rep, &err);
@@ -857,19 +1239,96 @@ static int transport_acquire_bt_a2dp(struct ba_transport *t) {
 	debug("New transport: %d (MTU: R:%zu W:%zu)", fd, t->mtu_read, t->mtu_write);
 
 fail:
-	g_object_unref(msg);
-	if (rep != NULL)
-		g_object_unref(rep);
 	if (err != NULL) {
 		error("Couldn't acquire transport: %s", err->message);
 		g_error_free(err);
 	}
+	return fd;
+}
+
+static int transport_acquire_bt_a2dp(struct ba_transport *t) {
+
+	GDBusMessage *msg, *rep;
+	GError *err = NULL;
+	int fd;
+
+	pthread_mutex_lock(&t->bt_fd_mtx);
+
+	/* Check whether transport is already acquired - keep-alive mode. */
+	if ((fd = t->bt_fd) != -1) {
+		debug("Reusing transport: %d", fd);
+		goto final;
+	}
+
+	msg = transport_acquire_bt_a2dp_msg(t);
+
+	if ((rep = g_dbus_connection_send_message_with_reply_sync(config.dbus, msg,
+					G_DBUS_SEND_MESSAGE_FLAGS_NONE, -1, NULL, NULL, &err)) == NULL) {
+		error("Couldn't acquire transport: %s", err->message);
+		g_error_free(err);
+	}
+	else {
+		fd = transport_acquire_bt_a2dp_reply(t, rep);
+		g_object_unref(rep);
+	}
+
+	g_object_unref(msg);
 
 final:
 	pthread_mutex_unlock(&t->bt_fd_mtx);
 	return fd;
 }
 
+static void transport_acquire_bt_a2dp_async_finish(GObject *source,
+		GAsyncResult *result, void *userdata) {
+
+	struct ba_transport *t = (struct ba_transport *)userdata;
+	GError *err = NULL;
+	GDBusMessage *rep;
+
+	pthread_mutex_lock(&t->bt_fd_mtx);
+
+	if ((rep = g_dbus_connection_send_message_with_reply_finish(
+					G_DBUS_CONNECTION(source), result, &err)) == NULL) {
+		error("Couldn't acquire transport: %s", err->message);
+		g_error_free(err);
+	}
+	else if (t->bt_fd != -1)
+		/* Transport has been acquired in the meantime. The new file
+		 * descriptor will be closed together with the reply message. */
+		debug("Reusing transport: %d", t->bt_fd);
+	else
+		transport_acquire_bt_a2dp_reply(t, rep);
+
+	pthread_mutex_unlock(&t->bt_fd_mtx);
+
+	if (rep != NULL)
+		g_object_unref(rep);
+	ba_transport_unref(t);
+}
+
+/**
+ * Acquire A2DP transport without blocking the main loop.
+ *
+ * The outcome of the acquisition is reported by the BlueZ transport state
+ * change, so there is no need to wait for the reply. */
+void ba_transport_acquire_a2dp_async(struct ba_transport *t) {
+
+	pthread_mutex_lock(&t->bt_fd_mtx);
+	const bool acquired = t->bt_fd != -1;
+	pthread_mutex_unlock(&t->bt_fd_mtx);
+
+	if (acquired)
+		return;
+
+	GDBusMessage *msg = transport_acquire_bt_a2dp_msg(t);
+	g_dbus_connection_send_message_with_reply(config.dbus, msg,
+			G_DBUS_SEND_MESSAGE_FLAGS_NONE, -1, NULL, NULL,
+			transport_acquire_bt_a2dp_async_finish, ba_transport_ref(t));
+	g_object_unref(msg);
+
+}
+
 static int transport_release_bt_a2dp(struct ba_transport *t) {
 
 	GDBusMessage *msg = NULL, *rep = NULL;
@@ -1020,6 +1479,25 @@ int ba_transport_pcm_release(struct ba_transport_pcm *pcm) {
 	return 0;
 }
 
+/**
+ * Check whether PCM connection shall be handed over.
+ *
+ * The handover mark set by the A2DP codec selection is valid for the
+ * handover timeout only. If the transport has not been destroyed within
+ * that time, the reconfiguration has not been completed by BlueZ, and the
+ * transport is kept as it is. */
+bool ba_transport_pcm_is_handover(const struct ba_transport_pcm *pcm) {
+
+	if (!pcm->handover)
+		return false;
+
+	struct timespec ts;
+	gettimestamp(&ts);
+	difftimespec(&pcm->handover_ts, &ts, &ts);
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000 < BA_TRANSPORT_PCM_HANDOVER_TIMEOUT;
+}
+
 /**
  * Create transport thread. */
 int ba_transport_thread_create(
@@ -1048,6 +1526,7 @@ int ba_transport_thread_create(
 
 int ba_transport_thread_ready(
 		struct ba_transport_thread *th) {
+	th->tid = syscall(SYS_gettid);
 	th->running = true;
 	pthread_cond_signal(&th->ready);
 	return 0;
@@ -1056,6 +1535,7 @@ int ba_transport_thread_ready(
 int ba_transport_thread_send_signal(
 		struct ba_transport_thread *th,
 		enum ba_transport_signal sig) {
+	trace2(signal_send, th->pipe[1], sig);
 	return write(th->pipe[1], &sig, sizeof(sig));
 }
 
@@ -1069,8 +1549,10 @@ enum ba_transport_signal ba_transport_thread_recv_signal(
 			errno == EINTR)
 		continue;
 
-	if (ret == sizeof(sig))
+	if (ret == sizeof(sig)) {
+		trace2(signal_recv, th->pipe[0], sig);
 		return sig;
+	}
 
 	warn("Couldn't read transport thread signal: %s", strerror(errno));
 	return BA_TRANSPORT_SIGNAL_PING;
@@ -1091,6 +1573,7 @@ void ba_transport_thread_cleanup(struct ba_transport_thread *th) {
 	if (t->release != NULL)
 		t->release(t);
 
+	th->tid = 0;
 	ba_transport_thread_cleanup_unlock(th);
 
 	/* XXX: If the order of the cleanup push is right, this function will
@@ -16,11 +16,16 @@
 #endif
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
 
 #include "a2dp.h"
+#include "a2dp-capture.h"
+#include "audio.h"
 #include "ba-device.h"
 #include "ba-rfcomm.h"
 #include "bluez.h"
@@ -73,6 +78,18 @@ enum ba_transport_pcm_mode {
 	BA_TRANSPORT_PCM_MODE_SINK,
 };
 
+enum ba_transport_pcm_underrun_policy {
+	/* send late data in a burst in order to catch up */
+	BA_TRANSPORT_PCM_UNDERRUN_NONE,
+	/* restart the stream time synchronization */
+	BA_TRANSPORT_PCM_UNDERRUN_RESYNC,
+	/* insert silence and keep the stream clock running */
+	BA_TRANSPORT_PCM_UNDERRUN_SILENCE,
+};
+
+/* maximal PCM start threshold (in milliseconds) */
+#define BA_TRANSPORT_PCM_START_THRESHOLD_MAX 1000
+
 /**
  * Builder for 16-bit PCM stream format identifier. */
 #define BA_TRANSPORT_PCM_FORMAT(sign, width, bytes, endian) \
@@ -89,6 +106,38 @@ enum ba_transport_pcm_mode {
 #define BA_TRANSPORT_PCM_FORMAT_S24_4LE BA_TRANSPORT_PCM_FORMAT(1, 24, 4, 0)
 #define BA_TRANSPORT_PCM_FORMAT_S32_4LE BA_TRANSPORT_PCM_FORMAT(1, 32, 4, 0)
 
+/**
+ * Get the format of the PCM FIFO. */
+#define ba_transport_pcm_fifo_format(pcm) \
+	((pcm)->fifo_format != 0 ? (pcm)->fifo_format : (pcm)->format)
+
+struct ba_transport_pcm;
+
+/**
+ * Callback function invoked when the PCM drain has completed. The error
+ * is 0 on success, or ECANCELED when the drain request was canceled. */
+typedef void ba_transport_pcm_drain_cb(struct ba_transport_pcm *pcm,
+		int error, void *userdata);
+
+/* PCM drain state polling interval (in milliseconds) */
+#define BA_TRANSPORT_PCM_DRAIN_POLL_INTERVAL 10
+/* maximal time spent in a single PCM drain stage (in milliseconds) */
+#define BA_TRANSPORT_PCM_DRAIN_TIMEOUT 2000
+
+/* maximal time for the reconfigured transport to take over
+ * the PCM connection of the destroyed one (in milliseconds) */
+#define BA_TRANSPORT_PCM_HANDOVER_TIMEOUT 5000
+
+enum ba_transport_pcm_drain_state {
+	BA_TRANSPORT_PCM_DRAIN_IDLE,
+	/* waiting for the IO thread to process all PCM samples */
+	BA_TRANSPORT_PCM_DRAIN_SYNC,
+	/* waiting for the BT socket output queue to become empty */
+	BA_TRANSPORT_PCM_DRAIN_OUTQ,
+	/* waiting for the remote device to play out its buffer */
+	BA_TRANSPORT_PCM_DRAIN_DELAY,
+};
+
 struct ba_transport_pcm {
 
 	/* backward reference to transport */
@@ -104,6 +153,11 @@ struct ba_transport_pcm {
 
 	/* 16-bit stream format identifier */
 	uint16_t format;
+	/* Format of the FIFO requested by the client. If it has a higher
+	 * resolution than the stream format, the A2DP source requantizes
+	 * the signal with dither. Zero means the stream format. */
+	uint16_t fifo_format;
+	struct audio_dither dither;
 	/* number of audio channels */
 	unsigned int channels;
 	/* PCM sampling frequency */
@@ -113,6 +167,12 @@ struct ba_transport_pcm {
 	 * audio encoding or decoding and data transfer. */
 	unsigned int delay;
 
+	/* Amount of audio (in milliseconds) which has to be buffered in the
+	 * FIFO before the stream is started. This and the underrun policy are
+	 * used by the A2DP source only. */
+	unsigned int start_threshold;
+	enum ba_transport_pcm_underrun_policy underrun_policy;
+
 	/* internal software volume control */
 	bool soft_volume;
 
@@ -130,15 +190,43 @@ struct ba_transport_pcm {
 
 	/* data synchronization */
 	pthread_mutex_t synced_mtx;
-	pthread_cond_t synced;
+	struct {
+		enum ba_transport_pcm_drain_state state;
+		/* set by the IO thread when all samples were processed */
+		bool synced;
+		/* time limit for the current drain state */
+		struct timespec deadline;
+		/* GLib event source of the drain state machine */
+		unsigned int source_id;
+		ba_transport_pcm_drain_cb *callback;
+		void *userdata;
+	} drain;
 
 	/* PCM access synchronization */
 	pthread_mutex_t dbus_mtx;
 
+	/* PCM controller channel and its main loop watch */
+	GIOChannel *controller;
+	unsigned int controller_id;
+
+	/* PCM connection shall be handed over to the transport
+	 * created during A2DP codec reconfiguration */
+	bool handover;
+	struct timespec handover_ts;
+
 	/* exported PCM D-Bus API */
 	char *ba_dbus_path;
 	unsigned int ba_dbus_id;
 
+	struct {
+		/* number of PCM frames transferred via FIFO */
+		uint64_t frames;
+		/* number of times the stream fell behind the schedule */
+		unsigned int underruns;
+		/* number of silence frames inserted due to underruns */
+		uint64_t silence_frames;
+	} stats;
+
 };
 
 struct ba_transport_thread {
@@ -148,6 +236,8 @@ struct ba_transport_thread {
 	pthread_mutex_t mutex;
 	/* actual thread ID */
 	pthread_t id;
+	/* kernel thread ID (used for CPU time accounting) */
+	pid_t tid;
 	/* notification PIPE */
 	int pipe[2];
 	/* indicates cleanup lock */
@@ -191,6 +281,32 @@ struct ba_transport {
 	struct ba_transport_thread thread_enc;
 	struct ba_transport_thread thread_dec;
 
+	/* guard the statistics estimation window */
+	pthread_mutex_t stats_mtx;
+
+	/* BT link traffic statistics - updated by IO threads, counters might
+	 * be read by any thread at any time, so they have to be atomic */
+	struct {
+		/* number of bytes read from the BT socket */
+		_Atomic uint64_t bt_rx_bytes;
+		/* number of bytes written to the BT socket */
+		_Atomic uint64_t bt_tx_bytes;
+		/* number of bytes queued in the BT socket output buffer */
+		_Atomic unsigned int bt_queued;
+		/* estimated BT link bitrate (both directions) in bits per second */
+		_Atomic unsigned int bt_bitrate;
+		/* bitrate estimation window start point (guarded by stats_mtx) */
+		struct timespec bt_bitrate_ts;
+		uint64_t bt_bitrate_bytes;
+		/* number of RTP packets lost (A2DP sink only) */
+		_Atomic unsigned int rtp_lost;
+		/* number of IO thread wakeups (A2DP sink only) */
+		_Atomic uint64_t wakeups;
+		/* estimated wakeups per second (bitrate estimation window) */
+		_Atomic unsigned int wakeup_rate;
+		uint64_t wakeup_rate_wakeups;
+	} stats;
+
 	union {
 
 		struct {
@@ -209,6 +325,18 @@ struct ba_transport {
 			/* delay reported by the AVDTP */
 			uint16_t delay;
 
+			/* Volume propagation to BlueZ. There is at most one Set call in
+			 * flight, subsequent changes are coalesced into the queued value.
+			 * These fields shall be accessed from the main thread only. */
+			struct {
+				/* Set call is in flight */
+				bool pending;
+				/* value to be sent when the pending call completes or -1 */
+				int queued;
+				/* value most recently sent to (or reported by) BlueZ or -1 */
+				int sent;
+			} bt_volume;
+
 			struct ba_transport_pcm pcm;
 			/* PCM for back-channel stream */
 			struct ba_transport_pcm pcm_bc;
@@ -220,6 +348,16 @@ struct ba_transport {
 			 * subsequent ioctl() calls. */
 			int bt_fd_coutq_init;
 
+			/* BT traffic capture (if enabled) */
+			struct a2dp_capture *capture;
+
+			/* Encoded silence packet replayed during the keep-alive period. It
+			 * is valid for the codec configuration of this transport only. */
+			uint8_t *silence;
+			size_t silence_len;
+			/* number of PCM frames encoded in the silence packet */
+			unsigned int silence_frames;
+
 		} a2dp;
 
 		struct {
@@ -283,12 +421,18 @@ void ba_transport_set_codec(
 		struct ba_transport *t,
 		uint16_t codec_id);
 
+void ba_transport_stats_update(struct ba_transport *t);
+unsigned int ba_transport_get_bitrate(struct ba_transport *t);
+uint64_t ba_transport_get_cpu_time(const struct ba_transport *t);
+
 int ba_transport_start(struct ba_transport *t);
 int ba_transport_stop(struct ba_transport *t);
 
 int ba_transport_set_a2dp_state(
 		struct ba_transport *t,
 		enum bluez_a2dp_transport_state state);
+void ba_transport_acquire_a2dp_async(
+		struct ba_transport *t);
 
 int ba_transport_pcm_get_delay(
 		const struct ba_transport_pcm *pcm);
@@ -305,10 +449,16 @@ int ba_transport_pcm_volume_update(
 
 int ba_transport_pcm_pause(struct ba_transport_pcm *pcm);
 int ba_transport_pcm_resume(struct ba_transport_pcm *pcm);
-int ba_transport_pcm_drain(struct ba_transport_pcm *pcm);
+int ba_transport_pcm_drain(
+		struct ba_transport_pcm *pcm,
+		ba_transport_pcm_drain_cb *callback,
+		void *userdata);
+void ba_transport_pcm_drain_cancel(struct ba_transport_pcm *pcm);
+void ba_transport_pcm_drain_synced(struct ba_transport_pcm *pcm);
 int ba_transport_pcm_drop(struct ba_transport_pcm *pcm);
 
 int ba_transport_pcm_release(struct ba_transport_pcm *pcm);
+bool ba_transport_pcm_is_handover(const struct ba_transport_pcm *pcm);
 
 int ba_transport_thread_create(
 		struct ba_transport_thread *th,
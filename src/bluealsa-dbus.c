@@ -16,9 +16,11 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
 
 #include <gio/gio.h>
@@ -28,6 +30,7 @@
 
 #include "a2dp.h"
 #include "a2dp-codecs.h"
+#include "audio.h"
 #include "ba-adapter.h"
 #include "ba-device.h"
 #include "bluealsa-iface.h"
@@ -37,6 +40,7 @@
 #include "utils.h"
 #include "shared/defs.h"
 #include "shared/log.h"
+#include "shared/mempool.h"
 
 static GVariant *ba_variant_new_device_path(const struct ba_device *d) {
 	return g_variant_new_object_path(d->bluez_dbus_path);
@@ -258,6 +262,71 @@ static void bluealsa_manager_get_pcms(GDBusMethodInvocation *inv) {
 	g_variant_builder_clear(&pcms);
 }
 
+static void bluealsa_manager_get_adapters(GDBusMethodInvocation *inv) {
+
+	GVariantBuilder adapters;
+	g_variant_builder_init(&adapters, G_VARIANT_TYPE("a{oa{sv}}"));
+
+	struct ba_adapter *a;
+	size_t i;
+
+	for (i = 0; i < HCI_MAX_DEV; i++) {
+
+		if ((a = ba_adapter_lookup(i)) == NULL)
+			continue;
+
+		char addr[18];
+		ba2str(&a->hci.bdaddr, addr);
+
+		GVariantBuilder props;
+		g_variant_builder_init(&props, G_VARIANT_TYPE("a{sv}"));
+		g_variant_builder_add(&props, "{sv}", "Name", g_variant_new_string(a->hci.name));
+		g_variant_builder_add(&props, "{sv}", "Address", g_variant_new_string(addr));
+		g_variant_builder_add(&props, "{sv}", "Bitrate",
+				g_variant_new_uint32(ba_adapter_get_bitrate(a, NULL)));
+		g_variant_builder_add(&props, "{sv}", "BitrateLimit",
+				g_variant_new_uint32(config.hci_bitrate_limit));
+
+		g_variant_builder_add(&adapters, "{oa{sv}}", a->ba_dbus_path, &props);
+		g_variant_builder_clear(&props);
+
+		ba_adapter_unref(a);
+
+	}
+
+	g_dbus_method_invocation_return_value(inv, g_variant_new("(a{oa{sv}})", &adapters));
+	g_variant_builder_clear(&adapters);
+}
+
+static void bluealsa_manager_get_statistics(GDBusMethodInvocation *inv) {
+
+	struct mempool_stats mps;
+	mempool_get_stats(&mps);
+
+	/* percentage of the pool memory which does not hold user data - it
+	 * accounts for size class rounding and recycled (cached) blocks */
+	const size_t pool = mps.allocated + mps.cached;
+	const unsigned int fragmentation = pool > 0 ? (pool - mps.requested) * 100 / pool : 0;
+
+	struct rusage usage = { 0 };
+	getrusage(RUSAGE_SELF, &usage);
+
+	GVariantBuilder props;
+	g_variant_builder_init(&props, G_VARIANT_TYPE("a{sv}"));
+
+	g_variant_builder_add(&props, "{sv}", "PoolHits", g_variant_new_uint64(mps.hits));
+	g_variant_builder_add(&props, "{sv}", "PoolMisses", g_variant_new_uint64(mps.misses));
+	g_variant_builder_add(&props, "{sv}", "PoolRequestedBytes", g_variant_new_uint64(mps.requested));
+	g_variant_builder_add(&props, "{sv}", "PoolAllocatedBytes", g_variant_new_uint64(mps.allocated));
+	g_variant_builder_add(&props, "{sv}", "PoolCachedBytes", g_variant_new_uint64(mps.cached));
+	g_variant_builder_add(&props, "{sv}", "PoolPeakBytes", g_variant_new_uint64(mps.peak));
+	g_variant_builder_add(&props, "{sv}", "PoolFragmentation", g_variant_new_uint32(fragmentation));
+	g_variant_builder_add(&props, "{sv}", "PeakRSS", g_variant_new_uint64((uint64_t)usage.ru_maxrss * 1024));
+
+	g_dbus_method_invocation_return_value(inv, g_variant_new("(a{sv})", &props));
+	g_variant_builder_clear(&props);
+}
+
 static void bluealsa_manager_method_call(GDBusConnection *conn, const char *sender,
 		const char *path, const char *interface, const char *method, GVariant *params,
 		GDBusMethodInvocation *invocation, void *userdata) {
@@ -268,6 +337,10 @@ static void bluealsa_manager_method_call(GDBusConnection *conn, const char *send
 	static const GDBusMethodCallDispatcher dispatchers[] = {
 		{ .method = "GetPCMs",
 			.handler = bluealsa_manager_get_pcms },
+		{ .method = "GetAdapters",
+			.handler = bluealsa_manager_get_adapters },
+		{ .method = "GetStatistics",
+			.handler = bluealsa_manager_get_statistics },
 		{ NULL },
 	};
 
@@ -285,6 +358,23 @@ unsigned int bluealsa_dbus_manager_register(GError **error) {
 			(GDBusInterfaceInfo *)&bluealsa_iface_manager, &vtable, NULL, NULL, error);
 }
 
+static void bluealsa_pcm_controller_drained(struct ba_transport_pcm *pcm,
+		int err, void *userdata) {
+	(void)pcm;
+
+	GIOChannel *ch = (GIOChannel *)userdata;
+	size_t len;
+
+	/* Do not reply if the drain was canceled due to the
+	 * controller channel closure or a drop request. */
+	if (err == 0) {
+		g_io_channel_write_chars(ch, "OK", -1, &len, NULL);
+		g_io_channel_flush(ch, NULL);
+	}
+
+	g_io_channel_unref(ch);
+}
+
 static gboolean bluealsa_pcm_controller(GIOChannel *ch, GIOCondition condition,
 		void *userdata) {
 	(void)condition;
@@ -299,8 +389,14 @@ static gboolean bluealsa_pcm_controller(GIOChannel *ch, GIOCondition condition,
 		return TRUE;
 	case G_IO_STATUS_NORMAL:
 		if (strncmp(command, BLUEALSA_PCM_CTRL_DRAIN, len) == 0) {
-			if (pcm->mode == BA_TRANSPORT_PCM_MODE_SINK)
-				ba_transport_pcm_drain(pcm);
+			/* Reply will be sent when the drain completes. Until then, the
+			 * main loop is free to serve other clients. */
+			if (pcm->mode == BA_TRANSPORT_PCM_MODE_SINK) {
+				g_io_channel_ref(ch);
+				if (ba_transport_pcm_drain(pcm, bluealsa_pcm_controller_drained, ch) == 0)
+					return TRUE;
+				g_io_channel_unref(ch);
+			}
 			g_io_channel_write_chars(ch, "OK", -1, &len, NULL);
 		}
 		else if (strncmp(command, BLUEALSA_PCM_CTRL_DROP, len) == 0) {
@@ -325,8 +421,11 @@ static gboolean bluealsa_pcm_controller(GIOChannel *ch, GIOCondition condition,
 	case G_IO_STATUS_AGAIN:
 		return TRUE;
 	case G_IO_STATUS_EOF:
+		ba_transport_pcm_drain_cancel(pcm);
 		ba_transport_pcm_release(pcm);
 		ba_transport_thread_send_signal(pcm->th, BA_TRANSPORT_SIGNAL_PCM_CLOSE);
+		pcm->controller = NULL;
+		pcm->controller_id = 0;
 		/* remove channel from watch */
 		return FALSE;
 	}
@@ -334,8 +433,80 @@ static gboolean bluealsa_pcm_controller(GIOChannel *ch, GIOCondition condition,
 	return TRUE;
 }
 
+/**
+ * Attach PCM controller channel to the given PCM. */
+static void bluealsa_pcm_controller_attach(struct ba_transport_pcm *pcm,
+		GIOChannel *ch) {
+	pcm->controller = ch;
+	pcm->controller_id = g_io_add_watch_full(ch, G_PRIORITY_DEFAULT, G_IO_IN,
+			bluealsa_pcm_controller, ba_transport_pcm_ref(pcm),
+			(GDestroyNotify)ba_transport_pcm_unref);
+}
+
+/**
+ * Parse PCM open options.
+ *
+ * @return On success this function returns NULL. Otherwise, the error
+ *   message is returned. */
+static const char *bluealsa_pcm_open_parse_options(GVariant *params,
+		const struct ba_transport_pcm *pcm,
+		unsigned int *start_threshold,
+		enum ba_transport_pcm_underrun_policy *underrun_policy,
+		uint16_t *fifo_format,
+		bool *noise_shaping) {
+
+	const char *errmsg = NULL;
+	GVariantIter *options;
+	GVariant *value = NULL;
+	const char *option;
+
+	g_variant_get(params, "(a{sv})", &options);
+	while (errmsg == NULL && g_variant_iter_next(options, "{&sv}", &option, &value)) {
+
+		if (strcmp(option, "StartThreshold") == 0 &&
+				g_variant_validate_value(value, G_VARIANT_TYPE_UINT32, option)) {
+			if ((*start_threshold = g_variant_get_uint32(value)) > BA_TRANSPORT_PCM_START_THRESHOLD_MAX)
+				errmsg = "Start threshold out of range";
+		}
+		else if (strcmp(option, "UnderrunPolicy") == 0 &&
+				g_variant_validate_value(value, G_VARIANT_TYPE_STRING, option)) {
+			const char *policy = g_variant_get_string(value, NULL);
+			if (strcmp(policy, "none") == 0)
+				*underrun_policy = BA_TRANSPORT_PCM_UNDERRUN_NONE;
+			else if (strcmp(policy, "resync") == 0)
+				*underrun_policy = BA_TRANSPORT_PCM_UNDERRUN_RESYNC;
+			else if (strcmp(policy, "silence") == 0)
+				*underrun_policy = BA_TRANSPORT_PCM_UNDERRUN_SILENCE;
+			else
+				errmsg = "Invalid underrun policy";
+		}
+		else if (strcmp(option, "Format") == 0 &&
+				g_variant_validate_value(value, G_VARIANT_TYPE_UINT16, option)) {
+			/* Higher resolution FIFO format is supported only by A2DP source
+			 * with 16-bit codecs, which can requantize the signal. */
+			*fifo_format = g_variant_get_uint16(value);
+			if (*fifo_format != pcm->format &&
+					!(pcm->t->type.profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE &&
+						pcm->format == BA_TRANSPORT_PCM_FORMAT_S16_2LE &&
+						(*fifo_format == BA_TRANSPORT_PCM_FORMAT_S24_4LE ||
+						 *fifo_format == BA_TRANSPORT_PCM_FORMAT_S32_4LE)))
+				errmsg = "Unsupported PCM format";
+		}
+		else if (strcmp(option, "NoiseShaping") == 0 &&
+				g_variant_validate_value(value, G_VARIANT_TYPE_BOOLEAN, option))
+			*noise_shaping = g_variant_get_boolean(value);
+
+		g_variant_unref(value);
+		value = NULL;
+	}
+
+	g_variant_iter_free(options);
+	return errmsg;
+}
+
 static void bluealsa_pcm_open(GDBusMethodInvocation *inv) {
 
+	GVariant *params = g_dbus_method_invocation_get_parameters(inv);
 	void *userdata = g_dbus_method_invocation_get_user_data(inv);
 	struct ba_transport_pcm *pcm = (struct ba_transport_pcm *)userdata;
 	const bool is_sink = pcm->mode == BA_TRANSPORT_PCM_MODE_SINK;
@@ -344,6 +515,22 @@ static void bluealsa_pcm_open(GDBusMethodInvocation *inv) {
 	int pcm_fds[4] = { -1, -1, -1, -1 };
 	size_t i;
 
+	unsigned int start_threshold = 0;
+	enum ba_transport_pcm_underrun_policy underrun_policy = BA_TRANSPORT_PCM_UNDERRUN_NONE;
+	uint16_t fifo_format = pcm->format;
+	bool noise_shaping = false;
+	const char *errmsg;
+
+	/* options are available with the OpenWithOptions() call only */
+	if (g_variant_is_of_type(params, G_VARIANT_TYPE("(a{sv})")) &&
+			(errmsg = bluealsa_pcm_open_parse_options(params, pcm, &start_threshold,
+					&underrun_policy, &fifo_format, &noise_shaping)) != NULL) {
+		g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
+				G_DBUS_ERROR_INVALID_ARGS, "%s", errmsg);
+		ba_transport_pcm_unref(pcm);
+		return;
+	}
+
 	/* Prevent two (or more) clients trying to
 	 * open the same PCM at the same time. */
 	pthread_mutex_lock(&pcm->dbus_mtx);
@@ -382,6 +569,15 @@ static void bluealsa_pcm_open(GDBusMethodInvocation *inv) {
 		goto fail;
 	}
 
+	/* make sure that the PIPE can hold the start threshold of audio */
+	if (start_threshold > 0) {
+		const int size = BA_TRANSPORT_PCM_FORMAT_BYTES(fifo_format) * pcm->channels *
+			pcm->sampling / 1000 * start_threshold;
+		if (fcntl(pcm_fds[0], F_GETPIPE_SZ) < size &&
+				fcntl(pcm_fds[0], F_SETPIPE_SZ, size) == -1)
+			warn("Couldn't resize PCM PIPE: %s", strerror(errno));
+	}
+
 	/* Source profiles (A2DP Source and SCO Audio Gateway) should be initialized
 	 * only if the audio is about to be transferred. It is most likely, that BT
 	 * headset will not run voltage converter (power-on its circuit board) until
@@ -398,10 +594,13 @@ static void bluealsa_pcm_open(GDBusMethodInvocation *inv) {
 	/* get correct PIPE endpoint - PIPE is unidirectional */
 	pcm->fd = pcm_fds[is_sink ? 0 : 1];
 
+	pcm->start_threshold = start_threshold;
+	pcm->underrun_policy = underrun_policy;
+	pcm->fifo_format = fifo_format;
+	audio_dither_init(&pcm->dither, noise_shaping);
+
 	GIOChannel *ch = g_io_channel_unix_new(pcm_fds[2]);
-	g_io_add_watch_full(ch, G_PRIORITY_DEFAULT, G_IO_IN,
-			bluealsa_pcm_controller, ba_transport_pcm_ref(pcm),
-			(GDestroyNotify)ba_transport_pcm_unref);
+	bluealsa_pcm_controller_attach(pcm, ch);
 	g_io_channel_set_close_on_unref(ch, TRUE);
 	g_io_channel_set_encoding(ch, NULL, NULL);
 	g_io_channel_unref(ch);
@@ -587,6 +786,9 @@ static void bluealsa_pcm_select_codec(GDBusMethodInvocation *inv) {
 	goto final;
 
 fail:
+	/* codec selection failed, so there is nothing to hand over */
+	if (t->type.profile & BA_TRANSPORT_PROFILE_MASK_A2DP)
+		t->a2dp.pcm.handover = false;
 	if (errmsg == NULL)
 		errmsg = strerror(errno);
 	error("Couldn't select codec: %s: %s", codec, errmsg);
@@ -602,6 +804,42 @@ final:
 		g_variant_unref(value);
 }
 
+static void bluealsa_pcm_get_statistics(GDBusMethodInvocation *inv) {
+
+	void *userdata = g_dbus_method_invocation_get_user_data(inv);
+	struct ba_transport_pcm *pcm = (struct ba_transport_pcm *)userdata;
+	const struct ba_transport *t = pcm->t;
+
+	GVariantBuilder stats;
+	g_variant_builder_init(&stats, G_VARIANT_TYPE("a{sv}"));
+
+	g_variant_builder_add(&stats, "{sv}", "ReceivedBytes",
+			g_variant_new_uint64(t->stats.bt_rx_bytes));
+	g_variant_builder_add(&stats, "{sv}", "TransmittedBytes",
+			g_variant_new_uint64(t->stats.bt_tx_bytes));
+	g_variant_builder_add(&stats, "{sv}", "QueuedBytes",
+			g_variant_new_uint32(t->stats.bt_queued));
+	g_variant_builder_add(&stats, "{sv}", "LostPackets",
+			g_variant_new_uint32(t->stats.rtp_lost));
+	g_variant_builder_add(&stats, "{sv}", "Wakeups",
+			g_variant_new_uint64(t->stats.wakeups));
+	g_variant_builder_add(&stats, "{sv}", "WakeupRate",
+			g_variant_new_uint32(t->stats.wakeup_rate));
+	g_variant_builder_add(&stats, "{sv}", "CPUTime",
+			g_variant_new_uint64(ba_transport_get_cpu_time(t)));
+	g_variant_builder_add(&stats, "{sv}", "Frames",
+			g_variant_new_uint64(pcm->stats.frames));
+	g_variant_builder_add(&stats, "{sv}", "Underruns",
+			g_variant_new_uint32(pcm->stats.underruns));
+	g_variant_builder_add(&stats, "{sv}", "SilenceFrames",
+			g_variant_new_uint64(pcm->stats.silence_frames));
+
+	g_dbus_method_invocation_return_value(inv, g_variant_new("(a{sv})", &stats));
+	g_variant_builder_clear(&stats);
+
+	ba_transport_pcm_unref(pcm);
+}
+
 static void bluealsa_pcm_method_call(GDBusConnection *conn, const char *sender,
 		const char *path, const char *interface, const char *method, GVariant *params,
 		GDBusMethodInvocation *invocation, void *userdata) {
@@ -612,12 +850,17 @@ static void bluealsa_pcm_method_call(GDBusConnection *conn, const char *sender,
 		{ .method = "Open",
 			.handler = bluealsa_pcm_open,
 			.asynchronous_call = true },
+		{ .method = "OpenWithOptions",
+			.handler = bluealsa_pcm_open,
+			.asynchronous_call = true },
 		{ .method = "GetCodecs",
 			.handler = bluealsa_pcm_get_codecs,
 			.asynchronous_call = true },
 		{ .method = "SelectCodec",
 			.handler = bluealsa_pcm_select_codec,
 			.asynchronous_call = true },
+		{ .method = "GetStatistics",
+			.handler = bluealsa_pcm_get_statistics },
 		{ NULL },
 	};
 
@@ -658,6 +901,28 @@ static void bluealsa_rfcomm_open(GDBusMethodInvocation *inv) {
 	g_object_unref(fd_list);
 }
 
+static void bluealsa_rfcomm_get_indicator_history(GDBusMethodInvocation *inv) {
+
+	void *userdata = g_dbus_method_invocation_get_user_data(inv);
+	struct ba_rfcomm *r = (struct ba_rfcomm *)userdata;
+	struct ba_device_indicator history[BA_DEVICE_INDICATOR_HISTORY_SIZE];
+	size_t i, len;
+
+	len = ba_device_indicator_history(r->sco->d, history, ARRAYSIZE(history));
+
+	GVariantBuilder entries;
+	g_variant_builder_init(&entries, G_VARIANT_TYPE("a(sit)"));
+
+	for (i = 0; i < len; i++)
+		g_variant_builder_add(&entries, "(sit)",
+				ba_device_indicator_to_string(history[i].ind),
+				history[i].value, history[i].timestamp);
+
+	g_dbus_method_invocation_return_value(inv, g_variant_new("(a(sit))", &entries));
+	g_variant_builder_clear(&entries);
+
+}
+
 static void bluealsa_rfcomm_method_call(GDBusConnection *conn, const char *sender,
 		const char *path, const char *interface, const char *method, GVariant *params,
 		GDBusMethodInvocation *invocation, void *userdata) {
@@ -668,6 +933,8 @@ static void bluealsa_rfcomm_method_call(GDBusConnection *conn, const char *sende
 	static const GDBusMethodCallDispatcher dispatchers[] = {
 		{ .method = "Open",
 			.handler = bluealsa_rfcomm_open },
+		{ .method = "GetIndicatorHistory",
+			.handler = bluealsa_rfcomm_get_indicator_history },
 		{ NULL },
 	};
 
@@ -776,6 +1043,148 @@ static gboolean bluealsa_pcm_set_property(GDBusConnection *conn,
 	return FALSE;
 }
 
+static void bluealsa_pcm_emit_removed(const char *path) {
+	g_dbus_connection_emit_signal(config.dbus, NULL,
+			"/org/bluealsa", BLUEALSA_IFACE_MANAGER, "PCMRemoved",
+			g_variant_new("(o)", path), NULL);
+}
+
+/**
+ * Close PCM connection kept for the handover (if any). */
+static void bluealsa_pcm_handover_release(struct ba_device *d) {
+
+	if (d->pcm_handover.fd == -1)
+		return;
+
+	debug("Releasing PCM handover: %s", d->pcm_handover.ba_dbus_path);
+	bluealsa_pcm_emit_removed(d->pcm_handover.ba_dbus_path);
+
+	close(d->pcm_handover.fd);
+	d->pcm_handover.fd = -1;
+	/* this will close the controller socket */
+	g_io_channel_unref(d->pcm_handover.controller);
+	d->pcm_handover.controller = NULL;
+	g_free(d->pcm_handover.ba_dbus_path);
+	d->pcm_handover.ba_dbus_path = NULL;
+
+	if (d->pcm_handover.timeout_id != 0) {
+		unsigned int id = d->pcm_handover.timeout_id;
+		d->pcm_handover.timeout_id = 0;
+		/* this call might release the last reference to the device */
+		g_source_remove(id);
+	}
+
+}
+
+static gboolean bluealsa_pcm_handover_timeout(void *userdata) {
+	struct ba_device *d = (struct ba_device *)userdata;
+	warn("PCM handover timeout: %s", d->pcm_handover.ba_dbus_path);
+	d->pcm_handover.timeout_id = 0;
+	bluealsa_pcm_handover_release(d);
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * Keep PCM connection for the handover.
+ *
+ * The PCM FIFO and the controller channel of the PCM which is about to be
+ * destroyed due to the A2DP codec reconfiguration are stored in the device
+ * structure, so they can be taken over by the new transport.
+ *
+ * @return On success this function returns true. */
+static bool bluealsa_pcm_handover_park(struct ba_transport_pcm *pcm) {
+
+	struct ba_device *d = pcm->t->d;
+	int fd;
+
+	bluealsa_pcm_handover_release(d);
+
+	/* The original FIFO will be closed by the transport destroy procedure
+	 * after the IO thread termination, so we have to duplicate it here. */
+	if (pcm->controller == NULL ||
+			(fd = dup(pcm->fd)) == -1)
+		return false;
+
+	debug("Keeping PCM for handover: %s", pcm->ba_dbus_path);
+
+	d->pcm_handover.ba_dbus_path = g_strdup(pcm->ba_dbus_path);
+	d->pcm_handover.format = pcm->format;
+	d->pcm_handover.fifo_format = pcm->fifo_format;
+	d->pcm_handover.dither = pcm->dither;
+	d->pcm_handover.channels = pcm->channels;
+	d->pcm_handover.sampling = pcm->sampling;
+	d->pcm_handover.fd = fd;
+
+	d->pcm_handover.controller = g_io_channel_ref(pcm->controller);
+	g_source_remove(pcm->controller_id);
+	pcm->controller = NULL;
+	pcm->controller_id = 0;
+
+	d->pcm_handover.timeout_id = g_timeout_add_full(G_PRIORITY_DEFAULT,
+			BA_TRANSPORT_PCM_HANDOVER_TIMEOUT, bluealsa_pcm_handover_timeout,
+			ba_device_ref(d), (GDestroyNotify)ba_device_unref);
+
+	return true;
+}
+
+static gboolean bluealsa_pcm_handover_acquire(void *userdata) {
+	struct ba_transport *t = (struct ba_transport *)userdata;
+	/* do not block the main loop on the BlueZ round-trip */
+	if (t->a2dp.pcm.fd != -1)
+		ba_transport_acquire_a2dp_async(t);
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * Take over PCM connection kept for the handover.
+ *
+ * @return If the PCM connection has been taken over, this function returns
+ *   true. Otherwise, false is returned. */
+static bool bluealsa_pcm_handover_resume(struct ba_transport_pcm *pcm) {
+
+	struct ba_transport *t = pcm->t;
+	struct ba_device *d = t->d;
+
+	if (d->pcm_handover.fd == -1 ||
+			strcmp(d->pcm_handover.ba_dbus_path, pcm->ba_dbus_path) != 0)
+		return false;
+
+	/* Without resampling and format conversion the PCM client has
+	 * to reopen the PCM with the new configuration. */
+	if (d->pcm_handover.format != pcm->format ||
+			d->pcm_handover.channels != pcm->channels ||
+			d->pcm_handover.sampling != pcm->sampling) {
+		debug("Couldn't take over PCM: %s", "Configuration mismatch");
+		bluealsa_pcm_handover_release(d);
+		return false;
+	}
+
+	debug("Taking over PCM: %s", pcm->ba_dbus_path);
+
+	pcm->fd = d->pcm_handover.fd;
+	pcm->fifo_format = d->pcm_handover.fifo_format;
+	pcm->dither = d->pcm_handover.dither;
+	d->pcm_handover.fd = -1;
+
+	bluealsa_pcm_controller_attach(pcm, d->pcm_handover.controller);
+	g_io_channel_unref(d->pcm_handover.controller);
+	d->pcm_handover.controller = NULL;
+
+	g_free(d->pcm_handover.ba_dbus_path);
+	d->pcm_handover.ba_dbus_path = NULL;
+	g_source_remove(d->pcm_handover.timeout_id);
+	d->pcm_handover.timeout_id = 0;
+
+	/* In case of A2DP Source profile, the transport has to be acquired by us.
+	 * However, it is not possible to do it right now, because BlueZ waits
+	 * for the reply to the SetConfiguration() call. */
+	if (t->type.profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE)
+		g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, bluealsa_pcm_handover_acquire,
+				ba_transport_ref(t), (GDestroyNotify)ba_transport_unref);
+
+	return true;
+}
+
 /**
  * Register BlueALSA D-Bus PCM interface. */
 unsigned int bluealsa_dbus_pcm_register(struct ba_transport_pcm *pcm, GError **error) {
@@ -792,6 +1201,13 @@ unsigned int bluealsa_dbus_pcm_register(struct ba_transport_pcm *pcm, GError **e
 
 		ba_transport_pcm_ref(pcm);
 
+		/* PCM connection handed over from the transport destroyed due to
+		 * codec reconfiguration - for the client it is the same PCM */
+		if (bluealsa_pcm_handover_resume(pcm)) {
+			bluealsa_dbus_pcm_update(pcm, BA_DBUS_PCM_UPDATE_CODEC | BA_DBUS_PCM_UPDATE_DELAY);
+			return pcm->ba_dbus_id;
+		}
+
 		GVariantBuilder props;
 		ba_variant_populate_pcm(&props, pcm);
 
@@ -840,9 +1256,13 @@ void bluealsa_dbus_pcm_unregister(struct ba_transport_pcm *pcm) {
 	g_dbus_connection_unregister_object(config.dbus, pcm->ba_dbus_id);
 	pcm->ba_dbus_id = 0;
 
-	g_dbus_connection_emit_signal(config.dbus, NULL,
-			"/org/bluealsa", BLUEALSA_IFACE_MANAGER, "PCMRemoved",
-			g_variant_new("(o)", pcm->ba_dbus_path), NULL);
+	const bool handover = ba_transport_pcm_is_handover(pcm);
+	pcm->handover = false;
+
+	if (handover && bluealsa_pcm_handover_park(pcm))
+		return;
+
+	bluealsa_pcm_emit_removed(pcm->ba_dbus_path);
 
 }
 
@@ -879,6 +1299,14 @@ void bluealsa_dbus_rfcomm_update(struct ba_rfcomm *r, unsigned int mask) {
 	g_variant_builder_clear(&props);
 }
 
+void bluealsa_dbus_rfcomm_indicator_changed(struct ba_rfcomm *r,
+		const struct ba_device_indicator *event) {
+	g_dbus_connection_emit_signal(config.dbus, NULL, r->ba_dbus_path,
+			BLUEALSA_IFACE_RFCOMM, "IndicatorChanged",
+			g_variant_new("(sit)", ba_device_indicator_to_string(event->ind),
+				event->value, event->timestamp), NULL);
+}
+
 void bluealsa_dbus_rfcomm_unregister(struct ba_rfcomm *r) {
 	if (r->ba_dbus_id == 0)
 		return;
@@ -17,6 +17,7 @@
 
 #include <glib.h>
 
+#include "ba-device.h"
 #include "ba-rfcomm.h"
 #include "ba-transport.h"
 
@@ -39,6 +40,8 @@ void bluealsa_dbus_pcm_unregister(struct ba_transport_pcm *pcm);
 
 unsigned int bluealsa_dbus_rfcomm_register(struct ba_rfcomm *r, GError **error);
 void bluealsa_dbus_rfcomm_update(struct ba_rfcomm *r, unsigned int mask);
+void bluealsa_dbus_rfcomm_indicator_changed(struct ba_rfcomm *r,
+		const struct ba_device_indicator *event);
 void bluealsa_dbus_rfcomm_unregister(struct ba_rfcomm *r);
 
 #endif
@@ -12,6 +12,10 @@
 
 #include <stddef.h>
 
+static const GDBusArgInfo arg_adapters = {
+	-1, "adapters", "a{oa{sv}}", NULL
+};
+
 static const GDBusArgInfo arg_codec = {
 	-1, "codec", "s", NULL
 };
@@ -24,6 +28,18 @@ static const GDBusArgInfo arg_fd = {
 	-1, "fd", "h", NULL
 };
 
+static const GDBusArgInfo arg_history = {
+	-1, "history", "a(sit)", NULL
+};
+
+static const GDBusArgInfo arg_name = {
+	-1, "name", "s", NULL
+};
+
+static const GDBusArgInfo arg_options = {
+	-1, "options", "a{sv}", NULL
+};
+
 static const GDBusArgInfo arg_path = {
 	-1, "path", "o", NULL
 };
@@ -36,6 +52,18 @@ static const GDBusArgInfo arg_props = {
 	-1, "props", "a{sv}", NULL
 };
 
+static const GDBusArgInfo arg_stats = {
+	-1, "stats", "a{sv}", NULL
+};
+
+static const GDBusArgInfo arg_timestamp = {
+	-1, "timestamp", "t", NULL
+};
+
+static const GDBusArgInfo arg_value = {
+	-1, "value", "i", NULL
+};
+
 static const GDBusArgInfo *GetPCMs_out[] = {
 	&arg_PCMs,
 	NULL,
@@ -48,8 +76,34 @@ static const GDBusMethodInfo bluealsa_iface_manager_GetPCMs = {
 	NULL,
 };
 
+static const GDBusArgInfo *GetAdapters_out[] = {
+	&arg_adapters,
+	NULL,
+};
+
+static const GDBusMethodInfo bluealsa_iface_manager_GetAdapters = {
+	-1, "GetAdapters",
+	NULL,
+	(GDBusArgInfo **)GetAdapters_out,
+	NULL,
+};
+
+static const GDBusArgInfo *manager_GetStatistics_out[] = {
+	&arg_stats,
+	NULL,
+};
+
+static const GDBusMethodInfo bluealsa_iface_manager_GetStatistics = {
+	-1, "GetStatistics",
+	NULL,
+	(GDBusArgInfo **)manager_GetStatistics_out,
+	NULL,
+};
+
 static const GDBusMethodInfo *bluealsa_iface_manager_methods[] = {
 	&bluealsa_iface_manager_GetPCMs,
+	&bluealsa_iface_manager_GetAdapters,
+	&bluealsa_iface_manager_GetStatistics,
 	NULL,
 };
 
@@ -88,6 +142,11 @@ static const GDBusArgInfo *pcm_Open_out[] = {
 	NULL,
 };
 
+static const GDBusArgInfo *pcm_OpenWithOptions_in[] = {
+	&arg_options,
+	NULL,
+};
+
 static const GDBusArgInfo *pcm_GetCodecs_out[] = {
 	&arg_codecs,
 	NULL,
@@ -99,6 +158,11 @@ static const GDBusArgInfo *pcm_SelectCodec_in[] = {
 	NULL,
 };
 
+static const GDBusArgInfo *pcm_GetStatistics_out[] = {
+	&arg_stats,
+	NULL,
+};
+
 static const GDBusMethodInfo bluealsa_iface_pcm_Open = {
 	-1, "Open",
 	NULL,
@@ -106,6 +170,13 @@ static const GDBusMethodInfo bluealsa_iface_pcm_Open = {
 	NULL,
 };
 
+static const GDBusMethodInfo bluealsa_iface_pcm_OpenWithOptions = {
+	-1, "OpenWithOptions",
+	(GDBusArgInfo **)pcm_OpenWithOptions_in,
+	(GDBusArgInfo **)pcm_Open_out,
+	NULL,
+};
+
 static const GDBusMethodInfo bluealsa_iface_pcm_GetCodecs = {
 	-1, "GetCodecs",
 	NULL,
@@ -120,10 +191,19 @@ static const GDBusMethodInfo bluealsa_iface_pcm_SelectCodec = {
 	NULL,
 };
 
+static const GDBusMethodInfo bluealsa_iface_pcm_GetStatistics = {
+	-1, "GetStatistics",
+	NULL,
+	(GDBusArgInfo **)pcm_GetStatistics_out,
+	NULL,
+};
+
 static const GDBusMethodInfo *bluealsa_iface_pcm_methods[] = {
 	&bluealsa_iface_pcm_Open,
+	&bluealsa_iface_pcm_OpenWithOptions,
 	&bluealsa_iface_pcm_GetCodecs,
 	&bluealsa_iface_pcm_SelectCodec,
+	&bluealsa_iface_pcm_GetStatistics,
 	NULL,
 };
 
@@ -199,8 +279,39 @@ static const GDBusMethodInfo bluealsa_iface_rfcomm_Open = {
 	NULL,
 };
 
+static const GDBusArgInfo *rfcomm_GetIndicatorHistory_out[] = {
+	&arg_history,
+	NULL,
+};
+
+static const GDBusMethodInfo bluealsa_iface_rfcomm_GetIndicatorHistory = {
+	-1, "GetIndicatorHistory",
+	NULL,
+	(GDBusArgInfo **)rfcomm_GetIndicatorHistory_out,
+	NULL,
+};
+
 static const GDBusMethodInfo *bluealsa_iface_rfcomm_methods[] = {
 	&bluealsa_iface_rfcomm_Open,
+	&bluealsa_iface_rfcomm_GetIndicatorHistory,
+	NULL,
+};
+
+static const GDBusArgInfo *rfcomm_IndicatorChanged_args[] = {
+	&arg_name,
+	&arg_value,
+	&arg_timestamp,
+	NULL,
+};
+
+static const GDBusSignalInfo bluealsa_iface_rfcomm_IndicatorChanged = {
+	-1, "IndicatorChanged",
+	(GDBusArgInfo **)rfcomm_IndicatorChanged_args,
+	NULL,
+};
+
+static const GDBusSignalInfo *bluealsa_iface_rfcomm_signals[] = {
+	&bluealsa_iface_rfcomm_IndicatorChanged,
 	NULL,
 };
 
@@ -242,7 +353,7 @@ const GDBusInterfaceInfo bluealsa_iface_pcm = {
 const GDBusInterfaceInfo bluealsa_iface_rfcomm = {
 	-1, BLUEALSA_IFACE_RFCOMM,
 	(GDBusMethodInfo **)bluealsa_iface_rfcomm_methods,
-	NULL,
+	(GDBusSignalInfo **)bluealsa_iface_rfcomm_signals,
 	(GDBusPropertyInfo **)bluealsa_iface_rfcomm_properties,
 	NULL,
 };
@@ -49,6 +49,11 @@ struct ba_config {
 	 * during profile registration. Leave it empty to use any adapter. */
 	GArray *hci_filter;
 
+	/* Aggregate BT link bitrate (in bits per second) of all transports on
+	 * a single adapter, above which encoders of new A2DP transports will be
+	 * steered towards lower quality. Zero means no limit. */
+	unsigned int hci_bitrate_limit;
+
 	/* used for main thread identification */
 	pthread_t main_thread;
 
@@ -68,6 +73,8 @@ struct ba_config {
 		const char *xapl_software_version;
 		const char *xapl_product_name;
 		unsigned int xapl_features;
+		/* keep PCM sampling at 16 kHz regardless of the codec */
+		bool fixed_rate;
 	} hfp;
 
 	struct {
@@ -98,6 +105,27 @@ struct ba_config {
 		 * been closed. One might set this value to negative number for infinite
 		 * time. This option applies for the source profile only. */
 		int keep_alive;
+		/* During the keep-alive period, instead of sending nothing, stream
+		 * silence which was encoded only once and cached by the transport. */
+		bool keep_alive_silence;
+
+		/* Keep PCM connection of the client open when A2DP codec is being
+		 * reconfigured. The new transport created by BlueZ will take over
+		 * the PCM, as long as the PCM format has not been changed. */
+		bool keep_pcm;
+
+		/* Expose A2DP sink PCM in the S32_4LE format regardless of the codec,
+		 * so clients do not have to reopen PCM when the codec is changed. */
+		bool sink_fixed_format;
+
+		/* The number of milliseconds for which A2DP sink lets incoming packets
+		 * accumulate in the BT socket before reading them in a single burst.
+		 * Zero disables such low-power mode. */
+		unsigned int sink_batch;
+
+		/* Directory where BT traffic of A2DP transports shall be captured.
+		 * Captures can be used for replaying real-world sessions. */
+		const char *capture_dir;
 
 	} a2dp;
 
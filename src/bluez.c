@@ -1126,7 +1126,15 @@ static void bluez_signal_transport_changed(GDBusConnection *conn, const char *se
 			if (t->type.profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE &&
 					t->a2dp.pcm.soft_volume)
 				debug("Skipping A2DP volume update: %u", volume);
+			else if (t->a2dp.bt_volume.sent == volume)
+				/* This is an echo of our own Set call - the update would only
+				 * bounce the volume back and forth. */
+				debug("Skipping echoed A2DP volume update: %u", volume);
 			else {
+				/* Genuine remote volume change. It is more recent than our
+				 * queued volume level (if any), so the queued one is dropped. */
+				t->a2dp.bt_volume.queued = -1;
+				t->a2dp.bt_volume.sent = volume;
 				int level = ba_transport_pcm_volume_bt_to_level(&t->a2dp.pcm, volume);
 				debug("Updating A2DP volume: %u [%.2f dB]", volume, 0.01 * level);
 				t->a2dp.pcm.volume[0].level = t->a2dp.pcm.volume[1].level = level;
@@ -107,41 +107,66 @@ HANDLE_APTX aptxhddec_init(void) {
 /**
  * Encode stereo PCM.
  *
+ * This function encodes as many apt-X code words (4 stereo frames each) as
+ * there are available in the input buffer and as will fit into the output
+ * buffer. Encoding a whole MTU worth of data in a single call amortizes the
+ * per-call overhead of the encoder library.
+ *
+ * @param len On input, the size of the output buffer. On output, the number
+ *   of bytes written to the output buffer.
  * @returns On success, this function returns the number of processed input
  *   samples. On error, -1 is returned. */
 ssize_t aptxenc_encode(HANDLE_APTX handle, const int16_t *input, size_t samples,
 		void *output, size_t *len) {
 
-	if (samples < 8 || *len < 4)
+	size_t blocks = samples / 8;
+	if (blocks > *len / 4)
+		blocks = *len / 4;
+
+	if (blocks == 0)
 		return errno = EINVAL, -1;
 
+	uint8_t *out = output;
+	size_t i;
+
 #if WITH_LIBOPENAPTX
 
-	const uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */] = {
-		0, input[0], input[0] >> 8, 0, input[1], input[1] >> 8,
-		0, input[2], input[2] >> 8, 0, input[3], input[3] >> 8,
-		0, input[4], input[4] >> 8, 0, input[5], input[5] >> 8,
-		0, input[6], input[6] >> 8, 0, input[7], input[7] >> 8,
-	};
+	uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */ * 32];
+	size_t n, written;
 
-	size_t rv;
-	if ((rv = aptx_encode(handle, pcm, sizeof(pcm), output, *len, len)) != sizeof(pcm))
-		return -1;
+	for (n = blocks * 8; n > 0; ) {
+
+		size_t chunk = n < sizeof(pcm) / 3 ? n : sizeof(pcm) / 3;
+		for (i = 0; i < chunk; i++, input++) {
+			pcm[i * 3 + 0] = 0;
+			pcm[i * 3 + 1] = *input;
+			pcm[i * 3 + 2] = *input >> 8;
+		}
+
+		if (aptx_encode(handle, pcm, chunk * 3, out, chunk / 2, &written) != chunk * 3)
+			return -1;
 
-	return rv / 3;
+		out += written;
+		n -= chunk;
+
+	}
 
 #else
 
-	int32_t pcm_l[4] = { input[0], input[2], input[4], input[6] };
-	int32_t pcm_r[4] = { input[1], input[3], input[5], input[7] };
+	for (i = 0; i < blocks; i++, input += 8, out += 4) {
 
-	if (aptxbtenc_encodestereo(handle, pcm_l, pcm_r, output) != 0)
-		return -1;
+		int32_t pcm_l[4] = { input[0], input[2], input[4], input[6] };
+		int32_t pcm_r[4] = { input[1], input[3], input[5], input[7] };
 
-	*len = 4;
-	return 8;
+		if (aptxbtenc_encodestereo(handle, pcm_l, pcm_r, out) != 0)
+			return -1;
+
+	}
 
 #endif
+
+	*len = out - (uint8_t *)output;
+	return blocks * 8;
 }
 #endif
 
@@ -202,49 +227,72 @@ ssize_t aptxdec_decode(HANDLE_APTX handle, const void *input, size_t len,
 /**
  * Encode stereo PCM (HD variant).
  *
+ * Similarly to the aptxenc_encode(), this function encodes as many code
+ * words as possible with a single call.
+ *
+ * @param len On input, the size of the output buffer. On output, the number
+ *   of bytes written to the output buffer.
  * @returns On success, this function returns the number of processed input
  *   samples. On error, -1 is returned. */
 ssize_t aptxhdenc_encode(HANDLE_APTX handle, const int32_t *input, size_t samples,
 		void *output, size_t *len) {
 
-	if (samples < 8 || *len < 6)
+	size_t blocks = samples / 8;
+	if (blocks > *len / 6)
+		blocks = *len / 6;
+
+	if (blocks == 0)
 		return errno = EINVAL, -1;
 
+	uint8_t *out = output;
+	size_t i;
+
 #if WITH_LIBOPENAPTX
 
-	const uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */] = {
-		input[0], input[0] >> 8, input[0] >> 16, input[1], input[1] >> 8, input[1] >> 16,
-		input[2], input[2] >> 8, input[2] >> 16, input[3], input[3] >> 8, input[3] >> 16,
-		input[4], input[4] >> 8, input[4] >> 16, input[5], input[5] >> 8, input[5] >> 16,
-		input[6], input[6] >> 8, input[6] >> 16, input[7], input[7] >> 8, input[7] >> 16,
-	};
+	uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */ * 32];
+	size_t n, written;
 
-	size_t rv;
-	if ((rv = aptx_encode(handle, pcm, sizeof(pcm), output, *len, len)) != sizeof(pcm))
-		return -1;
+	for (n = blocks * 8; n > 0; ) {
+
+		size_t chunk = n < sizeof(pcm) / 3 ? n : sizeof(pcm) / 3;
+		for (i = 0; i < chunk; i++, input++) {
+			pcm[i * 3 + 0] = *input;
+			pcm[i * 3 + 1] = *input >> 8;
+			pcm[i * 3 + 2] = *input >> 16;
+		}
+
+		if (aptx_encode(handle, pcm, chunk * 3, out, chunk / 8 * 6, &written) != chunk * 3)
+			return -1;
 
-	return rv / 3;
+		out += written;
+		n -= chunk;
+
+	}
 
 #else
 
-	int32_t pcm_l[4] = { input[0], input[2], input[4], input[6] };
-	int32_t pcm_r[4] = { input[1], input[3], input[5], input[7] };
-	uint32_t code[2];
+	for (i = 0; i < blocks; i++, input += 8, out += 6) {
 
-	if (aptxhdbtenc_encodestereo(handle, pcm_l, pcm_r, code) != 0)
-		return -1;
+		int32_t pcm_l[4] = { input[0], input[2], input[4], input[6] };
+		int32_t pcm_r[4] = { input[1], input[3], input[5], input[7] };
+		uint32_t code[2];
 
-	((uint8_t *)output)[0] = code[0] >> 16;
-	((uint8_t *)output)[1] = code[0] >> 8;
-	((uint8_t *)output)[2] = code[0];
-	((uint8_t *)output)[3] = code[1] >> 16;
-	((uint8_t *)output)[4] = code[1] >> 8;
-	((uint8_t *)output)[5] = code[1];
+		if (aptxhdbtenc_encodestereo(handle, pcm_l, pcm_r, code) != 0)
+			return -1;
 
-	*len = 6;
-	return 8;
+		out[0] = code[0] >> 16;
+		out[1] = code[0] >> 8;
+		out[2] = code[0];
+		out[3] = code[1] >> 16;
+		out[4] = code[1] >> 8;
+		out[5] = code[1];
+
+	}
 
 #endif
+
+	*len = out - (uint8_t *)output;
+	return blocks * 8;
 }
 #endif
 
@@ -211,3 +211,41 @@ fail:
 
 	return error == NULL;
 }
+
+/**
+ * Set a property of a given D-Bus interface asynchronously.
+ *
+ * @param conn D-Bus connection handler.
+ * @param service Valid D-Bus service name.
+ * @param path Valid D-Bus object path.
+ * @param interface Interface with the given property.
+ * @param property The property name.
+ * @param value Variant containing property value.
+ * @param callback Function called when the request is completed. In this
+ *   function one shall call g_dbus_set_property_finish().
+ * @param userdata Data passed to the callback function. */
+void g_dbus_set_property_async(GDBusConnection *conn, const char *service,
+		const char *path, const char *interface, const char *property,
+		const GVariant *value, GAsyncReadyCallback callback, void *userdata) {
+	g_dbus_connection_call(conn, service, path, DBUS_IFACE_PROPERTIES, "Set",
+			g_variant_new("(ssv)", interface, property, value), NULL,
+			G_DBUS_CALL_FLAGS_NONE, -1, NULL, callback, userdata);
+}
+
+/**
+ * Finish asynchronous D-Bus property set request.
+ *
+ * @param conn D-Bus connection handler.
+ * @param result Result passed to the g_dbus_set_property_async() callback.
+ * @param error NULL GError pointer.
+ * @return On success this function returns true. */
+bool g_dbus_set_property_finish(GDBusConnection *conn, GAsyncResult *result,
+		GError **error) {
+
+	GVariant *rv;
+	if ((rv = g_dbus_connection_call_finish(conn, result, error)) == NULL)
+		return false;
+
+	g_variant_unref(rv);
+	return true;
+}
@@ -47,5 +47,10 @@ GVariant *g_dbus_get_property(GDBusConnection *conn, const char *service,
 bool g_dbus_set_property(GDBusConnection *conn, const char *service,
 		const char *path, const char *interface, const char *property,
 		const GVariant *value, GError **error);
+void g_dbus_set_property_async(GDBusConnection *conn, const char *service,
+		const char *path, const char *interface, const char *property,
+		const GVariant *value, GAsyncReadyCallback callback, void *userdata);
+bool g_dbus_set_property_finish(GDBusConnection *conn, GAsyncResult *result,
+		GError **error);
 
 #endif
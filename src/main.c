@@ -12,6 +12,7 @@
 # include <config.h>
 #endif
 
+#include <errno.h>
 #include <getopt.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -97,10 +98,16 @@ int main(int argc, char **argv) {
 		{ "syslog", no_argument, NULL, 'S' },
 		{ "device", required_argument, NULL, 'i' },
 		{ "profile", required_argument, NULL, 'p' },
+		{ "hci-bitrate-limit", required_argument, NULL, 18 },
 		{ "a2dp-force-mono", no_argument, NULL, 6 },
 		{ "a2dp-force-audio-cd", no_argument, NULL, 7 },
 		{ "a2dp-keep-alive", required_argument, NULL, 8 },
+		{ "a2dp-keep-alive-silence", no_argument, NULL, 21 },
+		{ "a2dp-keep-pcm", no_argument, NULL, 20 },
+		{ "a2dp-sink-batch", required_argument, NULL, 22 },
+		{ "a2dp-sink-fixed-format", no_argument, NULL, 23 },
 		{ "a2dp-volume", no_argument, NULL, 9 },
+		{ "a2dp-capture", required_argument, NULL, 17 },
 		{ "sbc-quality", required_argument, NULL, 14 },
 #if ENABLE_AAC
 		{ "aac-afterburner", no_argument, NULL, 4 },
@@ -114,6 +121,9 @@ int main(int argc, char **argv) {
 #if ENABLE_MP3LAME
 		{ "mp3-quality", required_argument, NULL, 12 },
 		{ "mp3-vbr-quality", required_argument, NULL, 13 },
+#endif
+#if ENABLE_MSBC
+		{ "msbc-fixed-rate", no_argument, NULL, 19 },
 #endif
 		{ "xapl-resp-name", required_argument, NULL, 16 },
 		{ 0, 0, 0, 0 },
@@ -139,6 +149,10 @@ int main(int argc, char **argv) {
 
 	log_open(argv[0], syslog, BLUEALSA_LOGTIME);
 
+	/* Do not let the logging block IO threads. */
+	if (log_async_start() == -1)
+		warn("Couldn't start asynchronous logging: %s", strerror(errno));
+
 	if (bluealsa_config_init() != 0) {
 		error("Couldn't initialize bluealsa config");
 		return EXIT_FAILURE;
@@ -159,10 +173,16 @@ int main(int argc, char **argv) {
 					"  -S, --syslog\t\tsend output to syslog\n"
 					"  -i, --device=hciX\tHCI device(s) to use\n"
 					"  -p, --profile=NAME\tenable BT profile\n"
+					"  --hci-bitrate-limit=KBPS\tlimit HCI aggregate bitrate\n"
 					"  --a2dp-force-mono\tforce monophonic sound\n"
 					"  --a2dp-force-audio-cd\tforce 44.1 kHz sampling\n"
 					"  --a2dp-keep-alive=SEC\tkeep A2DP transport alive\n"
+					"  --a2dp-keep-alive-silence\tstream silence when kept alive\n"
+					"  --a2dp-keep-pcm\tkeep PCM open on codec change\n"
+					"  --a2dp-sink-batch=MSEC\tbatch A2DP sink wakeups\n"
+					"  --a2dp-sink-fixed-format\tuse S32 format for A2DP sink\n"
 					"  --a2dp-volume\t\tnative volume control by default\n"
+					"  --a2dp-capture=DIR\tcapture A2DP traffic to DIR\n"
 					"  --sbc-quality=NB\tset SBC encoder quality\n"
 #if ENABLE_AAC
 					"  --aac-afterburner\tenable FDK AAC afterburner\n"
@@ -176,6 +196,9 @@ int main(int argc, char **argv) {
 #if ENABLE_MP3LAME
 					"  --mp3-quality=NB\tselect LAME encoder algorithm\n"
 					"  --mp3-vbr-quality=NB\tset LAME encoder VBR quality\n"
+#endif
+#if ENABLE_MSBC
+					"  --msbc-fixed-rate\tkeep HFP PCM at 16 kHz for all codecs\n"
 #endif
 					"  --xapl-resp-name=NAME\tset product name used by XAPL\n"
 					"\nAvailable BT profiles:\n"
@@ -245,6 +268,10 @@ int main(int argc, char **argv) {
 			break;
 		}
 
+		case 18 /* --hci-bitrate-limit=KBPS */ :
+			config.hci_bitrate_limit = atoi(optarg) * 1000;
+			break;
+
 		case 6 /* --a2dp-force-mono */ :
 			config.a2dp.force_mono = true;
 			break;
@@ -254,9 +281,30 @@ int main(int argc, char **argv) {
 		case 8 /* --a2dp-keep-alive=SEC */ :
 			config.a2dp.keep_alive = atoi(optarg);
 			break;
+		case 21 /* --a2dp-keep-alive-silence */ :
+			config.a2dp.keep_alive_silence = true;
+			break;
+		case 20 /* --a2dp-keep-pcm */ :
+			config.a2dp.keep_pcm = true;
+			break;
+		case 22 /* --a2dp-sink-batch=MSEC */ : {
+			const int msec = atoi(optarg);
+			if (msec < 0 || msec > 500) {
+				error("Invalid sink batch period [0, 500]: %s", optarg);
+				return EXIT_FAILURE;
+			}
+			config.a2dp.sink_batch = msec;
+			break;
+		}
+		case 23 /* --a2dp-sink-fixed-format */ :
+			config.a2dp.sink_fixed_format = true;
+			break;
 		case 9 /* --a2dp-volume */ :
 			config.a2dp.volume = true;
 			break;
+		case 17 /* --a2dp-capture=DIR */ :
+			config.a2dp.capture_dir = optarg;
+			break;
 
 		case 14 /* --sbc-quality=NB */ :
 			config.sbc_quality = atoi(optarg);
@@ -320,6 +368,12 @@ int main(int argc, char **argv) {
 			break;
 #endif
 
+#if ENABLE_MSBC
+		case 19 /* --msbc-fixed-rate */ :
+			config.hfp.fixed_rate = true;
+			break;
+#endif
+
 		case 16 /* --xapl-resp-name=NAME */ :
 			config.hfp.xapl_product_name = optarg;
 			break;
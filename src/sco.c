@@ -25,6 +25,7 @@
 #include <bluetooth/sco.h>
 
 #include "a2dp-audio.h"
+#include "audio.h"
 #include "ba-device.h"
 #include "bluealsa.h"
 #include "codec-msbc.h"
@@ -35,6 +36,7 @@
 #include "shared/ffb.h"
 #include "shared/log.h"
 #include "shared/rt.h"
+#include "shared/trace.h"
 
 /**
  * SCO dispatcher internal data. */
@@ -219,18 +221,38 @@ void *sco_thread(struct ba_transport_thread *th) {
 	struct esco_msbc msbc_dec = { .initialized = false };
 	pthread_cleanup_push(PTHREAD_CLEANUP(msbc_finish), &msbc_enc);
 	pthread_cleanup_push(PTHREAD_CLEANUP(msbc_finish), &msbc_dec);
-	bool initialize_msbc = true;
 #endif
 
+	/* buffers for CVSD resampling in the fixed rate mode */
+	ffb_t rs_spk = { 0 };
+	ffb_t rs_mic = { 0 };
+	int16_t rs_mic_last = 0;
+	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &rs_spk);
+	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &rs_mic);
+
 	/* these buffers shall be bigger than the SCO MTU */
 	if (ffb_init_uint8_t(&bt_in, 128) == -1 ||
-			ffb_init_uint8_t(&bt_out, 128) == -1) {
+			ffb_init_uint8_t(&bt_out, 128) == -1 ||
+			ffb_init_int16_t(&rs_spk, 128) == -1 ||
+			ffb_init_int16_t(&rs_mic, 128) == -1) {
 		error("Couldn't create data buffer: %s", strerror(errno));
 		goto fail_ffb;
 	}
 
 	int poll_timeout = -1;
 	struct ba_transport *t = th->t;
+
+#if ENABLE_MSBC
+	/* Prepare mSBC codec ahead of time, so the codec switching
+	 * will not require any memory allocation in the IO loop. */
+	if (t->type.profile & BA_TRANSPORT_PROFILE_MASK_HFP &&
+			(msbc_init(&msbc_enc) != 0 || msbc_init(&msbc_dec) != 0)) {
+		error("Couldn't initialize mSBC codec: %s", strerror(errno));
+		goto fail_ffb;
+	}
+#endif
+
+	uint16_t codec_prev = t->type.codec;
 	struct asrsync asrs = { .frames = 0 };
 	struct pollfd pfds[] = {
 		{ th->pipe[0], POLLIN, 0 },
@@ -247,20 +269,36 @@ void *sco_thread(struct ba_transport_thread *th) {
 
 		/* prevent an unexpected change of the codec value */
 		const uint16_t codec = t->type.codec;
-
-		/* fresh-start for file descriptors polling */
-		pfds[1].fd = pfds[2].fd = -1;
-		pfds[3].fd = pfds[4].fd = -1;
-
+		/* CVSD resampling when PCM is configured for the mSBC rate */
+		const bool resample = codec != HFP_CODEC_MSBC &&
+			t->sco.spk_pcm.sampling == 16000;
+
+		/* Codec has been changed - switch at the frame boundary. Data buffered
+		 * for the previous codec is dropped (there is no SCO link during the
+		 * codec selection anyway) and the transfer pacing is restarted. */
+		if (codec != codec_prev) {
+			debug("Switching SCO codec: %#x -> %#x", codec_prev, codec);
+			codec_prev = codec;
+			ffb_rewind(&bt_in);
+			ffb_rewind(&bt_out);
+			ffb_rewind(&rs_spk);
+			ffb_rewind(&rs_mic);
+			rs_mic_last = 0;
 #if ENABLE_MSBC
-		if (initialize_msbc && codec == HFP_CODEC_MSBC) {
-			initialize_msbc = false;
-			if (msbc_init(&msbc_enc) != 0 || msbc_init(&msbc_dec) != 0) {
-				error("Couldn't initialize mSBC codec: %s", strerror(errno));
+			/* Codec is already prepared, so this is a mere state reset,
+			 * which does not allocate any memory. */
+			if (codec == HFP_CODEC_MSBC &&
+					(msbc_init(&msbc_enc) != 0 || msbc_init(&msbc_dec) != 0)) {
+				error("Couldn't reset mSBC codec: %s", strerror(errno));
 				goto fail;
 			}
-		}
 #endif
+			asrs.frames = 0;
+		}
+
+		/* fresh-start for file descriptors polling */
+		pfds[1].fd = pfds[2].fd = -1;
+		pfds[3].fd = pfds[4].fd = -1;
 
 		switch (codec) {
 		case HFP_CODEC_CVSD:
@@ -271,11 +309,19 @@ void *sco_thread(struct ba_transport_thread *th) {
 				pfds[2].fd = t->bt_fd;
 			if (t->bt_fd != -1 && ffb_len_in(&bt_out) >= t->mtu_write)
 				pfds[3].fd = t->sco.spk_pcm.fd;
-			if (ffb_len_out(&bt_in) > 0)
+			if (ffb_len_out(&bt_in) > 0 || ffb_len_out(&rs_mic) > 0)
 				pfds[4].fd = t->sco.mic_pcm.fd;
 			break;
 #if ENABLE_MSBC
 		case HFP_CODEC_MSBC:
+			/* If SCO is not opened or PCM is not connected,
+			 * reset mSBC encoder/decoder state. */
+			if (((t->sco.spk_pcm.fd == -1 && t->sco.mic_pcm.fd == -1) ||
+						t->bt_fd == -1) &&
+					(msbc_init(&msbc_enc) != 0 || msbc_init(&msbc_dec) != 0)) {
+				error("Couldn't reset mSBC codec: %s", strerror(errno));
+				goto fail;
+			}
 			if (msbc_encode(&msbc_enc) == -1)
 				warn("Couldn't encode mSBC: %s", strerror(errno));
 			if (msbc_decode(&msbc_dec) == -1)
@@ -288,11 +334,6 @@ void *sco_thread(struct ba_transport_thread *th) {
 				pfds[3].fd = t->sco.spk_pcm.fd;
 			if (ffb_blen_out(&msbc_dec.pcm) > 0)
 				pfds[4].fd = t->sco.mic_pcm.fd;
-			/* If SCO is not opened or PCM is not connected,
-			 * mark mSBC encoder/decoder for reinitialization. */
-			if ((t->sco.spk_pcm.fd == -1 && t->sco.mic_pcm.fd == -1) ||
-					t->bt_fd == -1)
-				initialize_msbc = true;
 			break;
 #endif
 		}
@@ -301,7 +342,7 @@ void *sco_thread(struct ba_transport_thread *th) {
 
 		switch (poll(pfds, ARRAYSIZE(pfds), poll_timeout)) {
 		case 0:
-			pthread_cond_signal(&t->sco.spk_pcm.synced);
+			ba_transport_pcm_drain_synced(&t->sco.spk_pcm);
 			poll_timeout = -1;
 			continue;
 		case -1:
@@ -340,7 +381,7 @@ void *sco_thread(struct ba_transport_thread *th) {
 				 *      data from the microphone (BT SCO socket). In order not to hang
 				 *      forever in the transport_drain_pcm() function, we will signal
 				 *      PCM drain right now. */
-				pthread_cond_signal(&t->sco.spk_pcm.synced);
+				ba_transport_pcm_drain_synced(&t->sco.spk_pcm);
 				break;
 			case BA_TRANSPORT_SIGNAL_PCM_DROP:
 				ba_transport_pcm_flush(&t->sco.spk_pcm);
@@ -350,8 +391,9 @@ void *sco_thread(struct ba_transport_thread *th) {
 			}
 		}
 
+		/* transfer pacing is driven by the codec sampling rate */
 		if (asrs.frames == 0)
-			asrsync_init(&asrs, t->sco.spk_pcm.sampling);
+			asrsync_init(&asrs, codec == HFP_CODEC_MSBC ? 16000 : 8000);
 
 		if (pfds[1].revents & POLLIN) {
 			/* dispatch incoming SCO data */
@@ -363,8 +405,10 @@ void *sco_thread(struct ba_transport_thread *th) {
 			switch (codec) {
 			case HFP_CODEC_CVSD:
 			default:
-				if (t->sco.mic_pcm.fd == -1)
+				if (t->sco.mic_pcm.fd == -1) {
 					ffb_rewind(&bt_in);
+					ffb_rewind(&rs_mic);
+				}
 				buffer = bt_in.tail;
 				buffer_len = ffb_len_in(&bt_in);
 				break;
@@ -392,6 +436,10 @@ retry_sco_read:
 					continue;
 				}
 
+			trace2(sco_read, pfds[1].fd, len);
+			t->stats.bt_rx_bytes += len;
+			ba_transport_stats_update(t);
+
 			/* If microphone (capture) PCM is not connected ignore incoming data. In
 			 * the worst case scenario, we might lose few milliseconds of data (one
 			 * mSBC frame which is 7.5 ms), but we will be sure, that the microphone
@@ -452,6 +500,10 @@ retry_sco_write:
 					continue;
 				}
 
+			trace2(sco_write, pfds[2].fd, len);
+			t->stats.bt_tx_bytes += len;
+			ba_transport_stats_update(t);
+
 			switch (codec) {
 			case HFP_CODEC_CVSD:
 			default:
@@ -475,6 +527,15 @@ retry_sco_write:
 			switch (codec) {
 			case HFP_CODEC_CVSD:
 			default:
+				if (resample) {
+					/* read up to the number of samples which fits into the SCO
+					 * buffer after decimation, including carried-over sample */
+					buffer = rs_spk.tail;
+					samples = ffb_len_in(&bt_out) / sizeof(int16_t) * 2 - ffb_len_out(&rs_spk);
+					if ((size_t)samples > ffb_len_in(&rs_spk))
+						samples = ffb_len_in(&rs_spk);
+					break;
+				}
 				buffer = (int16_t *)bt_out.tail;
 				samples = ffb_len_in(&bt_out) / sizeof(int16_t);
 				break;
@@ -494,9 +555,20 @@ retry_sco_write:
 				continue;
 			}
 
+			trace2(pcm_read, t->sco.spk_pcm.fd, samples);
+
 			switch (codec) {
 			case HFP_CODEC_CVSD:
 			default:
+				if (resample) {
+					ffb_seek(&rs_spk, samples);
+					/* odd sample (if any) is kept for the next read */
+					const size_t frames = ffb_len_out(&rs_spk) / 2;
+					audio_downsample_2x_s16_2le(bt_out.tail, rs_spk.data, frames);
+					ffb_seek(&bt_out, frames * sizeof(int16_t));
+					ffb_shift(&rs_spk, frames * 2);
+					break;
+				}
 				ffb_seek(&bt_out, samples * sizeof(int16_t));
 				break;
 #if ENABLE_MSBC
@@ -522,6 +594,17 @@ retry_sco_write:
 			switch (codec) {
 			case HFP_CODEC_CVSD:
 			default:
+				if (resample) {
+					size_t frames = ffb_len_out(&bt_in) / sizeof(int16_t);
+					if (frames > ffb_len_in(&rs_mic) / 2)
+						frames = ffb_len_in(&rs_mic) / 2;
+					audio_upsample_2x_s16_2le(rs_mic.tail, (int16_t *)bt_in.data, frames, &rs_mic_last);
+					ffb_seek(&rs_mic, frames * 2);
+					ffb_shift(&bt_in, frames * sizeof(int16_t));
+					buffer = rs_mic.data;
+					samples = ffb_len_out(&rs_mic);
+					break;
+				}
 				buffer = (int16_t *)bt_in.data;
 				samples = ffb_len_out(&bt_in) / sizeof(int16_t);
 				break;
@@ -543,6 +626,10 @@ retry_sco_write:
 			switch (codec) {
 			case HFP_CODEC_CVSD:
 			default:
+				if (resample) {
+					ffb_shift(&rs_mic, samples);
+					break;
+				}
 				ffb_shift(&bt_in, samples * sizeof(int16_t));
 				break;
 #if ENABLE_MSBC
@@ -579,6 +666,8 @@ fail:
 	debug_transport_thread_loop(th, "EXIT");
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 fail_ffb:
+	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
 #if ENABLE_MSBC
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
@@ -381,6 +381,66 @@ dbus_bool_t bluealsa_dbus_open_pcm(
 	return rv;
 }
 
+/**
+ * Open BlueALSA PCM stream with the given PCM format.
+ *
+ * The format may differ from the one reported by the PCM object, e.g. A2DP
+ * source PCM with the S16_LE format accepts higher resolution formats. */
+dbus_bool_t bluealsa_dbus_open_pcm_format(
+		struct ba_dbus_ctx *ctx,
+		const char *pcm_path,
+		dbus_uint16_t format,
+		int *fd_pcm,
+		int *fd_pcm_ctrl,
+		DBusError *error) {
+
+	static const char *option = "Format";
+	DBusMessage *msg;
+
+	if ((msg = dbus_message_new_method_call(ctx->ba_service, pcm_path,
+					BLUEALSA_INTERFACE_PCM, "OpenWithOptions")) == NULL)
+		goto fail;
+
+	DBusMessageIter iter;
+	DBusMessageIter iter_dict;
+	DBusMessageIter iter_entry;
+	DBusMessageIter iter_val;
+
+	dbus_message_iter_init_append(msg, &iter);
+	if (!dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sv}", &iter_dict) ||
+			!dbus_message_iter_open_container(&iter_dict, DBUS_TYPE_DICT_ENTRY, NULL, &iter_entry) ||
+			!dbus_message_iter_append_basic(&iter_entry, DBUS_TYPE_STRING, &option) ||
+			!dbus_message_iter_open_container(&iter_entry, DBUS_TYPE_VARIANT, "q", &iter_val) ||
+			!dbus_message_iter_append_basic(&iter_val, DBUS_TYPE_UINT16, &format) ||
+			!dbus_message_iter_close_container(&iter_entry, &iter_val) ||
+			!dbus_message_iter_close_container(&iter_dict, &iter_entry) ||
+			!dbus_message_iter_close_container(&iter, &iter_dict))
+		goto fail;
+
+	DBusMessage *rep;
+	if ((rep = dbus_connection_send_with_reply_and_block(ctx->conn,
+					msg, DBUS_TIMEOUT_USE_DEFAULT, error)) == NULL) {
+		dbus_message_unref(msg);
+		return FALSE;
+	}
+
+	dbus_bool_t rv;
+	rv = dbus_message_get_args(rep, error,
+			DBUS_TYPE_UNIX_FD, fd_pcm,
+			DBUS_TYPE_UNIX_FD, fd_pcm_ctrl,
+			DBUS_TYPE_INVALID);
+
+	dbus_message_unref(rep);
+	dbus_message_unref(msg);
+	return rv;
+
+fail:
+	if (msg != NULL)
+		dbus_message_unref(msg);
+	dbus_set_error(error, DBUS_ERROR_NO_MEMORY, NULL);
+	return FALSE;
+}
+
 /**
  * Open BlueALSA RFCOMM socket for dispatching AT commands. */
 dbus_bool_t bluealsa_dbus_open_rfcomm(
@@ -471,6 +531,227 @@ fail:
 	return FALSE;
 }
 
+/**
+ * Callback function for BlueALSA PCM statistics parser. */
+static dbus_bool_t bluealsa_dbus_pcm_get_stats_cb(const char *key,
+		DBusMessageIter *variant, void *userdata, DBusError *error) {
+	struct ba_pcm_stats *stats = (struct ba_pcm_stats *)userdata;
+
+	char type = dbus_message_iter_get_arg_type(variant);
+	char type_expected;
+
+	if (strcmp(key, "ReceivedBytes") == 0) {
+		if (type != (type_expected = DBUS_TYPE_UINT64))
+			goto fail;
+		dbus_message_iter_get_basic(variant, &stats->rx_bytes);
+	}
+	else if (strcmp(key, "TransmittedBytes") == 0) {
+		if (type != (type_expected = DBUS_TYPE_UINT64))
+			goto fail;
+		dbus_message_iter_get_basic(variant, &stats->tx_bytes);
+	}
+	else if (strcmp(key, "QueuedBytes") == 0) {
+		if (type != (type_expected = DBUS_TYPE_UINT32))
+			goto fail;
+		dbus_message_iter_get_basic(variant, &stats->queued_bytes);
+	}
+	else if (strcmp(key, "LostPackets") == 0) {
+		if (type != (type_expected = DBUS_TYPE_UINT32))
+			goto fail;
+		dbus_message_iter_get_basic(variant, &stats->lost_packets);
+	}
+	else if (strcmp(key, "CPUTime") == 0) {
+		if (type != (type_expected = DBUS_TYPE_UINT64))
+			goto fail;
+		dbus_message_iter_get_basic(variant, &stats->cpu_time);
+	}
+	else if (strcmp(key, "Frames") == 0) {
+		if (type != (type_expected = DBUS_TYPE_UINT64))
+			goto fail;
+		dbus_message_iter_get_basic(variant, &stats->frames);
+	}
+	else if (strcmp(key, "Underruns") == 0) {
+		if (type != (type_expected = DBUS_TYPE_UINT32))
+			goto fail;
+		dbus_message_iter_get_basic(variant, &stats->underruns);
+	}
+
+	return TRUE;
+
+fail:
+	dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE,
+			"Incorrect variant for '%s': %c != %c", key, type, type_expected);
+	return FALSE;
+}
+
+/**
+ * Get BlueALSA PCM transport statistics. */
+dbus_bool_t bluealsa_dbus_pcm_get_stats(
+		struct ba_dbus_ctx *ctx,
+		const char *pcm_path,
+		struct ba_pcm_stats *stats,
+		DBusError *error) {
+
+	DBusMessage *msg;
+	if ((msg = dbus_message_new_method_call(ctx->ba_service, pcm_path,
+					BLUEALSA_INTERFACE_PCM, "GetStatistics")) == NULL) {
+		dbus_set_error(error, DBUS_ERROR_NO_MEMORY, NULL);
+		return FALSE;
+	}
+
+	dbus_bool_t rv = FALSE;
+
+	DBusMessage *rep;
+	if ((rep = dbus_connection_send_with_reply_and_block(ctx->conn,
+					msg, DBUS_TIMEOUT_USE_DEFAULT, error)) == NULL)
+		goto final;
+
+	DBusMessageIter iter;
+	if (!dbus_message_iter_init(rep, &iter)) {
+		dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE, "Empty response message");
+		goto final;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	rv = bluealsa_dbus_message_iter_dict(&iter, error,
+			bluealsa_dbus_pcm_get_stats_cb, stats);
+
+final:
+	if (rep != NULL)
+		dbus_message_unref(rep);
+	dbus_message_unref(msg);
+	return rv;
+}
+
+/**
+ * Callback function for BlueALSA adapter properties parser. */
+static dbus_bool_t bluealsa_dbus_get_adapters_cb(const char *key,
+		DBusMessageIter *variant, void *userdata, DBusError *error) {
+	struct ba_hci *hci = (struct ba_hci *)userdata;
+
+	char type = dbus_message_iter_get_arg_type(variant);
+	char type_expected;
+	const char *tmp;
+
+	if (strcmp(key, "Name") == 0) {
+		if (type != (type_expected = DBUS_TYPE_STRING))
+			goto fail;
+		dbus_message_iter_get_basic(variant, &tmp);
+		strncpy(hci->name, tmp, sizeof(hci->name) - 1);
+	}
+	else if (strcmp(key, "Bitrate") == 0) {
+		if (type != (type_expected = DBUS_TYPE_UINT32))
+			goto fail;
+		dbus_message_iter_get_basic(variant, &hci->bitrate);
+	}
+	else if (strcmp(key, "BitrateLimit") == 0) {
+		if (type != (type_expected = DBUS_TYPE_UINT32))
+			goto fail;
+		dbus_message_iter_get_basic(variant, &hci->bitrate_limit);
+	}
+
+	return TRUE;
+
+fail:
+	dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE,
+			"Incorrect variant for '%s': %c != %c", key, type, type_expected);
+	return FALSE;
+}
+
+/**
+ * Get BlueALSA HCI adapters. */
+dbus_bool_t bluealsa_dbus_get_adapters(
+		struct ba_dbus_ctx *ctx,
+		struct ba_hci **hcis,
+		size_t *length,
+		DBusError *error) {
+
+	DBusMessage *msg;
+	if ((msg = dbus_message_new_method_call(ctx->ba_service, "/org/bluealsa",
+					BLUEALSA_INTERFACE_MANAGER, "GetAdapters")) == NULL) {
+		dbus_set_error(error, DBUS_ERROR_NO_MEMORY, NULL);
+		return FALSE;
+	}
+
+	dbus_bool_t rv = TRUE;
+	struct ba_hci *_hcis = NULL;
+	char *signature;
+	size_t i;
+
+	DBusMessage *rep;
+	if ((rep = dbus_connection_send_with_reply_and_block(ctx->conn,
+					msg, DBUS_TIMEOUT_USE_DEFAULT, error)) == NULL)
+		goto fail;
+
+	DBusMessageIter iter;
+	if (!dbus_message_iter_init(rep, &iter)) {
+		dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE, "Empty response message");
+		goto fail;
+	}
+
+	DBusMessageIter iter_hcis;
+	for (dbus_message_iter_recurse(&iter, &iter_hcis), i = 0;
+			dbus_message_iter_get_arg_type(&iter_hcis) != DBUS_TYPE_INVALID;
+			dbus_message_iter_next(&iter_hcis), i++) {
+
+		if (dbus_message_iter_get_arg_type(&iter_hcis) != DBUS_TYPE_DICT_ENTRY)
+			goto fail_signature;
+
+		struct ba_hci *tmp = _hcis;
+		if ((tmp = realloc(tmp, (i + 1) * sizeof(*tmp))) == NULL) {
+			dbus_set_error(error, DBUS_ERROR_NO_MEMORY, NULL);
+			goto fail;
+		}
+
+		_hcis = tmp;
+		memset(&_hcis[i], 0, sizeof(*_hcis));
+
+		DBusMessageIter iter_hcis_entry;
+		dbus_message_iter_recurse(&iter_hcis, &iter_hcis_entry);
+
+		if (dbus_message_iter_get_arg_type(&iter_hcis_entry) != DBUS_TYPE_OBJECT_PATH)
+			goto fail_signature;
+
+		const char *path;
+		dbus_message_iter_get_basic(&iter_hcis_entry, &path);
+		strncpy(_hcis[i].hci_path, path, sizeof(_hcis[i].hci_path) - 1);
+
+		if (!dbus_message_iter_next(&iter_hcis_entry))
+			goto fail_signature;
+
+		DBusError err = DBUS_ERROR_INIT;
+		if (!bluealsa_dbus_message_iter_dict(&iter_hcis_entry, &err,
+					bluealsa_dbus_get_adapters_cb, &_hcis[i])) {
+			dbus_set_error(error, err.name, "Get properties: %s", err.message);
+			dbus_error_free(&err);
+			goto fail;
+		}
+
+	}
+
+	*hcis = _hcis;
+	*length = i;
+
+	goto success;
+
+fail_signature:
+	signature = dbus_message_iter_get_signature(&iter);
+	dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE,
+			"Incorrect signature: %s != a{oa{sv}}", signature);
+	dbus_free(signature);
+
+fail:
+	if (_hcis != NULL)
+		free(_hcis);
+	rv = FALSE;
+
+success:
+	if (rep != NULL)
+		dbus_message_unref(rep);
+	dbus_message_unref(msg);
+	return rv;
+}
+
 /**
  * Send command to the BlueALSA PCM controller socket. */
 dbus_bool_t bluealsa_dbus_pcm_ctrl_send(
@@ -66,6 +66,38 @@ enum ba_pcm_property {
 	BLUEALSA_PCM_VOLUME,
 };
 
+/**
+ * BlueALSA PCM transport statistics. */
+struct ba_pcm_stats {
+	/* number of bytes read from the BT socket */
+	dbus_uint64_t rx_bytes;
+	/* number of bytes written to the BT socket */
+	dbus_uint64_t tx_bytes;
+	/* number of bytes queued in the BT socket */
+	dbus_uint32_t queued_bytes;
+	/* number of lost RTP packets */
+	dbus_uint32_t lost_packets;
+	/* CPU time (ns) consumed by IO threads */
+	dbus_uint64_t cpu_time;
+	/* number of transferred PCM frames */
+	dbus_uint64_t frames;
+	/* number of PCM underruns */
+	dbus_uint32_t underruns;
+};
+
+/**
+ * BlueALSA HCI adapter. */
+struct ba_hci {
+	/* BlueALSA D-Bus adapter path */
+	char hci_path[64];
+	/* HCI device name */
+	char name[16];
+	/* aggregate BT bitrate of all transports */
+	dbus_uint32_t bitrate;
+	/* bitrate limit (zero if unlimited) */
+	dbus_uint32_t bitrate_limit;
+};
+
 /**
  * BlueALSA PCM object. */
 struct ba_pcm {
@@ -162,6 +194,14 @@ dbus_bool_t bluealsa_dbus_open_pcm(
 		int *fd_pcm_ctrl,
 		DBusError *error);
 
+dbus_bool_t bluealsa_dbus_open_pcm_format(
+		struct ba_dbus_ctx *ctx,
+		const char *pcm_path,
+		dbus_uint16_t format,
+		int *fd_pcm,
+		int *fd_pcm_ctrl,
+		DBusError *error);
+
 dbus_bool_t bluealsa_dbus_open_rfcomm(
 		struct ba_dbus_ctx *ctx,
 		const char *rfcomm_path,
@@ -174,6 +214,18 @@ dbus_bool_t bluealsa_dbus_pcm_update(
 		enum ba_pcm_property property,
 		DBusError *error);
 
+dbus_bool_t bluealsa_dbus_pcm_get_stats(
+		struct ba_dbus_ctx *ctx,
+		const char *pcm_path,
+		struct ba_pcm_stats *stats,
+		DBusError *error);
+
+dbus_bool_t bluealsa_dbus_get_adapters(
+		struct ba_dbus_ctx *ctx,
+		struct ba_hci **hcis,
+		size_t *length,
+		DBusError *error);
+
 dbus_bool_t bluealsa_dbus_pcm_ctrl_send(
 		int fd_pcm_ctrl,
 		const char *command,
@@ -10,12 +10,16 @@
 
 #include "shared/ffb.h"
 
-#include <stdlib.h>
 #include <string.h>
 
+#include "shared/mempool.h"
+
 /**
  * Allocate/reallocate resources for the FIFO-like buffer.
  *
+ * Buffers are allocated from the memory pool, so IO threads which are
+ * restarted upon every transport acquisition will recycle memory.
+ *
  * @param ffb Pointer to the buffer structure.
  * @param nmemb Number of elements in the buffer.
  * @param size The size of the element.
@@ -23,7 +27,7 @@
 int ffb_init(ffb_t *ffb, size_t nmemb, size_t size) {
 
 	void *ptr;
-	if ((ptr = realloc(ffb->data, nmemb * size)) == NULL)
+	if ((ptr = mempool_realloc(ffb->data, nmemb * size)) == NULL)
 		return -1;
 
 	ffb->data = ffb->tail = ptr;
@@ -40,7 +44,7 @@ int ffb_init(ffb_t *ffb, size_t nmemb, size_t size) {
 void ffb_free(ffb_t *ffb) {
 	if (ffb->data == NULL)
 		return;
-	free(ffb->data);
+	mempool_free(ffb->data);
 	ffb->data = NULL;
 }
 
@@ -10,14 +10,21 @@
 
 #include "shared/log.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <syslog.h>
 #include <time.h>
+#include <unistd.h>
 
 #if WITH_LIBUNWIND
 # define UNW_LOCAL_ONLY
@@ -36,6 +43,72 @@ static bool _syslog = false;
 /* if true, print logging time */
 static bool _time = BLUEALSA_LOGTIME;
 
+/* Number of entries in the per-thread log ring. It has to be a power of
+ * two, so the ring index can be calculated with a simple bit mask. */
+#define LOG_RING_SIZE 64
+/* maximal length of the asynchronously logged message */
+#define LOG_MESSAGE_SIZE 512
+/* maximal number of messages emitted within one second */
+#define LOG_RATE_LIMIT 100
+
+struct log_entry {
+	struct timespec ts;
+	int priority;
+	char message[LOG_MESSAGE_SIZE];
+};
+
+/**
+ * Single-producer single-consumer log ring.
+ *
+ * Every thread which logs a message gets its own ring, so the producer
+ * side does not need any locking. Rings are never freed - when a thread
+ * terminates, its ring is marked as unused and might be taken over by
+ * another thread. */
+struct log_ring {
+	struct log_ring *next;
+	atomic_flag used;
+	/* index of the next entry to write (producer) */
+	atomic_uint head;
+	/* index of the next entry to read (consumer) */
+	atomic_uint tail;
+	/* messages dropped due to ring overflow */
+	atomic_uint dropped;
+	struct log_entry entries[LOG_RING_SIZE];
+};
+
+static struct {
+
+	/* if true, logging is performed by the drain thread */
+	atomic_bool enabled;
+	pthread_t thread;
+	/* wake-up notification for the drain thread */
+	int event_fd;
+
+	/* list of all allocated rings */
+	_Atomic(struct log_ring *) rings;
+	pthread_mutex_t rings_mtx;
+	pthread_key_t ring_key;
+
+	/* serialize draining (drain thread and flush) */
+	pthread_mutex_t drain_mtx;
+
+	/* deduplication state */
+	struct log_entry last;
+	unsigned int last_repeated;
+
+	/* rate limiting state */
+	time_t rate_sec;
+	unsigned int rate_count;
+	unsigned int rate_suppressed;
+
+} _async = {
+	.event_fd = -1,
+	.rings_mtx = PTHREAD_MUTEX_INITIALIZER,
+	.drain_mtx = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static __thread struct log_ring *_ring = NULL;
+
 void log_open(const char *ident, bool syslog, bool time) {
 
 	free(_ident);
@@ -48,18 +121,317 @@ void log_open(const char *ident, bool syslog, bool time) {
 
 }
 
-static void vlog(int priority, const char *format, va_list ap) {
+static const char *priority2str[] = {
+	[LOG_EMERG] = "X",
+	[LOG_ALERT] = "A",
+	[LOG_CRIT] = "C",
+	[LOG_ERR] = "E",
+	[LOG_WARNING] = "W",
+	[LOG_NOTICE] = "N",
+	[LOG_INFO] = "I",
+	[LOG_DEBUG] = "D",
+};
+
+/**
+ * Write formatted message to the log sinks. */
+static void log_emit(int priority, const struct timespec *ts, const char *message) {
+
+	if (_syslog)
+		syslog(priority, "%s", message);
+
+	flockfile(stderr);
+
+	if (_ident != NULL)
+		fprintf(stderr, "%s: ", _ident);
+	if (_time)
+		fprintf(stderr, "%lu.%.9lu: ", (long int)ts->tv_sec, ts->tv_nsec);
+	fprintf(stderr, "%s: %s\n", priority2str[priority], message);
+
+	funlockfile(stderr);
+
+}
+
+/**
+ * Emit pending deduplication summary, if any. */
+static void log_emit_repeated(void) {
+
+	if (_async.last_repeated == 0)
+		return;
+
+	char message[LOG_MESSAGE_SIZE + 64];
+	snprintf(message, sizeof(message), "%s (last message repeated %u times)",
+			_async.last.message, _async.last_repeated);
+	log_emit(_async.last.priority, &_async.last.ts, message);
+
+	_async.last_repeated = 0;
+
+}
+
+/**
+ * Apply deduplication and rate limiting to the given entry. */
+static void log_process_entry(const struct log_entry *e) {
+
+	if (e->priority == _async.last.priority &&
+			strcmp(e->message, _async.last.message) == 0) {
+		_async.last.ts = e->ts;
+		_async.last_repeated++;
+		return;
+	}
+
+	log_emit_repeated();
+	_async.last = *e;
+
+	if (e->ts.tv_sec != _async.rate_sec) {
+		if (_async.rate_suppressed > 0) {
+			char message[64];
+			snprintf(message, sizeof(message), "Suppressed %u log messages (rate limit)",
+					_async.rate_suppressed);
+			log_emit(LOG_WARNING, &e->ts, message);
+		}
+		_async.rate_sec = e->ts.tv_sec;
+		_async.rate_suppressed = 0;
+		_async.rate_count = 0;
+	}
+
+	if (++_async.rate_count > LOG_RATE_LIMIT) {
+		_async.rate_suppressed++;
+		return;
+	}
+
+	log_emit(e->priority, &e->ts, e->message);
+
+}
+
+/**
+ * Drain all log rings.
+ *
+ * The caller has to hold the drain lock.
+ *
+ * Entries from different rings are merged according to their time-stamps,
+ * so the output preserves the chronological order of logged messages.
+ *
+ * @param flush_repeated If true, emit pending deduplication summary.
+ * @return This function returns true if there is a pending deduplication
+ *   summary which was not emitted yet. */
+static bool log_drain_locked(bool flush_repeated) {
+
+	struct log_ring *r;
+	for (r = atomic_load(&_async.rings); r != NULL; r = r->next) {
+		unsigned int dropped;
+		if ((dropped = atomic_exchange(&r->dropped, 0)) > 0) {
+			char message[64];
+			struct timespec ts;
+			gettimestamp(&ts);
+			snprintf(message, sizeof(message), "Dropped %u log messages (buffer overflow)", dropped);
+			log_emit(LOG_WARNING, &ts, message);
+		}
+	}
+
+	for (;;) {
+
+		struct log_ring *oldest = NULL;
+		const struct log_entry *e = NULL;
+
+		for (r = atomic_load(&_async.rings); r != NULL; r = r->next) {
+			unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+			if (tail == atomic_load_explicit(&r->head, memory_order_acquire))
+				continue;
+			const struct log_entry *tmp = &r->entries[tail % LOG_RING_SIZE];
+			if (e == NULL || tmp->ts.tv_sec < e->ts.tv_sec ||
+					(tmp->ts.tv_sec == e->ts.tv_sec && tmp->ts.tv_nsec < e->ts.tv_nsec)) {
+				oldest = r;
+				e = tmp;
+			}
+		}
+
+		if (oldest == NULL)
+			break;
+
+		log_process_entry(e);
+		atomic_fetch_add_explicit(&oldest->tail, 1, memory_order_release);
+
+	}
+
+	if (flush_repeated)
+		log_emit_repeated();
+
+	return _async.last_repeated > 0;
+}
+
+/**
+ * Drain all log rings - serialized version of log_drain_locked(). */
+static bool log_drain(bool flush_repeated) {
+	pthread_mutex_lock(&_async.drain_mtx);
+	const bool repeated = log_drain_locked(flush_repeated);
+	pthread_mutex_unlock(&_async.drain_mtx);
+	return repeated;
+}
+
+static void *log_drain_thread(void *arg) {
+	(void)arg;
+
+	struct pollfd pfd = { _async.event_fd, POLLIN, 0 };
+	bool repeated = false;
+	eventfd_t value;
 
-	static const char *priority2str[] = {
-		[LOG_EMERG] = "X",
-		[LOG_ALERT] = "A",
-		[LOG_CRIT] = "C",
-		[LOG_ERR] = "E",
-		[LOG_WARNING] = "W",
-		[LOG_NOTICE] = "N",
-		[LOG_INFO] = "I",
-		[LOG_DEBUG] = "D",
-	};
+	for (;;) {
+
+		/* If there is a pending deduplication summary, emit it after one
+		 * second of silence, so it will not be held back indefinitely. */
+		int rv = poll(&pfd, 1, repeated ? 1000 : -1);
+		if (rv == -1 && errno != EINTR)
+			break;
+		if (rv > 0)
+			eventfd_read(_async.event_fd, &value);
+
+		repeated = log_drain(rv == 0);
+
+	}
+
+	return NULL;
+}
+
+static void log_ring_release(void *ring) {
+	atomic_flag_clear(&((struct log_ring *)ring)->used);
+}
+
+/**
+ * Get log ring for the calling thread. */
+static struct log_ring *log_ring_get(void) {
+
+	if (_ring != NULL)
+		return _ring;
+
+	struct log_ring *r;
+	for (r = atomic_load(&_async.rings); r != NULL; r = r->next)
+		if (!atomic_flag_test_and_set(&r->used))
+			goto final;
+
+	if ((r = calloc(1, sizeof(*r))) == NULL)
+		return NULL;
+
+	atomic_flag_test_and_set(&r->used);
+
+	pthread_mutex_lock(&_async.rings_mtx);
+	r->next = atomic_load(&_async.rings);
+	atomic_store(&_async.rings, r);
+	pthread_mutex_unlock(&_async.rings_mtx);
+
+final:
+	pthread_setspecific(_async.ring_key, r);
+	return _ring = r;
+}
+
+/**
+ * Put formatted message into the calling thread's log ring.
+ *
+ * This function never blocks. If the ring is full, the message is dropped
+ * and the drop counter is incremented.
+ *
+ * @return On success this function returns true. If the ring could not
+ *   be obtained, false is returned. */
+static bool log_ring_push(int priority, const char *format, va_list ap) {
+
+	struct log_ring *r;
+	if ((r = log_ring_get()) == NULL)
+		return false;
+
+	unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	if (head - atomic_load_explicit(&r->tail, memory_order_acquire) == LOG_RING_SIZE) {
+		atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+		return true;
+	}
+
+	struct log_entry *e = &r->entries[head % LOG_RING_SIZE];
+	gettimestamp(&e->ts);
+	e->priority = priority;
+	vsnprintf(e->message, sizeof(e->message), format, ap);
+
+	atomic_store_explicit(&r->head, head + 1, memory_order_release);
+	eventfd_write(_async.event_fd, 1);
+
+	return true;
+}
+
+/**
+ * Flush all pending asynchronous log messages.
+ *
+ * This function is registered as an exit handler by log_async_start(), so
+ * messages logged just before the program termination are not lost. */
+void log_async_flush(void) {
+	if (atomic_load(&_async.enabled))
+		log_drain(true);
+}
+
+/**
+ * Flush pending log messages before the process gets killed.
+ *
+ * This handler is called upon a fatal signal (e.g. abort() called by a
+ * failed assertion), so messages logged just before the crash - which are
+ * the most valuable ones - are not lost. Since the crashing thread might
+ * already hold the drain lock, the lock is not waited for. After that, the
+ * default signal action is restored and the signal is raised again. */
+static void log_async_fatal_handler(int sig) {
+	if (pthread_mutex_trylock(&_async.drain_mtx) == 0) {
+		log_drain_locked(true);
+		pthread_mutex_unlock(&_async.drain_mtx);
+	}
+	raise(sig);
+}
+
+/**
+ * Switch logging into the asynchronous mode.
+ *
+ * In the asynchronous mode, messages are formatted by the calling thread
+ * and stored in a lock-free per-thread ring. Then, they are written to
+ * the stderr and/or syslog by the background drain thread. Hence, logging
+ * from IO threads will never block on the output. Additionally, repeated
+ * messages (identical text and priority) are deduplicated and the overall
+ * output rate is limited. Pending messages are flushed at the program exit
+ * and upon a fatal signal.
+ *
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int log_async_start(void) {
+
+	int err;
+
+	if (atomic_load(&_async.enabled))
+		return 0;
+
+	if ((_async.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+		return -1;
+
+	if ((err = pthread_key_create(&_async.ring_key, log_ring_release)) != 0)
+		goto fail;
+
+	if ((err = pthread_create(&_async.thread, NULL, log_drain_thread, NULL)) != 0) {
+		pthread_key_delete(_async.ring_key);
+		goto fail;
+	}
+
+	pthread_setname_np(_async.thread, "ba-log");
+	atomic_store(&_async.enabled, true);
+	atexit(log_async_flush);
+
+	const int signals[] = { SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV };
+	struct sigaction sigact = {
+		.sa_handler = log_async_fatal_handler,
+		.sa_flags = SA_RESETHAND | SA_NODEFER };
+	size_t i;
+	for (i = 0; i < ARRAYSIZE(signals); i++)
+		sigaction(signals[i], &sigact, NULL);
+
+	return 0;
+
+fail:
+	close(_async.event_fd);
+	_async.event_fd = -1;
+	errno = err;
+	return -1;
+}
+
+static void vlog(int priority, const char *format, va_list ap) {
 
 	int oldstate;
 
@@ -69,6 +441,15 @@ static void vlog(int priority, const char *format, va_list ap) {
 	 * has to be temporally disabled. */
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldstate);
 
+	if (atomic_load_explicit(&_async.enabled, memory_order_relaxed)) {
+		va_list ap_async;
+		va_copy(ap_async, ap);
+		bool ok = log_ring_push(priority, format, ap_async);
+		va_end(ap_async);
+		if (ok)
+			goto final;
+	}
+
 	if (_syslog) {
 		va_list ap_syslog;
 		va_copy(ap_syslog, ap);
@@ -91,6 +472,7 @@ static void vlog(int priority, const char *format, va_list ap) {
 
 	funlockfile(stderr);
 
+final:
 	pthread_setcancelstate(oldstate, NULL);
 
 }
@@ -26,6 +26,8 @@
 #endif
 
 void log_open(const char *ident, bool syslog, bool time);
+int log_async_start(void);
+void log_async_flush(void);
 void log_message(int priority, const char *format, ...) __attribute__ ((format(printf, 2, 3)));
 
 #if DEBUG
@@ -0,0 +1,233 @@
+/*
+ * BlueALSA - mempool.c
+ * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "shared/mempool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* size class of blocks bigger than the biggest class */
+#define MEMPOOL_CLASS_NONE MEMPOOL_CLASSES
+
+/**
+ * Memory block header.
+ *
+ * The header is placed right before the memory returned to the user, so
+ * it has to be aligned in the same way as the malloc() memory is. */
+struct mempool_block {
+	/* next free block in the size class cache */
+	struct mempool_block *next;
+	/* size class index */
+	unsigned int cls;
+	/* size requested by the user */
+	size_t size;
+} __attribute__ ((aligned));
+
+static struct {
+	pthread_mutex_t mutex;
+	/* recycled blocks of every size class */
+	struct mempool_block *cache[MEMPOOL_CLASSES];
+	size_t cache_len[MEMPOOL_CLASSES];
+	struct mempool_stats stats;
+} pool = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * Get the size class for the given size. */
+static unsigned int mempool_size_class(size_t size) {
+	unsigned int cls;
+	for (cls = 0; cls < MEMPOOL_CLASSES; cls++)
+		if (size <= (size_t)MEMPOOL_CLASS_MIN_SIZE << cls)
+			return cls;
+	return MEMPOOL_CLASS_NONE;
+}
+
+/**
+ * Get the capacity of the block with the given size class. */
+static size_t mempool_block_capacity(unsigned int cls, size_t size) {
+	if (cls == MEMPOOL_CLASS_NONE)
+		return size;
+	return (size_t)MEMPOOL_CLASS_MIN_SIZE << cls;
+}
+
+static void mempool_stats_update_peak(void) {
+	const size_t total = pool.stats.allocated + pool.stats.cached;
+	if (total > pool.stats.peak)
+		pool.stats.peak = total;
+}
+
+/**
+ * Allocate memory block from the pool.
+ *
+ * Requested size is rounded up to the nearest power-of-two size class.
+ * Freed blocks are not returned to the system right away, but they are
+ * kept in the per-class cache, so allocations of objects with the same
+ * life cycle (e.g. IO buffers of the transport which is constantly
+ * reconnecting) will reuse memory instead of fragmenting the heap.
+ *
+ * @param size The number of bytes to allocate.
+ * @return On success this function returns a pointer to the allocated
+ *   memory. Otherwise, NULL is returned and errno is set appropriately. */
+void *mempool_alloc(size_t size) {
+
+	const unsigned int cls = mempool_size_class(size);
+	const size_t capacity = mempool_block_capacity(cls, size);
+	struct mempool_block *b = NULL;
+
+	pthread_mutex_lock(&pool.mutex);
+
+	if (cls != MEMPOOL_CLASS_NONE &&
+			(b = pool.cache[cls]) != NULL) {
+		pool.cache[cls] = b->next;
+		pool.cache_len[cls]--;
+		pool.stats.cached -= capacity;
+		pool.stats.hits++;
+	}
+	else
+		pool.stats.misses++;
+
+	pthread_mutex_unlock(&pool.mutex);
+
+	if (b == NULL &&
+			(b = malloc(sizeof(*b) + capacity)) == NULL)
+		return NULL;
+
+	b->next = NULL;
+	b->cls = cls;
+	b->size = size;
+
+	pthread_mutex_lock(&pool.mutex);
+	pool.stats.requested += size;
+	pool.stats.allocated += capacity;
+	mempool_stats_update_peak();
+	pthread_mutex_unlock(&pool.mutex);
+
+	return b + 1;
+}
+
+/**
+ * Allocate zero-initialized memory block from the pool. */
+void *mempool_alloc0(size_t size) {
+	void *ptr;
+	if ((ptr = mempool_alloc(size)) != NULL)
+		memset(ptr, 0, size);
+	return ptr;
+}
+
+/**
+ * Change the size of the memory block allocated from the pool.
+ *
+ * If the block capacity is big enough, it is reused in place. Otherwise,
+ * the content is copied into a new block (up to the smaller of the old
+ * and new sizes) and the old block is returned to the pool.
+ *
+ * @param ptr Pointer to the memory block or NULL.
+ * @param size New size of the memory block.
+ * @return On success this function returns a pointer to the reallocated
+ *   memory. Otherwise, NULL is returned and the original block is left
+ *   untouched. */
+void *mempool_realloc(void *ptr, size_t size) {
+
+	if (ptr == NULL)
+		return mempool_alloc(size);
+
+	struct mempool_block *b = (struct mempool_block *)ptr - 1;
+
+	if (b->cls != MEMPOOL_CLASS_NONE &&
+			size <= mempool_block_capacity(b->cls, b->size)) {
+		pthread_mutex_lock(&pool.mutex);
+		pool.stats.requested += size;
+		pool.stats.requested -= b->size;
+		pthread_mutex_unlock(&pool.mutex);
+		b->size = size;
+		return ptr;
+	}
+
+	void *tmp;
+	if ((tmp = mempool_alloc(size)) == NULL)
+		return NULL;
+
+	memcpy(tmp, ptr, b->size < size ? b->size : size);
+	mempool_free(ptr);
+
+	return tmp;
+}
+
+/**
+ * Return memory block to the pool.
+ *
+ * @param ptr Pointer to the memory block allocated with mempool_alloc()
+ *   or NULL, in which case no operation is performed. */
+void mempool_free(void *ptr) {
+
+	if (ptr == NULL)
+		return;
+
+	struct mempool_block *b = (struct mempool_block *)ptr - 1;
+	const unsigned int cls = b->cls;
+	const size_t capacity = mempool_block_capacity(cls, b->size);
+	bool recycled = false;
+
+	pthread_mutex_lock(&pool.mutex);
+
+	pool.stats.requested -= b->size;
+	pool.stats.allocated -= capacity;
+
+	if (cls != MEMPOOL_CLASS_NONE &&
+			pool.cache_len[cls] < MEMPOOL_CLASS_CACHE) {
+		b->next = pool.cache[cls];
+		pool.cache[cls] = b;
+		pool.cache_len[cls]++;
+		pool.stats.cached += capacity;
+		recycled = true;
+	}
+
+	pthread_mutex_unlock(&pool.mutex);
+
+	if (!recycled)
+		free(b);
+
+}
+
+/**
+ * Release all cached memory blocks back to the system. */
+void mempool_trim(void) {
+
+	struct mempool_block *cache[MEMPOOL_CLASSES];
+	size_t i;
+
+	pthread_mutex_lock(&pool.mutex);
+	memcpy(cache, pool.cache, sizeof(cache));
+	memset(pool.cache, 0, sizeof(pool.cache));
+	memset(pool.cache_len, 0, sizeof(pool.cache_len));
+	pool.stats.cached = 0;
+	pthread_mutex_unlock(&pool.mutex);
+
+	for (i = 0; i < MEMPOOL_CLASSES; i++)
+		while (cache[i] != NULL) {
+			struct mempool_block *b = cache[i];
+			cache[i] = b->next;
+			free(b);
+		}
+
+}
+
+/**
+ * Get memory pool statistics.
+ *
+ * @param stats Address where the statistics snapshot will be stored. */
+void mempool_get_stats(struct mempool_stats *stats) {
+	pthread_mutex_lock(&pool.mutex);
+	*stats = pool.stats;
+	pthread_mutex_unlock(&pool.mutex);
+}
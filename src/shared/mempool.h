@@ -0,0 +1,50 @@
+/*
+ * BlueALSA - mempool.h
+ * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef BLUEALSA_SHARED_MEMPOOL_H_
+#define BLUEALSA_SHARED_MEMPOOL_H_
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stddef.h>
+
+/* the smallest size class of the pool (in bytes) */
+#define MEMPOOL_CLASS_MIN_SIZE 64
+/* number of size classes - every class doubles the block size */
+#define MEMPOOL_CLASSES 11
+/* maximum number of recycled blocks kept in every size class */
+#define MEMPOOL_CLASS_CACHE 8
+
+struct mempool_stats {
+	/* number of allocations served from the cache */
+	size_t hits;
+	/* number of allocations which required a new memory block */
+	size_t misses;
+	/* bytes requested by users of currently allocated blocks */
+	size_t requested;
+	/* bytes of currently allocated blocks (including rounding) */
+	size_t allocated;
+	/* bytes of free blocks kept in the cache for recycling */
+	size_t cached;
+	/* peak value of allocated and cached bytes */
+	size_t peak;
+};
+
+void *mempool_alloc(size_t size);
+void *mempool_alloc0(size_t size);
+void *mempool_realloc(void *ptr, size_t size);
+void mempool_free(void *ptr);
+
+void mempool_trim(void);
+void mempool_get_stats(struct mempool_stats *stats);
+
+#endif
@@ -12,6 +12,7 @@
 
 #include <stdlib.h>
 
+#include "shared/trace.h"
 
 /**
  * Synchronize time with the sampling rate.
@@ -48,14 +49,41 @@ int asrsync_sync(struct asrsync *asrs, unsigned int frames) {
 	/* maintain constant rate */
 	difftimespec(&asrs->ts0, &ts, &ts);
 	if (difftimespec(&ts, &ts_rate, &asrs->ts_idle) > 0) {
+		trace2(pacing_sleep, asrs->ts_idle.tv_sec, asrs->ts_idle.tv_nsec);
 		nanosleep(&asrs->ts_idle, NULL);
 		rv = 1;
 	}
+	else
+		trace2(pacing_overdue, asrs->ts_idle.tv_sec, asrs->ts_idle.tv_nsec);
 
 	gettimestamp(&asrs->ts);
 	return rv;
 }
 
+/**
+ * Get the time by which the transfer is behind the schedule.
+ *
+ * @param asrs Pointer to the time synchronization structure.
+ * @return This function returns the number of milliseconds by which the
+ *   transfer is late, or zero if the transfer is on time. */
+unsigned int asrsync_get_overdue_msec(const struct asrsync *asrs) {
+
+	const unsigned int rate = asrs->rate;
+	const unsigned int frames = asrs->frames;
+	struct timespec ts_rate;
+	struct timespec ts;
+
+	ts_rate.tv_sec = frames / rate;
+	ts_rate.tv_nsec = 1000000000 / rate * (frames % rate);
+
+	gettimestamp(&ts);
+	difftimespec(&asrs->ts0, &ts, &ts);
+	if (difftimespec(&ts_rate, &ts, &ts) <= 0)
+		return 0;
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 /**
  * Calculate time difference for two time points.
  *
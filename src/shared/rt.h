@@ -57,6 +57,8 @@ struct asrsync {
 
 int asrsync_sync(struct asrsync *asrs, unsigned int frames);
 
+unsigned int asrsync_get_overdue_msec(const struct asrsync *asrs);
+
 /**
  * Get the number of microseconds spent outside of the sync function. */
 #define asrsync_get_busy_usec(asrs) \
@@ -0,0 +1,54 @@
+/*
+ * BlueALSA - trace.h
+ * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef BLUEALSA_SHARED_TRACE_H_
+#define BLUEALSA_SHARED_TRACE_H_
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+/**
+ * Static tracepoints.
+ *
+ * When compiled with the SDT support, every tracepoint is a single NOP
+ * instruction plus an ELF note describing the probe location and the
+ * arguments. Such probes can be attached to in the running process by
+ * tools like bpftrace, perf or systemtap, e.g.:
+ *
+ *   bpftrace -e 'usdt:/usr/bin/bluealsa:bluealsa:bt_write { ... }'
+ *
+ * Without the SDT support, tracepoints are compiled out entirely. All
+ * probes are registered with the "bluealsa" provider name.
+ *
+ * Available probes (with arguments):
+ *   bt_read, bt_write, bt_eagain - BT socket IO (fd, bytes[, coutq])
+ *   sco_read, sco_write - SCO socket IO (fd, bytes)
+ *   pcm_read - PCM FIFO read (fd, samples)
+ *   encode_begin, encode_end - A2DP encoder (codec ID, samples or bytes)
+ *   rtp_loss - RTP sequence gap (received, expected)
+ *   pacing_sleep, pacing_overdue - asrsync_sync() (sec, nsec)
+ *   signal_send, signal_recv - IO thread signal (pipe fd, signal)
+ *   io_read, io_write, io_period, io_pause, io_resume - ALSA plug-in */
+
+#if WITH_SDT
+# include <sys/sdt.h>
+# define trace(N) DTRACE_PROBE(bluealsa, N)
+# define trace1(N, A1) DTRACE_PROBE1(bluealsa, N, A1)
+# define trace2(N, A1, A2) DTRACE_PROBE2(bluealsa, N, A1, A2)
+# define trace3(N, A1, A2, A3) DTRACE_PROBE3(bluealsa, N, A1, A2, A3)
+#else
+# define trace(N) do {} while (0)
+# define trace1(N, A1) do {} while (0)
+# define trace2(N, A1, A2) do {} while (0)
+# define trace3(N, A1, A2, A3) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * bench-at.c
+ * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ * This program measures the throughput of the streaming AT message reader.
+ * The HFP service level connection transcript is fed into the reader in
+ * chunks of various sizes, which simulates RFCOMM reads with split and
+ * coalesced AT messages.
+ *
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/at.c"
+#include "../src/shared/log.c"
+#include "../src/shared/rt.c"
+
+static const char transcript[] =
+	"AT+BRSF=756\r"
+	"\r\n+BRSF:1639\r\n\r\nOK\r\n"
+	"AT+BAC=1,2\r"
+	"\r\nOK\r\n"
+	"AT+CIND=?\r"
+	"\r\n+CIND:(\"call\",(0,1)),(\"callsetup\",(0-3)),(\"service\",(0-1)),"
+	"(\"signal\",(0-5)),(\"roam\",(0,1)),(\"battchg\",(0-5)),(\"callheld\",(0-2))\r\n"
+	"\r\nOK\r\n"
+	"AT+CIND?\r"
+	"\r\n+CIND:0,0,1,4,0,4,0\r\n\r\nOK\r\n"
+	"AT+CMER=3,0,0,1,0\r"
+	"\r\nOK\r\n"
+	"AT+BIA=1,1,1,1,1,1,1\r"
+	"\r\nOK\r\n"
+	"\r\n+BCS:2\r\n"
+	"AT+BCS=2\r"
+	"\r\nOK\r\n"
+	"AT+VGS=9\r"
+	"AT+VGM=15\r"
+	"\r\n+CIEV:6,3\r\n"
+	"AT+XAPL=ABCD-1234-0100,10\r"
+	"\r\n+XAPL=iPhone,6\r\n"
+	"AT+IPHONEACCEV=2,1,4,2,0\r";
+
+/**
+ * Run the AT reader over the transcript.
+ *
+ * @param chunk Size of the chunk fed into the reader.
+ * @param iterations Number of transcript iterations.
+ * @return Number of parsed AT messages. */
+static size_t bench_at_reader(size_t chunk, unsigned int iterations) {
+
+	struct at_reader reader;
+	struct bt_at at;
+	size_t messages = 0;
+
+	at_reader_init(&reader);
+	while (iterations--) {
+		size_t i = 0;
+		while (i < sizeof(transcript) - 1) {
+			size_t len = sizeof(transcript) - 1 - i;
+			i += at_reader_feed(&reader, &transcript[i], chunk < len ? chunk : len);
+			while (at_reader_next(&reader, &at) == 0)
+				messages++;
+		}
+	}
+
+	return messages;
+}
+
+int main(int argc, char *argv[]) {
+
+	int opt;
+	const char *opts = "hn:";
+	struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "iterations", required_argument, NULL, 'n' },
+		{ 0, 0, 0, 0 },
+	};
+
+	static const size_t chunks[] = { 1, 7, 32, 127, sizeof(transcript) - 1 };
+	unsigned int iterations = 100000;
+	size_t i;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */ :
+			printf("Usage:\n"
+					"  %s [OPTION]...\n"
+					"\nOptions:\n"
+					"  -h, --help\t\tprint this help and exit\n"
+					"  -n, --iterations=NB\tnumber of transcript iterations\n",
+					argv[0]);
+			return 0;
+		case 'n' /* --iterations=NB */ :
+			if ((iterations = atoi(optarg)) == 0) {
+				fprintf(stderr, "Invalid number of iterations: %s\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return 1;
+		}
+
+	printf("{\"bytes\":%zu,\"iterations\":%u,\"results\":[",
+			sizeof(transcript) - 1, iterations);
+	for (i = 0; i < ARRAYSIZE(chunks); i++) {
+
+		struct timespec ts0, ts, diff;
+		gettimestamp(&ts0);
+		size_t messages = bench_at_reader(chunks[i], iterations);
+		gettimestamp(&ts);
+		difftimespec(&ts0, &ts, &diff);
+
+		double sec = diff.tv_sec + diff.tv_nsec / 1e9;
+		printf("%s{\"chunk\":%zu,\"messages\":%zu,\"ns_per_message\":%.1f,\"mb_per_sec\":%.1f}",
+				i == 0 ? "" : ",", chunks[i], messages, sec * 1e9 / messages,
+				(sizeof(transcript) - 1) * (double)iterations / sec / 1e6);
+
+	}
+	printf("]}\n");
+
+	return 0;
+}
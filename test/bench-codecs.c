@@ -0,0 +1,676 @@
+/*
+ * bench-codecs.c
+ * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "inc/sine.inc"
+#include "../src/shared/rt.c"
+
+/* Bypass transfer pacing, so the encoder runs as fast as it can. Pacing
+ * hook is also used for collecting per-packet encoding latency. */
+static int bench_asrsync_sync(struct asrsync *asrs, unsigned int frames);
+#define asrsync_sync(asrs, frames) bench_asrsync_sync(asrs, frames)
+
+#include "../src/a2dp.c"
+#include "../src/a2dp-audio.c"
+#include "../src/a2dp-capture.c"
+#include "../src/at.c"
+#include "../src/audio.c"
+#include "../src/ba-adapter.c"
+#include "../src/ba-device.c"
+#include "../src/ba-transport.c"
+#include "../src/bluealsa.c"
+#if ENABLE_APTX || ENABLE_APTX_HD
+# include "../src/codec-aptx.c"
+#endif
+#if ENABLE_MSBC
+# include "../src/codec-msbc.c"
+#endif
+#include "../src/codec-sbc.c"
+#include "../src/dbus.c"
+#include "../src/hci.c"
+#include "../src/sco.c"
+#include "../src/utils.c"
+#include "../src/shared/ffb.c"
+#include "../src/shared/log.c"
+#include "../src/shared/mempool.c"
+
+unsigned int bluealsa_dbus_pcm_register(struct ba_transport_pcm *pcm, GError **error) {
+	(void)pcm; (void)error; return 0; }
+void bluealsa_dbus_pcm_update(struct ba_transport_pcm *pcm, unsigned int mask) {
+	(void)pcm; (void)mask; }
+void bluealsa_dbus_pcm_unregister(struct ba_transport_pcm *pcm) {
+	(void)pcm; }
+struct ba_rfcomm *ba_rfcomm_new(struct ba_transport *sco, int fd) {
+	(void)sco; (void)fd; return NULL; }
+void ba_rfcomm_destroy(struct ba_rfcomm *r) {
+	(void)r; }
+int ba_rfcomm_send_signal(struct ba_rfcomm *r, enum ba_rfcomm_signal sig) {
+	(void)r; (void)sig; return 0; }
+bool bluez_a2dp_set_configuration(const char *current_dbus_sep_path,
+		const struct a2dp_sep *sep, GError **error) {
+	(void)current_dbus_sep_path; (void)sep; (void)error; return false; }
+
+/**
+ * Allocation statistics of the benchmarked IO thread.
+ *
+ * This program is linked with the --wrap linker option for the malloc()
+ * family, so allocations made by the BlueALSA code can be counted. Memory
+ * allocated inside codec libraries is not accounted. */
+static __thread bool alloc_tracking = false;
+static unsigned long alloc_count = 0;
+static unsigned long alloc_bytes = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+	if (alloc_tracking) {
+		__atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+	}
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+	if (alloc_tracking) {
+		__atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&alloc_bytes, nmemb * size, __ATOMIC_RELAXED);
+	}
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	if (alloc_tracking) {
+		__atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+	}
+	return __real_realloc(ptr, size);
+}
+
+/**
+ * Per-packet encoding latency in microseconds. */
+static unsigned int latency_samples[64 * 1024];
+static size_t latency_samples_len = 0;
+/* number of frames passed to the pacing function */
+static unsigned long synced_frames = 0;
+
+static int bench_asrsync_sync(struct asrsync *asrs, unsigned int frames) {
+
+	struct timespec ts;
+
+	asrs->frames += frames;
+	synced_frames += frames;
+
+	/* time spent outside of the sync function is the time
+	 * required for reading, encoding and writing one packet */
+	gettimestamp(&ts);
+	difftimespec(&asrs->ts, &ts, &asrs->ts_busy);
+	asrs->ts_idle.tv_sec = asrs->ts_idle.tv_nsec = 0;
+
+	if (latency_samples_len < ARRAYSIZE(latency_samples))
+		latency_samples[latency_samples_len++] =
+			asrs->ts_busy.tv_sec * 1000000 + asrs->ts_busy.tv_nsec / 1000;
+
+	gettimestamp(&asrs->ts);
+	return 0;
+}
+
+static const a2dp_sbc_t config_sbc_44100_stereo = {
+	.frequency = SBC_SAMPLING_FREQ_44100,
+	.channel_mode = SBC_CHANNEL_MODE_STEREO,
+	.block_length = SBC_BLOCK_LENGTH_16,
+	.subbands = SBC_SUBBANDS_8,
+	.allocation_method = SBC_ALLOCATION_LOUDNESS,
+	.min_bitpool = SBC_MIN_BITPOOL,
+	.max_bitpool = SBC_MAX_BITPOOL,
+};
+
+static const a2dp_sbc_t config_sbc_48000_joint_stereo = {
+	.frequency = SBC_SAMPLING_FREQ_48000,
+	.channel_mode = SBC_CHANNEL_MODE_JOINT_STEREO,
+	.block_length = SBC_BLOCK_LENGTH_16,
+	.subbands = SBC_SUBBANDS_8,
+	.allocation_method = SBC_ALLOCATION_LOUDNESS,
+	.min_bitpool = SBC_MIN_BITPOOL,
+	.max_bitpool = SBC_MAX_BITPOOL,
+};
+
+#if ENABLE_MP3LAME
+static const a2dp_mpeg_t config_mp3_44100_stereo = {
+	.layer = MPEG_LAYER_MP3,
+	.channel_mode = MPEG_CHANNEL_MODE_STEREO,
+	.frequency = MPEG_SAMPLING_FREQ_44100,
+	.vbr = 1,
+	MPEG_INIT_BITRATE(0xFFFF)
+};
+#endif
+
+#if ENABLE_AAC
+static const a2dp_aac_t config_aac_44100_stereo = {
+	.object_type = AAC_OBJECT_TYPE_MPEG2_AAC_LC,
+	AAC_INIT_FREQUENCY(AAC_SAMPLING_FREQ_44100)
+	.channels = AAC_CHANNELS_2,
+	.vbr = 1,
+	AAC_INIT_BITRATE(0xFFFF)
+};
+#endif
+
+#if ENABLE_APTX
+static const a2dp_aptx_t config_aptx_44100_stereo = {
+	.info = A2DP_SET_VENDOR_ID_CODEC_ID(APTX_VENDOR_ID, APTX_CODEC_ID),
+	.frequency = APTX_SAMPLING_FREQ_44100,
+	.channel_mode = APTX_CHANNEL_MODE_STEREO,
+};
+#endif
+
+#if ENABLE_APTX_HD
+static const a2dp_aptx_hd_t config_aptx_hd_44100_stereo = {
+	.aptx.info = A2DP_SET_VENDOR_ID_CODEC_ID(APTX_HD_VENDOR_ID, APTX_HD_CODEC_ID),
+	.aptx.frequency = APTX_SAMPLING_FREQ_44100,
+	.aptx.channel_mode = APTX_CHANNEL_MODE_STEREO,
+};
+#endif
+
+#if ENABLE_LDAC
+static const a2dp_ldac_t config_ldac_44100_stereo = {
+	.info = A2DP_SET_VENDOR_ID_CODEC_ID(LDAC_VENDOR_ID, LDAC_CODEC_ID),
+	.frequency = LDAC_SAMPLING_FREQ_44100,
+	.channel_mode = LDAC_CHANNEL_MODE_STEREO,
+};
+#endif
+
+/**
+ * Benchmarked codec setup. */
+struct bench_codec {
+	uint16_t codec_id;
+	const char *name;
+	const char *config_name;
+	const struct a2dp_codec *codec_source;
+	const struct a2dp_codec *codec_sink;
+	const void *configuration;
+	size_t mtu;
+	void *(*enc)(struct ba_transport_thread *);
+	void *(*dec)(struct ba_transport_thread *);
+};
+
+static const struct bench_codec codecs[] = {
+	{ A2DP_CODEC_SBC, "SBC", "44100-stereo",
+		&a2dp_codec_source_sbc, &a2dp_codec_sink_sbc, &config_sbc_44100_stereo,
+		153 * 3, a2dp_source_sbc, a2dp_sink_sbc },
+	{ A2DP_CODEC_SBC, "SBC", "48000-joint-stereo",
+		&a2dp_codec_source_sbc, &a2dp_codec_sink_sbc, &config_sbc_48000_joint_stereo,
+		153 * 3, a2dp_source_sbc, a2dp_sink_sbc },
+#if ENABLE_MP3LAME
+	{ A2DP_CODEC_MPEG12, "MP3", "44100-stereo",
+		&a2dp_codec_source_mpeg, &a2dp_codec_sink_mpeg, &config_mp3_44100_stereo,
+		1024, a2dp_source_mp3, a2dp_sink_mpeg },
+#endif
+#if ENABLE_AAC
+	{ A2DP_CODEC_MPEG24, "AAC", "44100-stereo",
+		&a2dp_codec_source_aac, &a2dp_codec_sink_aac, &config_aac_44100_stereo,
+		450, a2dp_source_aac, a2dp_sink_aac },
+#endif
+#if ENABLE_APTX
+	{ A2DP_CODEC_VENDOR_APTX, "aptX", "44100-stereo",
+		&a2dp_codec_source_aptx, &a2dp_codec_sink_aptx, &config_aptx_44100_stereo,
+# if HAVE_APTX_DECODE
+		400, a2dp_source_aptx, a2dp_sink_aptx },
+# else
+		400, a2dp_source_aptx, NULL },
+# endif
+#endif
+#if ENABLE_APTX_HD
+	{ A2DP_CODEC_VENDOR_APTX_HD, "aptX-HD", "44100-stereo",
+		&a2dp_codec_source_aptx_hd, &a2dp_codec_sink_aptx_hd, &config_aptx_hd_44100_stereo,
+# if HAVE_APTX_HD_DECODE
+		600, a2dp_source_aptx_hd, a2dp_sink_aptx_hd },
+# else
+		600, a2dp_source_aptx_hd, NULL },
+# endif
+#endif
+#if ENABLE_LDAC
+	{ A2DP_CODEC_VENDOR_LDAC, "LDAC", "44100-stereo",
+		&a2dp_codec_source_ldac, &a2dp_codec_sink_ldac, &config_ldac_44100_stereo,
+		RTP_HEADER_LEN + sizeof(rtp_media_header_t) + 990 + 6,
+# if HAVE_LDAC_DECODE
+		a2dp_source_ldac, a2dp_sink_ldac },
+# else
+		a2dp_source_ldac, NULL },
+# endif
+#endif
+};
+
+/**
+ * Results of a single benchmark run. */
+struct bench_result {
+	unsigned long frames;
+	unsigned long packets;
+	unsigned long bytes;
+	/* wall clock and IO thread CPU time */
+	unsigned long wall_usec;
+	unsigned long cpu_usec;
+	unsigned long alloc_count;
+	unsigned long alloc_bytes;
+	/* encoding latency percentiles */
+	unsigned int latency_p50;
+	unsigned int latency_p90;
+	unsigned int latency_p99;
+	unsigned int latency_max;
+};
+
+/**
+ * Captured BT packets used as an input for the decoder. */
+static struct {
+	uint8_t *data;
+	size_t data_len;
+	size_t data_size;
+	size_t *lens;
+	size_t len;
+	size_t size;
+} bt_packets = { 0 };
+
+static struct ba_device *device1 = NULL;
+static struct ba_device *device2 = NULL;
+static unsigned int duration = 10;
+static unsigned int timeout_ms = 500;
+
+static void *(*bench_routine)(struct ba_transport_thread *) = NULL;
+
+static int test_transport_acquire(struct ba_transport *t) {
+	(void)t; return 0; }
+static int test_transport_release_bt_a2dp(struct ba_transport *t) {
+	free(t->bluez_dbus_owner); t->bluez_dbus_owner = NULL;
+	return transport_release_bt_a2dp(t);
+}
+
+/**
+ * Wrapper for IO thread routine which enables allocation tracking. */
+static void *bench_io_thread(struct ba_transport_thread *th) {
+	alloc_tracking = true;
+	return bench_routine(th);
+}
+
+static unsigned long timespec2usec(const struct timespec *ts) {
+	return ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+static unsigned long thread_cpu_usec(pthread_t thread) {
+	struct timespec ts = { 0 };
+	clockid_t clock;
+	if (pthread_getcpuclockid(thread, &clock) == 0)
+		clock_gettime(clock, &ts);
+	return timespec2usec(&ts);
+}
+
+static int cmp_uint(const void *a, const void *b) {
+	const unsigned int *ua = a, *ub = b;
+	return (*ua > *ub) - (*ua < *ub);
+}
+
+static unsigned int percentile(const unsigned int *sorted, size_t len, unsigned int p) {
+	if (len == 0)
+		return 0;
+	return sorted[(len - 1) * p / 100];
+}
+
+/**
+ * Generate PCM signal with the given duration and format. */
+static void *pcm_generate(const struct ba_transport_pcm *pcm, size_t *size) {
+
+	const size_t samples = (size_t)pcm->sampling * duration * pcm->channels;
+	const size_t sample_size = BA_TRANSPORT_PCM_FORMAT_BYTES(pcm->format);
+	int16_t *s16;
+	int32_t *s32;
+	size_t i;
+
+	if ((s16 = malloc(samples * sizeof(*s16))) == NULL)
+		return NULL;
+	snd_pcm_sine_s16le(s16, samples, pcm->channels, 0, 1.0 / 128);
+
+	*size = samples * sample_size;
+	if (sample_size == sizeof(int16_t))
+		return s16;
+
+	if ((s32 = malloc(samples * sizeof(*s32))) == NULL) {
+		free(s16);
+		return NULL;
+	}
+
+	const int shift = BA_TRANSPORT_PCM_FORMAT_WIDTH(pcm->format) - 16;
+	for (i = 0; i < samples; i++)
+		s32[i] = (int32_t)s16[i] << shift;
+
+	free(s16);
+	return s32;
+}
+
+struct writer_data {
+	int fd;
+	const uint8_t *data;
+	size_t len;
+};
+
+static void *pcm_writer(void *userdata) {
+
+	struct writer_data *w = userdata;
+	struct pollfd pfds[] = {{ w->fd, POLLOUT, 0 }};
+	const uint8_t *head = w->data;
+	size_t len = w->len;
+	ssize_t ret;
+
+	while (len > 0) {
+		if (poll(pfds, ARRAYSIZE(pfds), -1) == -1)
+			break;
+		if ((ret = write(w->fd, head, len)) == -1) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			break;
+		}
+		head += ret;
+		len -= ret;
+	}
+
+	return NULL;
+}
+
+static void *bt_writer(void *userdata) {
+
+	struct writer_data *w = userdata;
+	struct pollfd pfds[] = {{ w->fd, POLLOUT, 0 }};
+	const uint8_t *head = bt_packets.data;
+	size_t i;
+
+	for (i = 0; i < bt_packets.len; i++) {
+		if (poll(pfds, ARRAYSIZE(pfds), -1) == -1)
+			break;
+		if (write(w->fd, head, bt_packets.lens[i]) == -1) {
+			if (errno == EAGAIN || errno == EINTR) {
+				i--;
+				continue;
+			}
+			break;
+		}
+		head += bt_packets.lens[i];
+	}
+
+	return NULL;
+}
+
+static void bt_packets_push(const void *data, size_t len) {
+
+	if (bt_packets.len == bt_packets.size) {
+		bt_packets.size = bt_packets.size ? bt_packets.size * 2 : 1024;
+		bt_packets.lens = realloc(bt_packets.lens, bt_packets.size * sizeof(*bt_packets.lens));
+	}
+
+	if (bt_packets.data_len + len > bt_packets.data_size) {
+		bt_packets.data_size = (bt_packets.data_size + len) * 2;
+		bt_packets.data = realloc(bt_packets.data, bt_packets.data_size);
+	}
+
+	memcpy(bt_packets.data + bt_packets.data_len, data, len);
+	bt_packets.data_len += len;
+	bt_packets.lens[bt_packets.len++] = len;
+
+}
+
+/**
+ * Start IO thread, feed it with data and drain its output until it becomes
+ * idle for longer than the timeout. */
+static int bench_run(struct ba_transport_thread *th,
+		void *(*routine)(struct ba_transport_thread *), void *(*writer)(void *),
+		struct writer_data *wd, int fd_out, bool capture_bt, struct bench_result *r) {
+
+	struct pollfd pfds[] = {{ fd_out, POLLIN, 0 }};
+	struct timespec ts0, ts;
+	pthread_t writer_thread;
+	uint8_t buffer[4096];
+	ssize_t len;
+
+	memset(r, 0, sizeof(*r));
+	alloc_count = alloc_bytes = 0;
+	latency_samples_len = 0;
+	synced_frames = 0;
+
+	bench_routine = routine;
+	gettimestamp(&ts0);
+	ts = ts0;
+
+	if (ba_transport_thread_create(th, bench_io_thread, "bench") == -1)
+		return -1;
+	pthread_create(&writer_thread, NULL, writer, wd);
+
+	while (poll(pfds, ARRAYSIZE(pfds), timeout_ms) > 0) {
+
+		if ((len = read(fd_out, buffer, sizeof(buffer))) <= 0) {
+			if (len == -1 && errno == EAGAIN)
+				continue;
+			break;
+		}
+
+		gettimestamp(&ts);
+		r->packets++;
+		r->bytes += len;
+
+		if (capture_bt)
+			bt_packets_push(buffer, len);
+
+	}
+
+	r->cpu_usec = thread_cpu_usec(th->id);
+
+	pthread_cancel(th->id);
+	pthread_join(th->id, NULL);
+	th->id = config.main_thread;
+	pthread_cancel(writer_thread);
+	pthread_join(writer_thread, NULL);
+
+	difftimespec(&ts0, &ts, &ts);
+	r->wall_usec = timespec2usec(&ts);
+	r->alloc_count = alloc_count;
+	r->alloc_bytes = alloc_bytes;
+
+	qsort(latency_samples, latency_samples_len, sizeof(*latency_samples), cmp_uint);
+	r->latency_p50 = percentile(latency_samples, latency_samples_len, 50);
+	r->latency_p90 = percentile(latency_samples, latency_samples_len, 90);
+	r->latency_p99 = percentile(latency_samples, latency_samples_len, 99);
+	if (latency_samples_len > 0)
+		r->latency_max = latency_samples[latency_samples_len - 1];
+
+	return 0;
+}
+
+static void print_result(FILE *f, const char *name, const struct bench_result *r,
+		unsigned int rate, bool latency) {
+
+	const double audio_sec = (double)r->frames / rate;
+	const double wall_sec = r->wall_usec / 1e6;
+
+	fprintf(f, "\"%s\":{\"frames\":%lu,\"packets\":%lu,\"bytes\":%lu,"
+			"\"wall_usec\":%lu,\"cpu_usec\":%lu,\"realtime_factor\":%.2f,"
+			"\"cpu_usec_per_audio_sec\":%.1f,\"alloc_count\":%lu,\"alloc_bytes\":%lu",
+			name, r->frames, r->packets, r->bytes, r->wall_usec, r->cpu_usec,
+			wall_sec > 0 ? audio_sec / wall_sec : 0,
+			audio_sec > 0 ? r->cpu_usec / audio_sec : 0,
+			r->alloc_count, r->alloc_bytes);
+	if (latency)
+		fprintf(f, ",\"packet_latency_usec\":{\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}",
+				r->latency_p50, r->latency_p90, r->latency_p99, r->latency_max);
+	fprintf(f, "}");
+
+}
+
+static int bench_codec(const struct bench_codec *c, FILE *f, bool first) {
+
+	struct bench_result enc = { 0 };
+	struct bench_result dec = { 0 };
+	struct writer_data wd;
+	int bt_fds[2];
+	int pcm_fds[2];
+	void *pcm;
+
+	struct ba_transport_type ttype = {
+		.profile = BA_TRANSPORT_PROFILE_A2DP_SOURCE,
+		.codec = c->codec_id };
+
+	struct ba_transport *t1 = ba_transport_new_a2dp(device1, ttype, ":bench", "/bench",
+			c->codec_source, c->configuration);
+	ttype.profile = BA_TRANSPORT_PROFILE_A2DP_SINK;
+	struct ba_transport *t2 = ba_transport_new_a2dp(device2, ttype, ":bench", "/bench",
+			c->codec_sink, c->configuration);
+
+	t1->acquire = t2->acquire = test_transport_acquire;
+	t1->release = t2->release = test_transport_release_bt_a2dp;
+	t1->mtu_write = t2->mtu_read = c->mtu;
+
+	if ((pcm = pcm_generate(&t1->a2dp.pcm, &wd.len)) == NULL)
+		return -1;
+
+	socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, bt_fds);
+	socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pcm_fds);
+	t1->bt_fd = bt_fds[1];
+	t1->a2dp.pcm.fd = pcm_fds[1];
+	wd.fd = pcm_fds[0];
+	wd.data = pcm;
+
+	bt_packets.len = 0;
+	bench_run(&t1->thread_enc, c->enc, pcm_writer, &wd, bt_fds[0], true, &enc);
+	enc.frames = synced_frames;
+	close(bt_fds[0]);
+	close(pcm_fds[0]);
+	free(pcm);
+
+	if (c->dec != NULL) {
+
+		socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, bt_fds);
+		socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pcm_fds);
+		t2->bt_fd = bt_fds[0];
+		t2->a2dp.pcm.fd = pcm_fds[1];
+		wd.fd = bt_fds[1];
+
+		bench_run(&t2->thread_dec, c->dec, bt_writer, &wd, pcm_fds[0], false, &dec);
+		dec.frames = dec.bytes / BA_TRANSPORT_PCM_FORMAT_BYTES(t2->a2dp.pcm.format) /
+			t2->a2dp.pcm.channels;
+		close(bt_fds[1]);
+		close(pcm_fds[0]);
+
+	}
+
+	fprintf(f, "%s{\"codec\":\"%s\",\"config\":\"%s\",\"sampling\":%u,\"channels\":%u,\"mtu\":%zu,",
+			first ? "" : ",", c->name, c->config_name, t1->a2dp.pcm.sampling,
+			t1->a2dp.pcm.channels, c->mtu);
+	print_result(f, "encode", &enc, t1->a2dp.pcm.sampling, true);
+	if (c->dec != NULL) {
+		fprintf(f, ",");
+		print_result(f, "decode", &dec, t2->a2dp.pcm.sampling, false);
+	}
+	fprintf(f, "}");
+
+	ba_transport_destroy(t1);
+	ba_transport_destroy(t2);
+
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+
+	int opt;
+	const char *opts = "hd:o:t:";
+	struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "duration", required_argument, NULL, 'd' },
+		{ "output", required_argument, NULL, 'o' },
+		{ "timeout", required_argument, NULL, 't' },
+		{ 0, 0, 0, 0 },
+	};
+
+	FILE *f = stdout;
+	size_t i;
+	int j;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */ :
+			printf("Usage:\n"
+					"  %s [OPTION]... [CODEC[:CONFIG]]...\n"
+					"\nOptions:\n"
+					"  -h, --help\t\tprint this help and exit\n"
+					"  -d, --duration=SEC\tduration of the input signal\n"
+					"  -o, --output=FILE\twrite JSON report to the file\n"
+					"  -t, --timeout=MSEC\tidle time which ends the run\n",
+					argv[0]);
+			return 0;
+		case 'd' /* --duration=SEC */ :
+			if ((duration = atoi(optarg)) == 0) {
+				fprintf(stderr, "Invalid duration: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'o' /* --output=FILE */ :
+			if ((f = fopen(optarg, "w")) == NULL) {
+				fprintf(stderr, "Couldn't open output file: %s\n", strerror(errno));
+				return 1;
+			}
+			break;
+		case 't' /* --timeout=MSEC */ :
+			timeout_ms = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return 1;
+		}
+
+	bdaddr_t addr1 = {{ 1, 2, 3, 4, 5, 6 }};
+	bdaddr_t addr2 = {{ 1, 2, 3, 7, 8, 9 }};
+	struct ba_adapter *adapter = ba_adapter_new(0);
+	device1 = ba_device_new(adapter, &addr1);
+	device2 = ba_device_new(adapter, &addr2);
+
+	bool first = true;
+	fprintf(f, "{\"duration\":%u,\"results\":[", duration);
+	for (i = 0; i < ARRAYSIZE(codecs); i++) {
+
+		bool enabled = optind == argc;
+		for (j = optind; j < argc; j++) {
+			const char *config = strchr(argv[j], ':');
+			size_t len = config != NULL ? (size_t)(config - argv[j]) : strlen(argv[j]);
+			if (strlen(codecs[i].name) == len &&
+					strncasecmp(argv[j], codecs[i].name, len) == 0 &&
+					(config == NULL || strcmp(config + 1, codecs[i].config_name) == 0))
+				enabled = true;
+		}
+
+		if (!enabled)
+			continue;
+
+		if (bench_codec(&codecs[i], f, first) == -1) {
+			fprintf(stderr, "Couldn't benchmark %s: %s\n", codecs[i].name, strerror(errno));
+			continue;
+		}
+
+		first = false;
+		fflush(f);
+
+	}
+	fprintf(f, "]}\n");
+
+	if (f != stdout)
+		fclose(f);
+
+	return 0;
+}
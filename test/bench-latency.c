@@ -0,0 +1,479 @@
+/*
+ * bench-latency.c
+ * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ * This program measures the end-to-end latency of the BlueALSA pipeline:
+ * ALSA plug-in, PCM FIFO, encoder, BT socket, decoder, PCM FIFO and the
+ * ALSA plug-in once more. The bluealsa-mock server is started in the A2DP
+ * loopback mode, so the data encoded by the A2DP source transport is fed
+ * to the decoder of the A2DP sink transport. Time-stamped markers are
+ * injected into the playback stream and detected in the capture stream.
+ *
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <alsa/asoundlib.h>
+
+#include "inc/preload.inc"
+#include "inc/server.inc"
+#include "../src/shared/defs.h"
+#include "../src/shared/log.c"
+#include "../src/shared/rt.c"
+
+/**
+ * Codecs available in the bluealsa-mock loopback mode. */
+static const struct {
+	const char *name;
+	const char *device;
+	bool extra;
+} codecs[] = {
+	{ "SBC", "12:34:56:78:9A:BC", false },
+#if ENABLE_APTX && HAVE_APTX_DECODE
+	{ "aptX", "AA:BB:CC:DD:00:00", true },
+#endif
+#if ENABLE_APTX_HD && HAVE_APTX_HD_DECODE
+	{ "aptX-HD", "AA:BB:CC:DD:88:DD", true },
+#endif
+};
+
+/* duration of the marker burst in milliseconds */
+#define MARKER_DURATION 10
+/* marker detection threshold relative to the full scale */
+#define MARKER_THRESHOLD 0.25
+
+static unsigned int buffer_time = 200000;
+static unsigned int period_time = 20000;
+static unsigned int duration = 10;
+static unsigned int interval = 500;
+
+static snd_pcm_format_t pcm_format;
+static unsigned int pcm_channels;
+static unsigned int pcm_sampling;
+
+/**
+ * Marker time-stamps and delays reported by the ALSA plug-in. */
+static struct marker {
+	struct timespec ts_inject;
+	struct timespec ts_detect;
+	snd_pcm_sframes_t delay_playback;
+	snd_pcm_sframes_t delay_capture;
+} *markers = NULL;
+static size_t markers_injected = 0;
+static size_t markers_detected = 0;
+static size_t markers_size = 0;
+static pthread_mutex_t markers_mtx = PTHREAD_MUTEX_INITIALIZER;
+static bool capture_running = true;
+
+static int snd_pcm_open_bluealsa(snd_pcm_t **pcmp, const char *service,
+		const char *device, snd_pcm_stream_t stream) {
+
+	char buffer[256];
+	snd_config_t *conf = NULL;
+	snd_input_t *input = NULL;
+	int err;
+
+	sprintf(buffer,
+			"pcm.bluealsa {\n"
+			"  type bluealsa\n"
+			"  service \"org.bluealsa.%s\"\n"
+			"  device \"%s\"\n"
+			"  profile \"a2dp\"\n"
+			"  delay 0\n"
+			"}\n", service, device);
+
+	if ((err = snd_config_top(&conf)) < 0)
+		goto fail;
+	if ((err = snd_input_buffer_open(&input, buffer, strlen(buffer))) != 0)
+		goto fail;
+	if ((err = snd_config_load(conf, input)) != 0)
+		goto fail;
+	err = snd_pcm_open_lconf(pcmp, "bluealsa", stream, 0, conf);
+
+fail:
+	if (conf != NULL)
+		snd_config_delete(conf);
+	if (input != NULL)
+		snd_input_close(input);
+	return err;
+}
+
+/**
+ * Set HW parameters according to the PCM exposed by the BlueALSA. */
+static int set_hw_params(snd_pcm_t *pcm, snd_pcm_uframes_t *period_size) {
+
+	snd_pcm_hw_params_t *params;
+	unsigned int btime = buffer_time;
+	unsigned int ptime = period_time;
+	int dir = 0;
+	int err;
+
+	snd_pcm_hw_params_alloca(&params);
+	snd_pcm_hw_params_any(pcm, params);
+
+	if ((err = snd_pcm_hw_params_set_access(pcm, params, SND_PCM_ACCESS_RW_INTERLEAVED)) != 0)
+		return err;
+	/* BlueALSA PCM exposes exactly one format, channels and rate */
+	if ((err = snd_pcm_hw_params_get_format(params, &pcm_format)) != 0)
+		return err;
+	if ((err = snd_pcm_hw_params_get_channels(params, &pcm_channels)) != 0)
+		return err;
+	if ((err = snd_pcm_hw_params_get_rate(params, &pcm_sampling, &dir)) != 0)
+		return err;
+	if ((err = snd_pcm_hw_params_set_buffer_time_near(pcm, params, &btime, &dir)) != 0)
+		return err;
+	if ((err = snd_pcm_hw_params_set_period_time_near(pcm, params, &ptime, &dir)) != 0)
+		return err;
+	if ((err = snd_pcm_hw_params(pcm, params)) != 0)
+		return err;
+
+	snd_pcm_hw_params_get_period_size(params, period_size, &dir);
+	debug("Selected PCM parameters: %s %u %u Hz: buffer time: %u us, period time: %u us",
+			snd_pcm_format_name(pcm_format), pcm_channels, pcm_sampling, btime, ptime);
+
+	return 0;
+}
+
+/**
+ * Get the first frame which exceeds the marker threshold. */
+static ssize_t marker_find(const void *buffer, size_t frames) {
+
+	const int width = snd_pcm_format_physical_width(pcm_format);
+	const double threshold = MARKER_THRESHOLD * (1LL << (snd_pcm_format_width(pcm_format) - 1));
+	size_t i;
+
+	for (i = 0; i < frames * pcm_channels; i++) {
+		const double v = width == 16 ? ((int16_t *)buffer)[i] : ((int32_t *)buffer)[i];
+		if (fabs(v) > threshold)
+			return i / pcm_channels;
+	}
+
+	return -1;
+}
+
+/**
+ * Fill buffer with the marker burst or with silence. */
+static void marker_generate(void *buffer, size_t frames, size_t offset, bool marker) {
+
+	const int width = snd_pcm_format_physical_width(pcm_format);
+	const double scale = 0.5 * ((1LL << (snd_pcm_format_width(pcm_format) - 1)) - 1);
+	const size_t burst = pcm_sampling * MARKER_DURATION / 1000;
+	size_t i, ch;
+
+	for (i = 0; i < frames; i++) {
+		double v = 0;
+		if (marker && offset + i < burst)
+			v = scale * sin(2 * M_PI * 1000 * (offset + i) / pcm_sampling);
+		for (ch = 0; ch < pcm_channels; ch++) {
+			if (width == 16)
+				((int16_t *)buffer)[i * pcm_channels + ch] = v;
+			else
+				((int32_t *)buffer)[i * pcm_channels + ch] = v;
+		}
+	}
+
+}
+
+static void *capture_thread(void *userdata) {
+
+	snd_pcm_t *pcm = userdata;
+	snd_pcm_uframes_t period_size;
+	snd_pcm_sframes_t frames;
+	snd_pcm_sframes_t delay;
+	struct timespec ts;
+	/* number of silent frames since the last detected marker */
+	size_t silence = 0;
+	bool armed = true;
+	int err;
+
+	if (set_hw_params(pcm, &period_size) != 0)
+		return NULL;
+
+	void *buffer = malloc(period_size * pcm_channels * sizeof(int32_t));
+	const size_t rearm = pcm_sampling * interval / 1000 / 2;
+
+	snd_pcm_start(pcm);
+	while (capture_running) {
+
+		/* do not block indefinitely, when the stream has ended */
+		if ((err = snd_pcm_wait(pcm, 100)) == 0)
+			continue;
+
+		if ((frames = snd_pcm_readi(pcm, buffer, period_size)) < 0) {
+			if (snd_pcm_recover(pcm, frames, 1) == 0)
+				continue;
+			error("Couldn't read PCM: %s", snd_strerror(frames));
+			break;
+		}
+
+		gettimestamp(&ts);
+		if (snd_pcm_delay(pcm, &delay) != 0)
+			delay = 0;
+
+		ssize_t i;
+		if ((i = marker_find(buffer, frames)) == -1 || !armed) {
+			if (i == -1 && (silence += frames) >= rearm)
+				armed = true;
+			if (i != -1)
+				silence = 0;
+			continue;
+		}
+
+		armed = false;
+		silence = 0;
+
+		pthread_mutex_lock(&markers_mtx);
+		if (markers_detected < markers_injected) {
+			struct marker *m = &markers[markers_detected++];
+			/* time-stamp of the frame which contains the marker onset */
+			const long usec = 1000000L * (frames - i) / pcm_sampling;
+			ts.tv_nsec -= usec * 1000;
+			while (ts.tv_nsec < 0) {
+				ts.tv_nsec += 1000000000;
+				ts.tv_sec--;
+			}
+			m->ts_detect = ts;
+			m->delay_capture = delay;
+		}
+		pthread_mutex_unlock(&markers_mtx);
+
+	}
+
+	free(buffer);
+	return NULL;
+}
+
+static int cmp_long(const void *a, const void *b) {
+	const long *la = a, *lb = b;
+	return (*la > *lb) - (*la < *lb);
+}
+
+static void print_report(FILE *f, const char *codec) {
+
+	long *latency = calloc(markers_detected + 1, sizeof(*latency));
+	double mean = 0, jitter = 0, discrepancy = 0;
+	size_t n = 0, i;
+
+	for (i = 0; i < markers_detected; i++) {
+		struct timespec diff;
+		if (difftimespec(&markers[i].ts_inject, &markers[i].ts_detect, &diff) <= 0)
+			continue;
+		latency[n] = diff.tv_sec * 1000000 + diff.tv_nsec / 1000;
+		const long reported = 1000000L *
+			(markers[i].delay_playback + markers[i].delay_capture) / pcm_sampling;
+		discrepancy += latency[n] - reported;
+		mean += latency[n];
+		n++;
+	}
+
+	if (n > 0) {
+		mean /= n;
+		discrepancy /= n;
+		for (i = 0; i < n; i++)
+			jitter += (latency[i] - mean) * (latency[i] - mean);
+		jitter = sqrt(jitter / n);
+		qsort(latency, n, sizeof(*latency), cmp_long);
+	}
+
+	fprintf(f, "{\"codec\":\"%s\",\"format\":\"%s\",\"channels\":%u,\"sampling\":%u,"
+			"\"buffer_time\":%u,\"period_time\":%u,"
+			"\"markers\":{\"injected\":%zu,\"detected\":%zu},"
+			"\"latency_usec\":{\"min\":%ld,\"p50\":%ld,\"p90\":%ld,\"p99\":%ld,\"max\":%ld,"
+			"\"mean\":%.0f,\"jitter\":%.0f},\"delay_discrepancy_usec\":%.0f}\n",
+			codec, snd_pcm_format_name(pcm_format), pcm_channels, pcm_sampling,
+			buffer_time, period_time, markers_injected, markers_detected,
+			latency[0], latency[n > 0 ? (n - 1) * 50 / 100 : 0],
+			latency[n > 0 ? (n - 1) * 90 / 100 : 0],
+			latency[n > 0 ? (n - 1) * 99 / 100 : 0],
+			latency[n > 0 ? n - 1 : 0], mean, jitter, discrepancy);
+
+	free(latency);
+}
+
+int main(int argc, char *argv[]) {
+
+	preload(argc, argv, ".libs/aloader.so");
+
+	int opt;
+	const char *opts = "hc:b:p:d:i:";
+	struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "codec", required_argument, NULL, 'c' },
+		{ "buffer-time", required_argument, NULL, 'b' },
+		{ "period-time", required_argument, NULL, 'p' },
+		{ "duration", required_argument, NULL, 'd' },
+		{ "interval", required_argument, NULL, 'i' },
+		{ 0, 0, 0, 0 },
+	};
+
+	const char *codec = codecs[0].name;
+	size_t i;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */ :
+			printf("Usage:\n"
+					"  %s [OPTION]...\n"
+					"\nOptions:\n"
+					"  -h, --help\t\t\tprint this help and exit\n"
+					"  -c, --codec=NAME\t\tA2DP codec used for the loopback\n"
+					"  -b, --buffer-time=USEC\tPCM buffer time\n"
+					"  -p, --period-time=USEC\tPCM period time\n"
+					"  -d, --duration=SEC\t\tmeasurement duration\n"
+					"  -i, --interval=MSEC\t\tinterval between markers\n",
+					argv[0]);
+			return 0;
+		case 'c' /* --codec=NAME */ :
+			codec = optarg;
+			break;
+		case 'b' /* --buffer-time=USEC */ :
+			buffer_time = atoi(optarg);
+			break;
+		case 'p' /* --period-time=USEC */ :
+			period_time = atoi(optarg);
+			break;
+		case 'd' /* --duration=SEC */ :
+			duration = atoi(optarg);
+			break;
+		case 'i' /* --interval=MSEC */ :
+			if ((interval = atoi(optarg)) < 2 * MARKER_DURATION) {
+				fprintf(stderr, "Invalid marker interval: %s\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return 1;
+		}
+
+	for (i = 0; i < ARRAYSIZE(codecs); i++)
+		if (strcasecmp(codecs[i].name, codec) == 0)
+			break;
+	if (i == ARRAYSIZE(codecs)) {
+		fprintf(stderr, "Codec not available in loopback mode: %s\n", codec);
+		return 1;
+	}
+
+	/* bench-latency and bluealsa-mock shall be placed in the same directory */
+	bluealsa_mock_path = dirname(strdup(argv[0]));
+	bluealsa_mock_args[0] = "--a2dp-loopback";
+	if (codecs[i].extra)
+		bluealsa_mock_args[1] = "--a2dp-extra-codecs";
+
+	const char *service = "latency";
+	snd_pcm_t *pcm_playback = NULL;
+	snd_pcm_t *pcm_capture = NULL;
+	snd_pcm_uframes_t period_size;
+	pthread_t thread;
+	pid_t pid;
+	int err;
+
+	if ((pid = spawn_bluealsa_server(service, duration + 5, true, false, true, true)) == -1) {
+		fprintf(stderr, "Couldn't spawn bluealsa-mock: %s\n", strerror(errno));
+		return 1;
+	}
+
+	/* Capture PCM has to be opened before the playback, because opening
+	 * the playback acquires the source transport and starts the loopback
+	 * decoder which writes to the capture PCM FIFO. */
+	if ((err = snd_pcm_open_bluealsa(&pcm_capture, service, codecs[i].device,
+					SND_PCM_STREAM_CAPTURE)) != 0 ||
+			(err = snd_pcm_open_bluealsa(&pcm_playback, service, codecs[i].device,
+					SND_PCM_STREAM_PLAYBACK)) != 0) {
+		fprintf(stderr, "Couldn't open PCM: %s\n", snd_strerror(err));
+		goto fail;
+	}
+
+	if ((err = set_hw_params(pcm_playback, &period_size)) != 0) {
+		fprintf(stderr, "Couldn't set HW parameters: %s\n", snd_strerror(err));
+		goto fail;
+	}
+
+	markers_size = duration * 1000 / interval + 1;
+	markers = calloc(markers_size, sizeof(*markers));
+	void *buffer = malloc(period_size * pcm_channels * sizeof(int32_t));
+
+	pthread_create(&thread, NULL, capture_thread, pcm_capture);
+
+	const size_t interval_frames = pcm_sampling * interval / 1000;
+	const size_t total_frames = pcm_sampling * duration;
+	size_t frames = 0;
+
+	while (frames < total_frames) {
+
+		size_t offset = frames % interval_frames;
+		bool marker = false;
+
+		/* inject marker at the beginning of the period which
+		 * crosses the marker interval boundary */
+		if (offset + period_size > interval_frames || offset == 0) {
+			marker = markers_injected < markers_size;
+			offset = 0;
+		}
+
+		marker_generate(buffer, period_size, offset, marker);
+
+		if (marker) {
+			struct marker *m = &markers[markers_injected];
+			if (snd_pcm_delay(pcm_playback, &m->delay_playback) != 0)
+				m->delay_playback = 0;
+			gettimestamp(&m->ts_inject);
+			pthread_mutex_lock(&markers_mtx);
+			markers_injected++;
+			pthread_mutex_unlock(&markers_mtx);
+		}
+
+		snd_pcm_sframes_t ret;
+		if ((ret = snd_pcm_writei(pcm_playback, buffer, period_size)) < 0) {
+			if (snd_pcm_recover(pcm_playback, ret, 1) == 0)
+				continue;
+			fprintf(stderr, "Couldn't write PCM: %s\n", snd_strerror(ret));
+			break;
+		}
+
+		frames += period_size;
+
+	}
+
+	snd_pcm_drain(pcm_playback);
+	/* give the last marker a chance to reach the capture */
+	usleep(buffer_time * 2);
+	capture_running = false;
+	pthread_join(thread, NULL);
+
+	print_report(stdout, codecs[i].name);
+
+	free(buffer);
+	free(markers);
+
+fail:
+	if (pcm_playback != NULL)
+		snd_pcm_close(pcm_playback);
+	if (pcm_capture != NULL)
+		snd_pcm_close(pcm_capture);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err == 0 ? 0 : 1;
+}
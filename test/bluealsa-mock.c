@@ -18,6 +18,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <getopt.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -25,6 +26,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -35,8 +38,25 @@
 #include "inc/dbus.inc"
 #include "inc/sine.inc"
 
+#include "../src/shared/rt.c"
+
+/* number of IO thread pacing misses */
+static unsigned long pacing_misses = 0;
+
+/**
+ * Synchronize time with the sampling rate and account pacing misses. */
+static int mock_asrsync_sync(struct asrsync *asrs, unsigned int frames) {
+	int rv = asrsync_sync(asrs, frames);
+	if (rv == 0)
+		__atomic_add_fetch(&pacing_misses, 1, __ATOMIC_RELAXED);
+	return rv;
+}
+
+#define asrsync_sync(asrs, frames) mock_asrsync_sync(asrs, frames)
+
 #include "../src/a2dp.c"
 #include "../src/a2dp-audio.c"
+#include "../src/a2dp-capture.c"
 #include "../src/at.c"
 #include "../src/audio.c"
 #include "../src/ba-adapter.c"
@@ -59,7 +79,7 @@
 #include "../src/utils.c"
 #include "../src/shared/ffb.c"
 #include "../src/shared/log.c"
-#include "../src/shared/rt.c"
+#include "../src/shared/mempool.c"
 
 static const a2dp_sbc_t config_sbc_44100_stereo = {
 	.frequency = SBC_SAMPLING_FREQ_44100,
@@ -89,12 +109,16 @@ static GMutex timeout_mutex = { NULL };
 static GCond timeout_cond = { NULL };
 static int timeout = 5;
 static bool a2dp_extra_codecs = false;
+static bool a2dp_loopback = false;
 static bool a2dp_source = false;
 static bool a2dp_sink = false;
 static bool sco_hfp = false;
 static bool sco_hsp = false;
 static bool dump_output = false;
 static bool fuzzing = false;
+static unsigned int load_devices = 0;
+static const char *load_codecs = "SBC";
+static unsigned int load_stats_interval = 1;
 
 static gboolean main_loop_exit_handler(void *userdata) {
 	g_main_loop_quit((GMainLoop *)userdata);
@@ -219,8 +243,52 @@ void *bt_dump_thread(void *userdata) {
 	return NULL;
 }
 
+/**
+ * Start decoder of the sink transport, which is a loopback counterpart of
+ * the given A2DP source transport. Both transports have to be registered
+ * for the same device and with the same codec. */
+static int mock_a2dp_loopback_start(struct ba_transport *t, int bt_fd) {
+
+	struct ba_transport_type type = { BA_TRANSPORT_PROFILE_A2DP_SINK, t->type.codec };
+	const char *path = g_dbus_transport_type_to_bluez_object_path(type);
+	void *(*routine)(struct ba_transport_thread *) = NULL;
+	struct ba_transport *t_sink;
+	int ret;
+
+	switch (t->type.codec) {
+	case A2DP_CODEC_SBC:
+		routine = a2dp_sink_sbc;
+		break;
+#if HAVE_APTX_DECODE
+	case A2DP_CODEC_VENDOR_APTX:
+		routine = a2dp_sink_aptx;
+		break;
+#endif
+#if HAVE_APTX_HD_DECODE
+	case A2DP_CODEC_VENDOR_APTX_HD:
+		routine = a2dp_sink_aptx_hd;
+		break;
+#endif
+	}
+
+	if (routine == NULL ||
+			(t_sink = ba_transport_lookup(t->d, path)) == NULL)
+		return -1;
+
+	t_sink->bt_fd = bt_fd;
+	t_sink->mtu_read = t->mtu_write;
+	ret = ba_transport_thread_create(&t_sink->thread_dec, routine, "ba-a2dp-loop");
+
+	ba_transport_unref(t_sink);
+	return ret;
+}
+
 static int mock_transport_acquire(struct ba_transport *t) {
 
+	/* in the loopback mode sink is fed by the source transport */
+	if (a2dp_loopback && t->type.profile & BA_TRANSPORT_PROFILE_A2DP_SINK)
+		return 0;
+
 	int bt_fds[2];
 	assert(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, bt_fds) == 0);
 
@@ -228,25 +296,25 @@ static int mock_transport_acquire(struct ba_transport *t) {
 	t->mtu_read = 256;
 	t->mtu_write = 256;
 
-	if (t->type.profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE)
+	if (t->type.profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE) {
 		switch (t->type.codec) {
 		case A2DP_CODEC_SBC:
 			assert(ba_transport_thread_create(&t->thread_enc, a2dp_source_sbc, "ba-a2dp-sbc") == 0);
-			g_thread_unref(g_thread_new(NULL, bt_dump_thread, GINT_TO_POINTER(bt_fds[1])));
 			break;
 #if ENABLE_APTX_HD
 		case A2DP_CODEC_VENDOR_APTX:
 			assert(ba_transport_thread_create(&t->thread_enc, a2dp_source_aptx, "ba-a2dp-aptx") == 0);
-			g_thread_unref(g_thread_new(NULL, bt_dump_thread, GINT_TO_POINTER(bt_fds[1])));
 			break;
 #endif
 #if ENABLE_APTX_HD
 		case A2DP_CODEC_VENDOR_APTX_HD:
 			assert(ba_transport_thread_create(&t->thread_enc, a2dp_source_aptx_hd, "ba-a2dp-aptx-hd") == 0);
-			g_thread_unref(g_thread_new(NULL, bt_dump_thread, GINT_TO_POINTER(bt_fds[1])));
 			break;
 #endif
 		}
+		if (!a2dp_loopback || mock_a2dp_loopback_start(t, bt_fds[1]) == -1)
+			g_thread_unref(g_thread_new(NULL, bt_dump_thread, GINT_TO_POINTER(bt_fds[1])));
+	}
 	else if (t->type.profile & BA_TRANSPORT_PROFILE_A2DP_SINK)
 		switch (t->type.codec) {
 		case A2DP_CODEC_SBC:
@@ -310,6 +378,224 @@ static struct ba_transport *mock_transport_new_sco(const char *device_btmac,
 	return t;
 }
 
+/**
+ * Load generator data. */
+static struct {
+	/* PCM and BT sockets of all load transports */
+	GArray *pcm_fds;
+	GArray *bt_fds;
+	/* number of bytes produced by encoders */
+	unsigned long bt_bytes;
+} load = { NULL };
+
+/**
+ * Create A2DP source transport, which is fed by the load generator. */
+static struct ba_transport *mock_load_transport_new(unsigned int id,
+		const char *codec_name) {
+
+	const struct a2dp_codec *codec = &a2dp_codec_source_sbc;
+	const void *configuration = &config_sbc_44100_stereo;
+	void *(*routine)(struct ba_transport_thread *) = a2dp_source_sbc;
+	int bt_fds[2], pcm_fds[2];
+	char addr[18];
+
+#if ENABLE_APTX
+	if (strcasecmp(codec_name, ba_transport_codecs_a2dp_to_string(A2DP_CODEC_VENDOR_APTX)) == 0) {
+		codec = &a2dp_codec_source_aptx;
+		configuration = &config_aptx_44100_stereo;
+		routine = a2dp_source_aptx;
+	}
+#endif
+#if ENABLE_APTX_HD
+	if (strcasecmp(codec_name, ba_transport_codecs_a2dp_to_string(A2DP_CODEC_VENDOR_APTX_HD)) == 0) {
+		codec = &a2dp_codec_source_aptx_hd;
+		configuration = &config_aptx_hd_48000_stereo;
+		routine = a2dp_source_aptx_hd;
+	}
+#endif
+
+	sprintf(addr, "00:00:00:00:%02X:%02X", (id >> 8) & 0xFF, id & 0xFF);
+	struct ba_transport *t = mock_transport_new_a2dp(addr,
+			BA_TRANSPORT_PROFILE_A2DP_SOURCE, codec, configuration);
+
+	assert(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, bt_fds) == 0);
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pcm_fds) == 0);
+
+	t->bt_fd = bt_fds[0];
+	t->mtu_read = 256;
+	t->mtu_write = 256;
+	t->a2dp.pcm.fd = pcm_fds[1];
+
+	g_array_append_val(load.bt_fds, bt_fds[1]);
+	g_array_append_val(load.pcm_fds, pcm_fds[0]);
+
+	assert(ba_transport_thread_create(&t->thread_enc, routine, "ba-a2dp-load") == 0);
+	return t;
+}
+
+/**
+ * Write sine signal to all load transport PCMs. */
+static void *mock_load_feeder_thread(void *userdata) {
+	(void)userdata;
+
+	static int16_t buffer[1024 * 2];
+	const size_t n = load.pcm_fds->len;
+	struct pollfd *pfds = g_new0(struct pollfd, n);
+	size_t *offsets = g_new0(size_t, n);
+	size_t i;
+
+	snd_pcm_sine_s16le(buffer, ARRAYSIZE(buffer), 2, 0, 1.0 / 128);
+	for (i = 0; i < n; i++) {
+		pfds[i].fd = g_array_index(load.pcm_fds, int, i);
+		pfds[i].events = POLLOUT;
+	}
+
+	for (;;) {
+
+		if (poll(pfds, n, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (pfds[i].revents & (POLLERR | POLLHUP))
+				pfds[i].fd = -1;
+			else if (pfds[i].revents & POLLOUT) {
+				/* keep stream continuous across partial writes */
+				const uint8_t *head = (uint8_t *)buffer + offsets[i];
+				ssize_t ret;
+				if ((ret = send(pfds[i].fd, head, sizeof(buffer) - offsets[i], MSG_NOSIGNAL)) > 0)
+					offsets[i] = (offsets[i] + ret) % sizeof(buffer);
+			}
+		}
+
+	}
+
+	g_free(offsets);
+	g_free(pfds);
+	return NULL;
+}
+
+/**
+ * Read and discard data produced by all load transport encoders. */
+static void *mock_load_drain_thread(void *userdata) {
+	(void)userdata;
+
+	const size_t n = load.bt_fds->len;
+	struct pollfd *pfds = g_new0(struct pollfd, n);
+	uint8_t buffer[1024];
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		pfds[i].fd = g_array_index(load.bt_fds, int, i);
+		pfds[i].events = POLLIN;
+	}
+
+	for (;;) {
+
+		if (poll(pfds, n, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (pfds[i].revents & POLLIN) {
+				ssize_t ret;
+				if ((ret = read(pfds[i].fd, buffer, sizeof(buffer))) > 0)
+					__atomic_add_fetch(&load.bt_bytes, ret, __ATOMIC_RELAXED);
+				else
+					pfds[i].fd = -1;
+			}
+			else if (pfds[i].revents & (POLLERR | POLLHUP))
+				pfds[i].fd = -1;
+		}
+
+	}
+
+	g_free(pfds);
+	return NULL;
+}
+
+static unsigned int get_proc_status_value(const char *key) {
+
+	char line[128];
+	unsigned int value = 0;
+	FILE *f;
+
+	if ((f = fopen("/proc/self/status", "r")) == NULL)
+		return 0;
+
+	while (fgets(line, sizeof(line), f) != NULL)
+		if (strncmp(line, key, strlen(key)) == 0) {
+			value = atoi(line + strlen(key));
+			break;
+		}
+
+	fclose(f);
+	return value;
+}
+
+/**
+ * Periodically report resource usage of the mock server. */
+static void *mock_load_stats_thread(void *userdata) {
+	(void)userdata;
+
+	struct timespec ts0, ts1, ts;
+	unsigned long cpu_usec_prev = 0;
+	unsigned long bt_bytes_prev = 0;
+
+	gettimestamp(&ts0);
+	for (;;) {
+
+		sleep(load_stats_interval);
+
+		/* measure D-Bus round-trip of the GetPCMs call */
+		GError *err = NULL;
+		gettimestamp(&ts1);
+		GVariant *rv = g_dbus_connection_call_sync(config.dbus, service,
+				"/org/bluealsa", BLUEALSA_IFACE_MANAGER, "GetPCMs", NULL, NULL,
+				G_DBUS_CALL_FLAGS_NONE, -1, NULL, &err);
+		gettimestamp(&ts);
+		difftimespec(&ts1, &ts, &ts1);
+
+		if (rv != NULL)
+			g_variant_unref(rv);
+		if (err != NULL) {
+			error("Couldn't get BlueALSA PCM list: %s", err->message);
+			g_error_free(err);
+		}
+
+		struct rusage ru;
+		getrusage(RUSAGE_SELF, &ru);
+		const unsigned long cpu_usec =
+			(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+			ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+		const unsigned long bt_bytes = load.bt_bytes;
+
+		struct timespec ts_now = ts;
+		difftimespec(&ts0, &ts_now, &ts);
+		ts0 = ts_now;
+
+		const double wall_usec = ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+		fprintf(stderr, "BLUEALSA_LOAD_STATS={\"transports\":%u,\"threads\":%u,"
+				"\"rss_kb\":%u,\"cpu_percent\":%.1f,\"bt_bytes_per_sec\":%.0f,"
+				"\"pacing_misses\":%lu,\"get_pcms_usec\":%ld}\n",
+				load.bt_fds->len, get_proc_status_value("Threads:"),
+				get_proc_status_value("VmRSS:"),
+				100.0 * (cpu_usec - cpu_usec_prev) / wall_usec,
+				1e6 * (bt_bytes - bt_bytes_prev) / wall_usec,
+				pacing_misses, ts1.tv_sec * 1000000 + ts1.tv_nsec / 1000);
+
+		cpu_usec_prev = cpu_usec;
+		bt_bytes_prev = bt_bytes;
+
+	}
+
+	return NULL;
+}
+
 void *mock_service_thread(void *userdata) {
 
 	GMainLoop *loop = userdata;
@@ -393,6 +679,27 @@ void *mock_service_thread(void *userdata) {
 					BA_TRANSPORT_PROFILE_HSP_AG, HFP_CODEC_UNDEFINED));
 	}
 
+	if (load_devices > 0) {
+
+		gchar **codecs = g_strsplit(load_codecs, ",", 0);
+		const unsigned int codecs_len = g_strv_length(codecs);
+
+		load.pcm_fds = g_array_new(FALSE, FALSE, sizeof(int));
+		load.bt_fds = g_array_new(FALSE, FALSE, sizeof(int));
+
+		/* distribute codecs among devices in the round-robin manner */
+		for (i = 0; i < load_devices; i++)
+			g_ptr_array_add(tt, mock_load_transport_new(i, codecs[i % codecs_len]));
+
+		g_thread_unref(g_thread_new(NULL, mock_load_feeder_thread, NULL));
+		g_thread_unref(g_thread_new(NULL, mock_load_drain_thread, NULL));
+		if (load_stats_interval > 0)
+			g_thread_unref(g_thread_new(NULL, mock_load_stats_thread, NULL));
+
+		g_strfreev(codecs);
+
+	}
+
 	g_mutex_lock(&timeout_mutex);
 	while (timeout > 0)
 		g_cond_wait(&timeout_cond, &timeout_mutex);
@@ -444,6 +751,10 @@ int main(int argc, char *argv[]) {
 		{ "sco-hsp", no_argument, NULL, 5 },
 		{ "dump-output", no_argument, NULL, 6 },
 		{ "fuzzing", no_argument, NULL, 7 },
+		{ "a2dp-loopback", no_argument, NULL, 8 },
+		{ "load-devices", required_argument, NULL, 9 },
+		{ "load-codecs", required_argument, NULL, 10 },
+		{ "load-stats", required_argument, NULL, 11 },
 		{ 0, 0, 0, 0 },
 	};
 
@@ -462,7 +773,11 @@ int main(int argc, char *argv[]) {
 					"  --sco-hfp\t\tregister HFP endpoints\n"
 					"  --sco-hsp\t\tregister HSP endpoints\n"
 					"  --dump-output\t\tdump Bluetooth transport data\n"
-					"  --fuzzing\t\tmock human actions with timings\n",
+					"  --fuzzing\t\tmock human actions with timings\n"
+					"  --a2dp-loopback\tdecode A2DP source output with A2DP sink\n"
+					"  --load-devices=NUM\tstream to NUM mock A2DP devices\n"
+					"  --load-codecs=LIST\tcomma-separated list of load codecs\n"
+					"  --load-stats=SEC\tload statistics report interval\n",
 					argv[0]);
 			return EXIT_SUCCESS;
 		case 'B' /* --dbus=NAME */ :
@@ -492,6 +807,20 @@ int main(int argc, char *argv[]) {
 		case 7 /* --fuzzing */ :
 			fuzzing = true;
 			break;
+		case 8 /* --a2dp-loopback */ :
+			a2dp_loopback = true;
+			a2dp_source = true;
+			a2dp_sink = true;
+			break;
+		case 9 /* --load-devices=NUM */ :
+			load_devices = atoi(optarg);
+			break;
+		case 10 /* --load-codecs=LIST */ :
+			load_codecs = optarg;
+			break;
+		case 11 /* --load-stats=SEC */ :
+			load_stats_interval = atoi(optarg);
+			break;
 		default:
 			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
 			return EXIT_FAILURE;
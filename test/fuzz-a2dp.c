@@ -0,0 +1,222 @@
+/*
+ * fuzz-a2dp.c
+ * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+/*
+ * Fuzzing harness for the A2DP sink IO threads. The first byte of the input
+ * selects the codec (see the codecs[] array below). The rest of the input is
+ * a sequence of BT packets, each one preceded with its length encoded as a
+ * 16-bit big-endian integer. Packets are delivered to the sink IO thread via
+ * the SEQPACKET socket, exactly as BlueZ does it.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../src/a2dp.c"
+#include "../src/a2dp-audio.c"
+#include "../src/a2dp-capture.c"
+#include "../src/at.c"
+#include "../src/audio.c"
+#include "../src/ba-adapter.c"
+#include "../src/ba-device.c"
+#include "../src/ba-transport.c"
+#include "../src/bluealsa.c"
+#if ENABLE_APTX || ENABLE_APTX_HD
+# include "../src/codec-aptx.c"
+#endif
+#if ENABLE_MSBC
+# include "../src/codec-msbc.c"
+#endif
+#include "../src/codec-sbc.c"
+#include "../src/dbus.c"
+#include "../src/hci.c"
+#include "../src/sco.c"
+#include "../src/utils.c"
+#include "../src/shared/ffb.c"
+#include "../src/shared/log.c"
+#include "../src/shared/mempool.c"
+#include "../src/shared/rt.c"
+
+#include "inc/fuzz.inc"
+
+unsigned int bluealsa_dbus_pcm_register(struct ba_transport_pcm *pcm, GError **error) {
+	debug("%s: %p", __func__, (void *)pcm); (void)error; return 0; }
+void bluealsa_dbus_pcm_update(struct ba_transport_pcm *pcm, unsigned int mask) {
+	debug("%s: %p %#x", __func__, (void *)pcm, mask); }
+void bluealsa_dbus_pcm_unregister(struct ba_transport_pcm *pcm) {
+	debug("%s: %p", __func__, (void *)pcm); }
+struct ba_rfcomm *ba_rfcomm_new(struct ba_transport *sco, int fd) {
+	debug("%s: %p", __func__, (void *)sco); (void)fd; return NULL; }
+void ba_rfcomm_destroy(struct ba_rfcomm *r) {
+	debug("%s: %p", __func__, (void *)r); }
+int ba_rfcomm_send_signal(struct ba_rfcomm *r, enum ba_rfcomm_signal sig) {
+	debug("%s: %p: %#x", __func__, (void *)r, sig); return 0; }
+bool bluez_a2dp_set_configuration(const char *current_dbus_sep_path,
+		const struct a2dp_sep *sep, GError **error) {
+	debug("%s: %s", __func__, current_dbus_sep_path); (void)sep;
+	(void)error; return false; }
+
+static const a2dp_sbc_t config_sbc_44100_stereo = {
+	.frequency = SBC_SAMPLING_FREQ_44100,
+	.channel_mode = SBC_CHANNEL_MODE_STEREO,
+	.block_length = SBC_BLOCK_LENGTH_16,
+	.subbands = SBC_SUBBANDS_8,
+	.allocation_method = SBC_ALLOCATION_LOUDNESS,
+	.min_bitpool = SBC_MIN_BITPOOL,
+	.max_bitpool = SBC_MAX_BITPOOL,
+};
+
+static const a2dp_mpeg_t config_mp3_44100_stereo = {
+	.layer = MPEG_LAYER_MP3,
+	.channel_mode = MPEG_CHANNEL_MODE_STEREO,
+	.frequency = MPEG_SAMPLING_FREQ_44100,
+	.vbr = 1,
+	MPEG_INIT_BITRATE(0xFFFF)
+};
+
+static const a2dp_aac_t config_aac_44100_stereo = {
+	.object_type = AAC_OBJECT_TYPE_MPEG2_AAC_LC,
+	AAC_INIT_FREQUENCY(AAC_SAMPLING_FREQ_44100)
+	.channels = AAC_CHANNELS_2,
+	.vbr = 1,
+	AAC_INIT_BITRATE(0xFFFF)
+};
+
+static const a2dp_aptx_t config_aptx_44100_stereo = {
+	.info = A2DP_SET_VENDOR_ID_CODEC_ID(APTX_VENDOR_ID, APTX_CODEC_ID),
+	.frequency = APTX_SAMPLING_FREQ_44100,
+	.channel_mode = APTX_CHANNEL_MODE_STEREO,
+};
+
+static const a2dp_aptx_hd_t config_aptx_hd_44100_stereo = {
+	.aptx.info = A2DP_SET_VENDOR_ID_CODEC_ID(APTX_HD_VENDOR_ID, APTX_HD_CODEC_ID),
+	.aptx.frequency = APTX_SAMPLING_FREQ_44100,
+	.aptx.channel_mode = APTX_CHANNEL_MODE_STEREO,
+};
+
+static const a2dp_ldac_t config_ldac_44100_stereo = {
+	.info = A2DP_SET_VENDOR_ID_CODEC_ID(LDAC_VENDOR_ID, LDAC_CODEC_ID),
+	.frequency = LDAC_SAMPLING_FREQ_44100,
+	.channel_mode = LDAC_CHANNEL_MODE_STEREO,
+};
+
+/**
+ * A2DP sink codecs with decoding support. The selector value is a part of
+ * the seed corpus format, so it shall not be changed for existing codecs. */
+static const struct {
+	uint8_t selector;
+	const struct a2dp_codec *codec;
+	const void *configuration;
+} codecs[] = {
+	{ 0, &a2dp_codec_sink_sbc, &config_sbc_44100_stereo },
+#if ENABLE_MPG123 || ENABLE_MP3LAME
+	{ 1, &a2dp_codec_sink_mpeg, &config_mp3_44100_stereo },
+#endif
+#if ENABLE_AAC
+	{ 2, &a2dp_codec_sink_aac, &config_aac_44100_stereo },
+#endif
+#if ENABLE_APTX && HAVE_APTX_DECODE
+	{ 3, &a2dp_codec_sink_aptx, &config_aptx_44100_stereo },
+#endif
+#if ENABLE_APTX_HD && HAVE_APTX_HD_DECODE
+	{ 4, &a2dp_codec_sink_aptx_hd, &config_aptx_hd_44100_stereo },
+#endif
+#if ENABLE_LDAC && HAVE_LDAC_DECODE
+	{ 5, &a2dp_codec_sink_ldac, &config_ldac_44100_stereo },
+#endif
+};
+
+/* Reading MTU of the fuzzed transport. It is big enough to hold
+ * any A2DP packet which might be received from a real device. */
+#define FUZZ_MTU_READ 1024
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+
+	static struct ba_device *device = NULL;
+	int bt_fds[2];
+
+	if (device == NULL) {
+		bdaddr_t addr = {{ 1, 2, 3, 4, 5, 6 }};
+		struct ba_adapter *adapter = ba_adapter_new(0);
+		device = ba_device_new(adapter, &addr);
+		ba_adapter_unref(adapter);
+	}
+
+	if (size < 1)
+		return 0;
+
+	size_t i;
+	for (i = 0; i < ARRAYSIZE(codecs); i++)
+		if (codecs[i].selector == data[0])
+			break;
+	/* codec not supported in this build */
+	if (i == ARRAYSIZE(codecs))
+		return 0;
+
+	data++, size--;
+
+	struct ba_transport_type ttype = {
+		.profile = BA_TRANSPORT_PROFILE_A2DP_SINK,
+		.codec = codecs[i].codec->codec_id };
+	struct ba_transport *t = ba_transport_new_a2dp(device, ttype, ":fuzz", "/fuzz",
+			codecs[i].codec, codecs[i].configuration);
+
+	/* BT socket is closed by the IO thread upon EOF and there is
+	 * no BlueZ to talk to, so do not call the release callback. */
+	t->release = NULL;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, bt_fds) == -1)
+		goto final;
+
+	t->bt_fd = bt_fds[0];
+	t->mtu_read = FUZZ_MTU_READ;
+	t->a2dp.pcm.fd = open("/dev/null", O_WRONLY);
+
+	if (ba_transport_start(t) == -1) {
+		close(bt_fds[1]);
+		goto final;
+	}
+
+	while (size >= 2) {
+
+		size_t len = (data[0] << 8) | data[1];
+		data += 2, size -= 2;
+
+		if (len > size)
+			len = size;
+
+		/* Zero-length packet would be
+		 * interpreted as a closed connection. */
+		if (len > 0 && write(bt_fds[1], data, len) == -1)
+			break;
+
+		data += len;
+		size -= len;
+
+	}
+
+	/* Signal EOF and wait for the IO thread to process all packets. */
+	close(bt_fds[1]);
+	pthread_join(t->thread_dec.id, NULL);
+	t->thread_dec.id = config.main_thread;
+	t->thread_dec.running = false;
+
+final:
+	ba_transport_destroy(t);
+	return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * fuzz-at.c
+ * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+/*
+ * Fuzzing harness for the AT command parser. The input is treated as data
+ * received from the RFCOMM socket. Every parsed AT message value is also
+ * passed to the specialized value parsers. The same input is fed into the
+ * streaming AT reader in chunks, which sizes are derived from the input, so
+ * AT messages are split at various positions.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/at.c"
+#include "../src/shared/log.c"
+
+#include "inc/fuzz.inc"
+
+static void fuzz_at_value(const struct bt_at *at) {
+
+	bool bia[__HFP_IND_MAX] = { 0 };
+	enum hfp_ind cind[20];
+	unsigned int cmer[5];
+
+	if (at->value == NULL)
+		return;
+
+	at_parse_bia(at->value, bia);
+	at_parse_cind(at->value, cind);
+	at_parse_cmer(at->value, cmer);
+
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+
+	struct at_reader reader;
+	struct bt_at at;
+	char *buffer;
+	char *str;
+	size_t i;
+
+	/* RFCOMM reader operates on null-terminated strings */
+	if ((buffer = malloc(size + 1)) == NULL)
+		return 0;
+	memcpy(buffer, data, size);
+	buffer[size] = '\0';
+
+	for (str = buffer; (str = at_parse(str, &at)) != NULL; ) {
+		fuzz_at_value(&at);
+		if (*str == '\0')
+			break;
+	}
+
+	free(buffer);
+
+	at_reader_init(&reader);
+	for (i = 0; i < size; ) {
+
+		size_t len = 1 + data[i] % 32;
+		if (len > size - i)
+			len = size - i;
+
+		i += at_reader_feed(&reader, &data[i], len);
+
+		int ret;
+		while ((ret = at_reader_next(&reader, &at)) == 0 || errno == EBADMSG)
+			if (ret == 0)
+				fuzz_at_value(&at);
+
+	}
+
+	return 0;
+}
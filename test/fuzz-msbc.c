@@ -0,0 +1,64 @@
+/*
+ * fuzz-msbc.c
+ * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+/*
+ * Fuzzing harness for the eSCO mSBC decoder. The first byte of the input
+ * specifies the size of chunks (eSCO MTU) in which the rest of the input is
+ * delivered to the decoder. Zero means, that the whole remaining input shall
+ * be delivered at once (or as much as fits into the decoder buffer).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/codec-msbc.c"
+#include "../src/codec-sbc.c"
+#include "../src/shared/defs.h"
+#include "../src/shared/ffb.c"
+#include "../src/shared/log.c"
+#include "../src/shared/mempool.c"
+
+#include "inc/fuzz.inc"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+
+	struct esco_msbc msbc = { .initialized = false };
+
+	if (size < 1)
+		return 0;
+
+	size_t mtu = data[0] != 0 ? data[0] : SIZE_MAX;
+	data++, size--;
+
+	if (msbc_init(&msbc) != 0)
+		return 0;
+
+	while (size > 0) {
+
+		size_t len = MIN(MIN(mtu, size), ffb_blen_in(&msbc.data));
+		memcpy(msbc.data.tail, data, len);
+		ffb_seek(&msbc.data, len);
+		data += len;
+		size -= len;
+
+		/* Every non-zero return value means, that at least one byte of
+		 * the input data has been consumed, so this loop will end. */
+		while (msbc_decode(&msbc) != 0)
+			ffb_rewind(&msbc.pcm);
+		ffb_rewind(&msbc.pcm);
+
+	}
+
+	msbc_finish(&msbc);
+	return 0;
+}
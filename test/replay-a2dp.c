@@ -0,0 +1,370 @@
+/*
+ * replay-a2dp.c
+ * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+/*
+ * Replay driver for A2DP captures created with the --a2dp-capture option.
+ *
+ * In the replay mode, encoded audio packets from the capture (received ones
+ * for sink transports, sent ones for source transports) are fed into the A2DP
+ * sink IO thread with the original timing, accelerated timing or as fast as
+ * possible. In the compare mode, packets sent by the source transport are
+ * compared with the reference capture.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/a2dp.c"
+#include "../src/a2dp-audio.c"
+#include "../src/a2dp-capture.c"
+#include "../src/at.c"
+#include "../src/audio.c"
+#include "../src/ba-adapter.c"
+#include "../src/ba-device.c"
+#include "../src/ba-transport.c"
+#include "../src/bluealsa.c"
+#if ENABLE_APTX || ENABLE_APTX_HD
+# include "../src/codec-aptx.c"
+#endif
+#if ENABLE_MSBC
+# include "../src/codec-msbc.c"
+#endif
+#include "../src/codec-sbc.c"
+#include "../src/dbus.c"
+#include "../src/hci.c"
+#include "../src/sco.c"
+#include "../src/utils.c"
+#include "../src/shared/ffb.c"
+#include "../src/shared/log.c"
+#include "../src/shared/mempool.c"
+#include "../src/shared/rt.c"
+
+unsigned int bluealsa_dbus_pcm_register(struct ba_transport_pcm *pcm, GError **error) {
+	debug("%s: %p", __func__, (void *)pcm); (void)error; return 0; }
+void bluealsa_dbus_pcm_update(struct ba_transport_pcm *pcm, unsigned int mask) {
+	debug("%s: %p %#x", __func__, (void *)pcm, mask); }
+void bluealsa_dbus_pcm_unregister(struct ba_transport_pcm *pcm) {
+	debug("%s: %p", __func__, (void *)pcm); }
+struct ba_rfcomm *ba_rfcomm_new(struct ba_transport *sco, int fd) {
+	debug("%s: %p", __func__, (void *)sco); (void)fd; return NULL; }
+void ba_rfcomm_destroy(struct ba_rfcomm *r) {
+	debug("%s: %p", __func__, (void *)r); }
+int ba_rfcomm_send_signal(struct ba_rfcomm *r, enum ba_rfcomm_signal sig) {
+	debug("%s: %p: %#x", __func__, (void *)r, sig); return 0; }
+bool bluez_a2dp_set_configuration(const char *current_dbus_sep_path,
+		const struct a2dp_sep *sep, GError **error) {
+	debug("%s: %s", __func__, current_dbus_sep_path); (void)sep;
+	(void)error; return false; }
+
+static double speed = 1.0;
+static const char *output_file = "/dev/null";
+
+static unsigned long timespec2usec(const struct timespec *ts) {
+	return ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+static unsigned long clock_usec(clockid_t id) {
+	struct timespec ts;
+	clock_gettime(id, &ts);
+	return timespec2usec(&ts);
+}
+
+/**
+ * Get direction of packets with encoded audio stream. */
+static enum a2dp_capture_dir capture_stream_dir(const struct a2dp_capture *c) {
+	if (c->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE)
+		return A2DP_CAPTURE_DIR_TX;
+	return A2DP_CAPTURE_DIR_RX;
+}
+
+/**
+ * Determine whether packets of the given codec have RTP header. */
+static bool codec_uses_rtp(uint16_t codec_id) {
+	return codec_id != A2DP_CODEC_VENDOR_APTX &&
+		codec_id != A2DP_CODEC_VENDOR_FASTSTREAM;
+}
+
+static int replay(const char *path) {
+
+	const struct a2dp_codec *codec;
+	struct a2dp_capture *c;
+	int bt_fds[2] = { -1, -1 };
+	int rv = -1;
+
+	if ((c = a2dp_capture_open_replay(path)) == NULL) {
+		error("Couldn't open capture file: %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	if ((codec = a2dp_codec_lookup(c->codec_id, A2DP_SINK)) == NULL ||
+			codec->capabilities_size != c->configuration_size) {
+		error("Unsupported capture codec: %s",
+				ba_transport_codecs_a2dp_to_string(c->codec_id));
+		goto fail_codec;
+	}
+
+	bdaddr_t addr = {{ 1, 2, 3, 4, 5, 6 }};
+	struct ba_adapter *a = ba_adapter_new(0);
+	struct ba_device *d = ba_device_new(a, &addr);
+	ba_adapter_unref(a);
+
+	struct ba_transport_type ttype = {
+		.profile = BA_TRANSPORT_PROFILE_A2DP_SINK,
+		.codec = c->codec_id };
+	struct ba_transport *t = ba_transport_new_a2dp(d, ttype, ":replay", "/replay",
+			codec, c->configuration);
+	ba_device_unref(d);
+
+	/* there is no BlueZ to talk to */
+	t->release = NULL;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, bt_fds) == -1) {
+		error("Couldn't create BT socket: %s", strerror(errno));
+		goto fail;
+	}
+
+	t->bt_fd = bt_fds[0];
+	t->mtu_read = capture_stream_dir(c) == A2DP_CAPTURE_DIR_TX ?
+		c->mtu_write : c->mtu_read;
+
+	if ((t->a2dp.pcm.fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+		error("Couldn't open output file: %s: %s", output_file, strerror(errno));
+		goto fail;
+	}
+
+	const unsigned long cpu_usec_process = clock_usec(CLOCK_PROCESS_CPUTIME_ID);
+	const unsigned long cpu_usec_thread = clock_usec(CLOCK_THREAD_CPUTIME_ID);
+
+	if (ba_transport_start(t) == -1) {
+		error("Couldn't start transport: %s", strerror(errno));
+		goto fail;
+	}
+
+	uint8_t buffer[1024 * 4];
+	enum a2dp_capture_dir dir;
+	struct timespec ts0, ts;
+	unsigned long prev_usec = 0;
+	double interval_sum = 0, interval_sum2 = 0;
+	size_t packets = 0;
+	size_t bytes = 0;
+	ssize_t len;
+
+	gettimestamp(&ts0);
+	while ((len = a2dp_capture_read(c, &dir, &ts, buffer, sizeof(buffer))) > 0) {
+
+		if (dir != capture_stream_dir(c))
+			continue;
+
+		const unsigned long usec = timespec2usec(&ts);
+		if (packets > 0) {
+			const double delta = (double)usec - prev_usec;
+			interval_sum += delta;
+			interval_sum2 += delta * delta;
+		}
+		prev_usec = usec;
+
+		if (speed > 0) {
+			/* wait until the packet time-stamp (scaled by the speed) */
+			struct timespec now, target = ts0;
+			const unsigned long delay = usec / speed;
+			target.tv_sec += delay / 1000000;
+			target.tv_nsec += (delay % 1000000) * 1000;
+			if (target.tv_nsec >= 1000000000)
+				target.tv_sec++, target.tv_nsec -= 1000000000;
+			gettimestamp(&now);
+			if (difftimespec(&now, &target, &now) > 0)
+				nanosleep(&now, NULL);
+		}
+
+		if (send(bt_fds[1], buffer, len, MSG_NOSIGNAL) == -1) {
+			error("BT socket write error: %s", strerror(errno));
+			break;
+		}
+
+		packets++;
+		bytes += len;
+
+	}
+
+	/* Signal EOF and wait for the IO thread to decode all packets. */
+	close(bt_fds[1]);
+	bt_fds[1] = -1;
+	pthread_join(t->thread_dec.id, NULL);
+	t->thread_dec.id = config.main_thread;
+	t->thread_dec.running = false;
+
+	gettimestamp(&ts);
+	difftimespec(&ts0, &ts, &ts);
+
+	const unsigned long decode_cpu_usec =
+		(clock_usec(CLOCK_PROCESS_CPUTIME_ID) - cpu_usec_process) -
+		(clock_usec(CLOCK_THREAD_CPUTIME_ID) - cpu_usec_thread);
+
+	double interval_mean = 0, interval_stddev = 0;
+	if (packets > 1) {
+		interval_mean = interval_sum / (packets - 1);
+		interval_stddev = sqrt(fmax(0, interval_sum2 / (packets - 1) - interval_mean * interval_mean));
+	}
+
+	printf("Codec: %s\n", ba_transport_codecs_a2dp_to_string(c->codec_id));
+	printf("Packets: %zu (%zu bytes)\n", packets, bytes);
+	printf("Capture duration: %.3f s\n", prev_usec / 1e6);
+	printf("Replay duration: %.3f s\n", timespec2usec(&ts) / 1e6);
+	printf("Packet interval: mean %.0f us, stddev %.0f us\n", interval_mean, interval_stddev);
+	printf("Decoder CPU time: %lu us\n", decode_cpu_usec);
+
+	rv = 0;
+
+fail:
+	if (bt_fds[1] != -1)
+		close(bt_fds[1]);
+	ba_transport_destroy(t);
+fail_codec:
+	a2dp_capture_close(c);
+	return rv;
+}
+
+/**
+ * Read next packet with encoded audio stream. */
+static ssize_t compare_read_next(struct a2dp_capture *c, void *buffer, size_t size) {
+	enum a2dp_capture_dir dir;
+	struct timespec ts;
+	ssize_t len;
+	while ((len = a2dp_capture_read(c, &dir, &ts, buffer, size)) > 0)
+		if (dir == capture_stream_dir(c))
+			break;
+	return len;
+}
+
+static int compare(const char *path, const char *path_ref) {
+
+	struct a2dp_capture *c = NULL, *c_ref = NULL;
+	int rv = -1;
+
+	if ((c = a2dp_capture_open_replay(path)) == NULL) {
+		error("Couldn't open capture file: %s: %s", path, strerror(errno));
+		goto final;
+	}
+	if ((c_ref = a2dp_capture_open_replay(path_ref)) == NULL) {
+		error("Couldn't open capture file: %s: %s", path_ref, strerror(errno));
+		goto final;
+	}
+
+	if (c->codec_id != c_ref->codec_id ||
+			c->configuration_size != c_ref->configuration_size ||
+			memcmp(c->configuration, c_ref->configuration, c->configuration_size) != 0) {
+		printf("Codec configuration mismatch\n");
+		rv = 1;
+		goto final;
+	}
+
+	/* RTP sequence number and time-stamp are randomized upon every
+	 * transport start, so they are excluded from the comparison. */
+	const size_t skip = codec_uses_rtp(c->codec_id) ? RTP_HEADER_LEN : 0;
+
+	uint8_t buffer[1024 * 4], buffer_ref[1024 * 4];
+	size_t packets = 0, mismatches = 0;
+	ssize_t len, len_ref;
+
+	for (;;) {
+
+		len = compare_read_next(c, buffer, sizeof(buffer));
+		len_ref = compare_read_next(c_ref, buffer_ref, sizeof(buffer_ref));
+		if (len <= 0 || len_ref <= 0)
+			break;
+
+		if (len != len_ref || (size_t)len < skip ||
+				memcmp(buffer + skip, buffer_ref + skip, len - skip) != 0) {
+			if (mismatches++ == 0)
+				printf("First mismatch at packet: %zu\n", packets);
+		}
+
+		packets++;
+
+	}
+
+	if (len == -1 || len_ref == -1) {
+		error("Couldn't read capture: %s", strerror(errno));
+		goto final;
+	}
+
+	if (len != len_ref) {
+		printf("Number of packets mismatch\n");
+		mismatches++;
+	}
+
+	printf("Compared packets: %zu\n", packets);
+	printf("Mismatched packets: %zu\n", mismatches);
+	rv = mismatches == 0 ? 0 : 1;
+
+final:
+	a2dp_capture_close(c);
+	a2dp_capture_close(c_ref);
+	return rv;
+}
+
+int main(int argc, char *argv[]) {
+
+	int opt;
+	const char *opts = "hs:o:c:";
+	struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "speed", required_argument, NULL, 's' },
+		{ "output", required_argument, NULL, 'o' },
+		{ "compare", required_argument, NULL, 'c' },
+		{ 0, 0, 0, 0 },
+	};
+
+	const char *compare_ref = NULL;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */ :
+			printf("usage: %s [--speed=X] [--output=FILE] [--compare=REF] CAPTURE\n"
+					"  -s, --speed=X\t\treplay speed factor (0 - no pacing)\n"
+					"  -o, --output=FILE\twrite decoded PCM to FILE\n"
+					"  -c, --compare=REF\tcompare source output with REF capture\n",
+					argv[0]);
+			return 0;
+		case 's' /* --speed=X */ :
+			speed = atof(optarg);
+			break;
+		case 'o' /* --output=FILE */ :
+			output_file = optarg;
+			break;
+		case 'c' /* --compare=REF */ :
+			compare_ref = optarg;
+			break;
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return 1;
+		}
+
+	if (optind + 1 != argc) {
+		fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+		return 1;
+	}
+
+	if (compare_ref != NULL)
+		return compare(argv[optind], compare_ref) == 0 ? 0 : 1;
+
+	return replay(argv[optind]) == 0 ? 0 : 1;
+}
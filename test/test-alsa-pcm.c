@@ -36,6 +36,7 @@
 #include "../src/shared/defs.h"
 #include "../src/shared/ffb.c"
 #include "../src/shared/log.c"
+#include "../src/shared/mempool.c"
 #include "../src/shared/rt.c"
 
 #define dumprv(fn) fprintf(stderr, #fn " = %d\n", (int)fn)
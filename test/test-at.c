@@ -8,6 +8,9 @@
  *
  */
 
+#include <errno.h>
+#include <string.h>
+
 #include <check.h>
 
 #include "../src/at.c"
@@ -34,17 +37,22 @@ START_TEST(test_at_build) {
 
 START_TEST(test_at_parse_invalid) {
 	struct bt_at at;
+	char str1[] = "ABC\r";
+	char str2[] = "AT+CLCK?";
+	char str3[] = "\r\r";
+	char str4[] = "\r\nOK";
 	/* invalid AT command lines */
-	ck_assert_ptr_eq(at_parse("ABC\r", &at), NULL);
-	ck_assert_ptr_eq(at_parse("AT+CLCK?", &at), NULL);
-	ck_assert_ptr_eq(at_parse("\r\r", &at), NULL);
-	ck_assert_ptr_eq(at_parse("\r\nOK", &at), NULL);
+	ck_assert_ptr_eq(at_parse(str1, &at), NULL);
+	ck_assert_ptr_eq(at_parse(str2, &at), NULL);
+	ck_assert_ptr_eq(at_parse(str3, &at), NULL);
+	ck_assert_ptr_eq(at_parse(str4, &at), NULL);
 } END_TEST
 
 START_TEST(test_at_parse_cmd) {
 	struct bt_at at;
+	char str[] = "AT+CLCC\r";
 	/* parse AT plain command */
-	ck_assert_ptr_ne(at_parse("AT+CLCC\r", &at), NULL);
+	ck_assert_ptr_ne(at_parse(str, &at), NULL);
 	ck_assert_int_eq(at.type, AT_TYPE_CMD);
 	ck_assert_str_eq(at.command, "+CLCC");
 	ck_assert_ptr_eq(at.value, NULL);
@@ -52,8 +60,9 @@ START_TEST(test_at_parse_cmd) {
 
 START_TEST(test_at_parse_cmd_get) {
 	struct bt_at at;
+	char str[] = "AT+COPS?\r";
 	/* parse AT GET command */
-	ck_assert_ptr_ne(at_parse("AT+COPS?\r", &at), NULL);
+	ck_assert_ptr_ne(at_parse(str, &at), NULL);
 	ck_assert_int_eq(at.type, AT_TYPE_CMD_GET);
 	ck_assert_str_eq(at.command, "+COPS");
 	ck_assert_ptr_eq(at.value, NULL);
@@ -61,8 +70,9 @@ START_TEST(test_at_parse_cmd_get) {
 
 START_TEST(test_at_parse_cmd_set) {
 	struct bt_at at;
+	char str[] = "AT+CLCK=\"SC\",0,\"1234\"\r";
 	/* parse AT SET command */
-	ck_assert_ptr_ne(at_parse("AT+CLCK=\"SC\",0,\"1234\"\r", &at), NULL);
+	ck_assert_ptr_ne(at_parse(str, &at), NULL);
 	ck_assert_int_eq(at.type, AT_TYPE_CMD_SET);
 	ck_assert_str_eq(at.command, "+CLCK");
 	ck_assert_str_eq(at.value, "\"SC\",0,\"1234\"");
@@ -70,8 +80,9 @@ START_TEST(test_at_parse_cmd_set) {
 
 START_TEST(test_at_parse_cmd_test) {
 	struct bt_at at;
+	char str[] = "AT+COPS=?\r";
 	/* parse AT TEST command */
-	ck_assert_ptr_ne(at_parse("AT+COPS=?\r", &at), NULL);
+	ck_assert_ptr_ne(at_parse(str, &at), NULL);
 	ck_assert_int_eq(at.type, AT_TYPE_CMD_TEST);
 	ck_assert_str_eq(at.command, "+COPS");
 	ck_assert_ptr_eq(at.value, NULL);
@@ -79,8 +90,9 @@ START_TEST(test_at_parse_cmd_test) {
 
 START_TEST(test_at_parse_resp) {
 	struct bt_at at;
+	char str[] = "\r\n+CIND:0,0,1,4,0,4,0\r\n";
 	/* parse response result code */
-	ck_assert_ptr_ne(at_parse("\r\n+CIND:0,0,1,4,0,4,0\r\n", &at), NULL);
+	ck_assert_ptr_ne(at_parse(str, &at), NULL);
 	ck_assert_int_eq(at.type, AT_TYPE_RESP);
 	ck_assert_str_eq(at.command, "+CIND");
 	ck_assert_str_eq(at.value, "0,0,1,4,0,4,0");
@@ -88,8 +100,9 @@ START_TEST(test_at_parse_resp) {
 
 START_TEST(test_at_parse_resp_empty) {
 	struct bt_at at;
+	char str[] = "\r\n+CIND:\r\n";
 	/* parse response result code with empty value */
-	ck_assert_ptr_ne(at_parse("\r\n+CIND:\r\n", &at), NULL);
+	ck_assert_ptr_ne(at_parse(str, &at), NULL);
 	ck_assert_int_eq(at.type, AT_TYPE_RESP);
 	ck_assert_str_eq(at.command, "+CIND");
 	ck_assert_str_eq(at.value, "");
@@ -97,8 +110,9 @@ START_TEST(test_at_parse_resp_empty) {
 
 START_TEST(test_at_parse_resp_unsolicited) {
 	struct bt_at at;
+	char str[] = "\r\nRING\r\n";
 	/* parse unsolicited result code */
-	ck_assert_ptr_ne(at_parse("\r\nRING\r\n", &at), NULL);
+	ck_assert_ptr_ne(at_parse(str, &at), NULL);
 	ck_assert_int_eq(at.type, AT_TYPE_RESP);
 	ck_assert_str_eq(at.command, "");
 	ck_assert_str_eq(at.value, "RING");
@@ -106,8 +120,9 @@ START_TEST(test_at_parse_resp_unsolicited) {
 
 START_TEST(test_at_parse_case_sensitivity) {
 	struct bt_at at;
+	char str[] = "aT+tEsT=VaLuE\r";
 	/* case-insensitive command and case-sensitive value */
-	ck_assert_ptr_ne(at_parse("aT+tEsT=VaLuE\r", &at), NULL);
+	ck_assert_ptr_ne(at_parse(str, &at), NULL);
 	ck_assert_int_eq(at.type, AT_TYPE_CMD_SET);
 	ck_assert_str_eq(at.command, "+TEST");
 	ck_assert_str_eq(at.value, "VaLuE");
@@ -116,13 +131,131 @@ START_TEST(test_at_parse_case_sensitivity) {
 START_TEST(test_at_parse_multiple_cmds) {
 	struct bt_at at;
 	/* concatenated commands */
-	const char *cmd = "\r\nOK\r\n\r\n+COPS:1\r\n";
+	char cmd[] = "\r\nOK\r\n\r\n+COPS:1\r\n";
 	ck_assert_str_eq(at_parse(cmd, &at), &cmd[6]);
 	ck_assert_int_eq(at.type, AT_TYPE_RESP);
 	ck_assert_str_eq(at.command, "");
 	ck_assert_str_eq(at.value, "OK");
 } END_TEST
 
+START_TEST(test_at_reader_coalesced) {
+
+	struct at_reader reader;
+	struct bt_at at;
+
+	at_reader_init(&reader);
+	const char *data = "AT+BRSF=756\rAT+BAC=1,2\r\r\nOK\r\n\r\n+CIEV:1,0\r\n";
+	ck_assert_uint_eq(at_reader_feed(&reader, data, strlen(data)), strlen(data));
+
+	ck_assert_int_eq(at_reader_next(&reader, &at), 0);
+	ck_assert_int_eq(at.type, AT_TYPE_CMD_SET);
+	ck_assert_str_eq(at.command, "+BRSF");
+	ck_assert_str_eq(at.value, "756");
+
+	ck_assert_int_eq(at_reader_next(&reader, &at), 0);
+	ck_assert_int_eq(at.type, AT_TYPE_CMD_SET);
+	ck_assert_str_eq(at.command, "+BAC");
+	ck_assert_str_eq(at.value, "1,2");
+
+	ck_assert_int_eq(at_reader_next(&reader, &at), 0);
+	ck_assert_int_eq(at.type, AT_TYPE_RESP);
+	ck_assert_str_eq(at.command, "");
+	ck_assert_str_eq(at.value, "OK");
+
+	ck_assert_int_eq(at_reader_next(&reader, &at), 0);
+	ck_assert_int_eq(at.type, AT_TYPE_RESP);
+	ck_assert_str_eq(at.command, "+CIEV");
+	ck_assert_str_eq(at.value, "1,0");
+
+	ck_assert_int_eq(at_reader_next(&reader, &at), -1);
+	ck_assert_int_eq(errno, EAGAIN);
+
+} END_TEST
+
+START_TEST(test_at_reader_split) {
+
+	struct at_reader reader;
+	struct bt_at at;
+	size_t i;
+
+	at_reader_init(&reader);
+	const char *data = "\r\n+CIND:0,0,1\r\nAT+VGS=7\r";
+
+	/* feed data one byte at a time */
+	for (i = 0; i < 13; i++) {
+		ck_assert_uint_eq(at_reader_feed(&reader, &data[i], 1), 1);
+		ck_assert_int_eq(at_reader_next(&reader, &at), -1);
+		ck_assert_int_eq(errno, EAGAIN);
+	}
+
+	ck_assert_uint_eq(at_reader_feed(&reader, &data[i++], 1), 1);
+	ck_assert_int_eq(at_reader_next(&reader, &at), 0);
+	ck_assert_int_eq(at.type, AT_TYPE_RESP);
+	ck_assert_str_eq(at.command, "+CIND");
+	ck_assert_str_eq(at.value, "0,0,1");
+
+	/* trailing <LF> of the response received in a separate chunk */
+	for (; i < strlen(data) - 1; i++) {
+		ck_assert_uint_eq(at_reader_feed(&reader, &data[i], 1), 1);
+		ck_assert_int_eq(at_reader_next(&reader, &at), -1);
+		ck_assert_int_eq(errno, EAGAIN);
+	}
+
+	ck_assert_uint_eq(at_reader_feed(&reader, &data[i], 1), 1);
+	ck_assert_int_eq(at_reader_next(&reader, &at), 0);
+	ck_assert_int_eq(at.type, AT_TYPE_CMD_SET);
+	ck_assert_str_eq(at.command, "+VGS");
+	ck_assert_str_eq(at.value, "7");
+
+} END_TEST
+
+START_TEST(test_at_reader_invalid) {
+
+	struct at_reader reader;
+	struct bt_at at;
+
+	at_reader_init(&reader);
+	const char *data = "\r\nOK\r\nABC\rAT+CLCC\r";
+	at_reader_feed(&reader, data, strlen(data));
+
+	ck_assert_int_eq(at_reader_next(&reader, &at), 0);
+	ck_assert_str_eq(at.value, "OK");
+
+	/* response without leading <LF> shall be rejected */
+	ck_assert_int_eq(at_reader_next(&reader, &at), -1);
+	ck_assert_int_eq(errno, EBADMSG);
+
+	ck_assert_int_eq(at_reader_next(&reader, &at), 0);
+	ck_assert_int_eq(at.type, AT_TYPE_CMD);
+	ck_assert_str_eq(at.command, "+CLCC");
+
+} END_TEST
+
+START_TEST(test_at_reader_overflow) {
+
+	struct at_reader reader;
+	struct bt_at at;
+	char data[sizeof(reader.buffer)];
+
+	at_reader_init(&reader);
+	memset(data, 'X', sizeof(data));
+	memcpy(data, "AT+LONG=", 8);
+
+	ck_assert_uint_eq(at_reader_feed(&reader, data, sizeof(data)), sizeof(data));
+	ck_assert_int_eq(at_reader_next(&reader, &at), -1);
+	ck_assert_int_eq(errno, EAGAIN);
+
+	/* too long message shall be discarded */
+	ck_assert_uint_eq(at_reader_feed(&reader, "XX\rAT+BCC\r", 10), 10);
+	ck_assert_int_eq(at_reader_next(&reader, &at), -1);
+	ck_assert_int_eq(errno, EBADMSG);
+
+	ck_assert_int_eq(at_reader_next(&reader, &at), 0);
+	ck_assert_int_eq(at.type, AT_TYPE_CMD);
+	ck_assert_str_eq(at.command, "+BCC");
+
+} END_TEST
+
 START_TEST(test_at_parse_bia) {
 
 	const bool state_ok1[__HFP_IND_MAX] = { 0, true, true, true, true, true, true, true };
@@ -218,6 +351,10 @@ int main(void) {
 	tcase_add_test(tc, test_at_parse_resp_unsolicited);
 	tcase_add_test(tc, test_at_parse_case_sensitivity);
 	tcase_add_test(tc, test_at_parse_multiple_cmds);
+	tcase_add_test(tc, test_at_reader_coalesced);
+	tcase_add_test(tc, test_at_reader_split);
+	tcase_add_test(tc, test_at_reader_invalid);
+	tcase_add_test(tc, test_at_reader_overflow);
 	tcase_add_test(tc, test_at_parse_bia);
 	tcase_add_test(tc, test_at_parse_cind);
 	tcase_add_test(tc, test_at_parse_cmer);
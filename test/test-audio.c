@@ -81,6 +81,106 @@ START_TEST(test_audio_scale_s32_4le) {
 
 } END_TEST
 
+START_TEST(test_audio_s16_2le_to_s32_4le) {
+
+	const int16_t in[] = { 0, 1, -1, 0x7FFF, -0x8000 };
+	const int32_t out[] = { 0, 0x10000, -0x10000, 0x7FFF0000, INT32_MIN };
+	int32_t tmp[ARRAYSIZE(out)];
+
+	audio_s16_2le_to_s32_4le(tmp, in, ARRAYSIZE(tmp));
+	ck_assert_int_eq(memcmp(tmp, out, sizeof(out)), 0);
+
+} END_TEST
+
+START_TEST(test_audio_s24_4le_to_s32_4le) {
+
+	const int32_t in[] = { 0, 1, -1, 0x7FFFFF, -0x800000 };
+	const int32_t out[] = { 0, 0x100, -0x100, 0x7FFFFF00, INT32_MIN };
+	int32_t tmp[ARRAYSIZE(out)];
+
+	audio_s24_4le_to_s32_4le(tmp, in, ARRAYSIZE(tmp));
+	ck_assert_int_eq(memcmp(tmp, out, sizeof(out)), 0);
+
+} END_TEST
+
+START_TEST(test_audio_s32_4le_to_s16_2le_dither) {
+
+	struct audio_dither dither;
+	int32_t in[4096];
+	int16_t out[ARRAYSIZE(in)];
+	size_t i;
+
+	for (int noise_shaping = 0; noise_shaping <= 1; noise_shaping++) {
+
+		/* signal which is representable in 16 bits is not altered by more
+		 * than 1 LSB and there is no bias */
+		audio_dither_init(&dither, noise_shaping);
+		for (i = 0; i < ARRAYSIZE(in); i++)
+			in[i] = 100 * 0x10000;
+		audio_s32_4le_to_s16_2le_dither(out, in, 2, ARRAYSIZE(in), &dither);
+		long sum = 0;
+		for (i = 0; i < ARRAYSIZE(out); i++) {
+			ck_assert_int_ge(out[i], 100 - 1 - noise_shaping);
+			ck_assert_int_le(out[i], 100 + 1 + noise_shaping);
+			sum += out[i];
+		}
+		ck_assert_int_eq((sum + ARRAYSIZE(out) / 2) / ARRAYSIZE(out), 100);
+
+		/* fraction of LSB is preserved on average, which would be truncated
+		 * to zero without the dither */
+		audio_dither_init(&dither, noise_shaping);
+		for (i = 0; i < ARRAYSIZE(in); i++)
+			in[i] = 0x4000;
+		audio_s32_4le_to_s16_2le_dither(out, in, 1, ARRAYSIZE(in), &dither);
+		sum = 0;
+		for (i = 0; i < ARRAYSIZE(out); i++)
+			sum += out[i];
+		ck_assert_int_gt(sum, ARRAYSIZE(out) * 0.2);
+		ck_assert_int_lt(sum, ARRAYSIZE(out) * 0.3);
+
+		/* full-scale signal is clipped without overflow */
+		const int32_t in_clip[] = { INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN };
+		int16_t out_clip[ARRAYSIZE(in_clip)];
+		audio_dither_init(&dither, noise_shaping);
+		audio_s32_4le_to_s16_2le_dither(out_clip, in_clip, 2, ARRAYSIZE(in_clip), &dither);
+		for (i = 0; i < ARRAYSIZE(out_clip); i++)
+			ck_assert_int_ge(abs(out_clip[i]), INT16_MAX - 1);
+
+	}
+
+} END_TEST
+
+START_TEST(test_audio_downsample_2x_s16_2le) {
+
+	const int16_t in[] = { 100, 200, -300, -100, 0x7FFF, 0x7FFF, -0x8000, -0x8000 };
+	const int16_t out[] = { 150, -200, 0x7FFF, -0x8000 };
+	int16_t tmp[ARRAYSIZE(out)];
+
+	audio_downsample_2x_s16_2le(tmp, in, ARRAYSIZE(tmp));
+	ck_assert_int_eq(memcmp(tmp, out, sizeof(out)), 0);
+
+} END_TEST
+
+START_TEST(test_audio_upsample_2x_s16_2le) {
+
+	const int16_t in1[] = { 100, 300 };
+	const int16_t in2[] = { -100 };
+	const int16_t out1[] = { 50, 100, 200, 300 };
+	const int16_t out2[] = { 100, -100 };
+	int16_t last = 0;
+	int16_t tmp[4];
+
+	audio_upsample_2x_s16_2le(tmp, in1, ARRAYSIZE(in1), &last);
+	ck_assert_int_eq(memcmp(tmp, out1, sizeof(out1)), 0);
+	ck_assert_int_eq(last, 300);
+
+	/* interpolation shall continue across calls */
+	audio_upsample_2x_s16_2le(tmp, in2, ARRAYSIZE(in2), &last);
+	ck_assert_int_eq(memcmp(tmp, out2, sizeof(out2)), 0);
+	ck_assert_int_eq(last, -100);
+
+} END_TEST
+
 int main(void) {
 
 	Suite *s = suite_create(__FILE__);
@@ -91,6 +191,11 @@ int main(void) {
 
 	tcase_add_test(tc, test_audio_scale_s16_2le);
 	tcase_add_test(tc, test_audio_scale_s32_4le);
+	tcase_add_test(tc, test_audio_s16_2le_to_s32_4le);
+	tcase_add_test(tc, test_audio_s24_4le_to_s32_4le);
+	tcase_add_test(tc, test_audio_s32_4le_to_s16_2le_dither);
+	tcase_add_test(tc, test_audio_downsample_2x_s16_2le);
+	tcase_add_test(tc, test_audio_upsample_2x_s16_2le);
 
 	srunner_run_all(sr, CK_ENV);
 	int nf = srunner_ntests_failed(sr);
@@ -24,8 +24,11 @@
 #include "../src/hci.c"
 #include "../src/utils.c"
 #include "../src/shared/log.c"
+#include "../src/shared/mempool.c"
+#include "../src/shared/rt.c"
 
 int a2dp_audio_thread_create(struct ba_transport *t) { (void)t; return 0; }
+void a2dp_capture_close(struct a2dp_capture *c) { (void)c; }
 void *ba_rfcomm_thread(struct ba_transport *t) { (void)t; return 0; }
 void *sco_thread(struct ba_transport_thread *th) { (void)th; return 0; }
 unsigned int bluealsa_dbus_pcm_register(struct ba_transport_pcm *pcm, GError **error) {
@@ -86,6 +89,57 @@ START_TEST(test_ba_device) {
 
 } END_TEST
 
+START_TEST(test_ba_device_indicator) {
+
+	struct ba_adapter *a;
+	struct ba_device *d;
+	struct ba_device_indicator event;
+	struct ba_device_indicator history[BA_DEVICE_INDICATOR_HISTORY_SIZE];
+	size_t i;
+
+	ck_assert_ptr_ne(a = ba_adapter_new(0), NULL);
+	bdaddr_t addr = {{ 0x12, 0x34, 0x56, 0x78, 0x90, 0xAB }};
+	ck_assert_ptr_ne(d = ba_device_new(a, &addr), NULL);
+	ba_adapter_unref(a);
+
+	ck_assert_int_eq(ba_device_indicator_history(d, history, ARRAYSIZE(history)), 0);
+
+	/* battery indicator updates device battery level */
+	ck_assert_int_eq(ba_device_indicator_update(d, HFP_IND_BATTCHG, 60, &event), true);
+	ck_assert_int_eq(event.ind, HFP_IND_BATTCHG);
+	ck_assert_int_eq(event.value, 60);
+	ck_assert_uint_gt(event.timestamp, 0);
+	ck_assert_int_eq(d->battery_level, 60);
+
+	/* unchanged value shall not be recorded */
+	ck_assert_int_eq(ba_device_indicator_update(d, HFP_IND_BATTCHG, 60, NULL), false);
+	ck_assert_int_eq(ba_device_indicator_update(d, HFP_IND_NULL, 1, NULL), false);
+	ck_assert_int_eq(ba_device_indicator_update(d, HFP_IND_SIGNAL, 4, NULL), true);
+
+	ck_assert_int_eq(ba_device_indicator_history(d, history, ARRAYSIZE(history)), 2);
+	ck_assert_int_eq(history[0].ind, HFP_IND_BATTCHG);
+	ck_assert_int_eq(history[1].ind, HFP_IND_SIGNAL);
+	ck_assert_int_eq(history[1].value, 4);
+
+	/* overflow history, the oldest entries shall be dropped */
+	for (i = 0; i < ARRAYSIZE(history) + 3; i++)
+		ba_device_indicator_update(d, HFP_IND_SIGNAL, i % 2, NULL);
+	ck_assert_int_eq(ba_device_indicator_history(d, history, ARRAYSIZE(history)), ARRAYSIZE(history));
+	ck_assert_int_eq(history[0].ind, HFP_IND_SIGNAL);
+	ck_assert_int_eq(history[ARRAYSIZE(history) - 1].value, (ARRAYSIZE(history) + 2) % 2);
+
+	/* partial history shall contain the most recent entries */
+	ck_assert_int_eq(ba_device_indicator_history(d, history, 2), 2);
+	ck_assert_int_eq(history[1].value, (ARRAYSIZE(history) + 2) % 2);
+	ck_assert_uint_le(history[0].timestamp, history[1].timestamp);
+
+	ck_assert_str_eq(ba_device_indicator_to_string(HFP_IND_BATTCHG), "battery");
+	ck_assert_ptr_eq(ba_device_indicator_to_string(HFP_IND_NULL), NULL);
+
+	ba_device_unref(d);
+
+} END_TEST
+
 START_TEST(test_ba_transport) {
 
 	struct ba_adapter *a;
@@ -176,6 +230,114 @@ START_TEST(test_ba_transport_pcm_volume) {
 
 } END_TEST
 
+START_TEST(test_ba_transport_bitrate) {
+
+	struct ba_adapter *a;
+	struct ba_device *d;
+	struct ba_transport *t1, *t2;
+	bdaddr_t addr = { 0 };
+
+	ck_assert_ptr_ne(a = ba_adapter_new(0), NULL);
+	ck_assert_ptr_ne(d = ba_device_new(a, &addr), NULL);
+	ck_assert_ptr_ne(t1 = transport_new(d, "/owner", "/path/1"), NULL);
+	ck_assert_ptr_ne(t2 = transport_new(d, "/owner", "/path/2"), NULL);
+
+	/* no traffic at all */
+	ck_assert_uint_eq(ba_adapter_get_bitrate(a, NULL), 0);
+
+	/* start the estimation window one second in the past */
+	ba_transport_stats_update(t1);
+	t1->stats.bt_bitrate_ts.tv_sec -= 1;
+	t1->stats.bt_tx_bytes = 12500;
+	ba_transport_stats_update(t1);
+	ck_assert_uint_le(ba_transport_get_bitrate(t1), 100000);
+	ck_assert_uint_gt(ba_transport_get_bitrate(t1), 99000);
+
+	t1->stats.bt_bitrate = 100000;
+	gettimestamp(&t2->stats.bt_bitrate_ts);
+	t2->stats.bt_bitrate = 200000;
+
+	ck_assert_uint_eq(ba_adapter_get_bitrate(a, NULL), 300000);
+	ck_assert_uint_eq(ba_adapter_get_bitrate(a, t2), 100000);
+
+	/* stale estimation shall not be taken into account */
+	t2->stats.bt_bitrate_ts.tv_sec -= 2;
+	ck_assert_uint_eq(ba_adapter_get_bitrate(a, NULL), 100000);
+
+	ba_adapter_unref(a);
+	ba_device_unref(d);
+	ba_transport_unref(t1);
+	ba_transport_unref(t2);
+
+} END_TEST
+
+static void test_ba_transport_pcm_drain_cb(struct ba_transport_pcm *pcm,
+		int err, void *userdata) {
+	(void)pcm;
+	*(int *)userdata = err;
+}
+
+START_TEST(test_ba_transport_pcm_drain) {
+
+	struct ba_adapter *a;
+	struct ba_device *d;
+	struct ba_transport *t;
+	bdaddr_t addr = { 0 };
+	struct timespec ts0, ts, diff;
+	int result;
+
+	ck_assert_ptr_ne(a = ba_adapter_new(0), NULL);
+	ck_assert_ptr_ne(d = ba_device_new(a, &addr), NULL);
+	ck_assert_ptr_ne(t = transport_new(d, "/owner", "/path"), NULL);
+
+	t->type.profile = BA_TRANSPORT_PROFILE_A2DP_SOURCE;
+	transport_pcm_init(&t->a2dp.pcm, &t->thread_enc, BA_TRANSPORT_PCM_MODE_SINK);
+	transport_pcm_init(&t->a2dp.pcm_bc, &t->thread_dec, BA_TRANSPORT_PCM_MODE_SOURCE);
+	/* 50 ms delay reported by the remote device */
+	t->a2dp.delay = 500;
+
+	struct ba_transport_pcm *pcm = &t->a2dp.pcm;
+
+	/* drain requires running IO thread */
+	ck_assert_int_eq(ba_transport_pcm_drain(pcm, test_ba_transport_pcm_drain_cb, &result), -1);
+	ck_assert_int_eq(errno, ESRCH);
+
+	t->thread_enc.id = pthread_self();
+
+	/* drain request shall not block the caller */
+	result = -1;
+	gettimestamp(&ts0);
+	ck_assert_int_eq(ba_transport_pcm_drain(pcm, test_ba_transport_pcm_drain_cb, &result), 0);
+	ck_assert_int_eq(ba_transport_pcm_drain(pcm, test_ba_transport_pcm_drain_cb, &result), -1);
+	ck_assert_int_eq(errno, EBUSY);
+	ck_assert_int_eq(ba_transport_thread_recv_signal(&t->thread_enc), BA_TRANSPORT_SIGNAL_PCM_SYNC);
+
+	ba_transport_pcm_drain_synced(pcm);
+	while (result == -1)
+		g_main_context_iteration(NULL, TRUE);
+
+	gettimestamp(&ts);
+	difftimespec(&ts0, &ts, &diff);
+	ck_assert_int_eq(result, 0);
+	/* drain shall complete after the device delay */
+	ck_assert_uint_ge(diff.tv_sec * 1000 + diff.tv_nsec / 1000000, 50);
+	ck_assert_uint_lt(diff.tv_sec * 1000 + diff.tv_nsec / 1000000, 200);
+
+	/* canceled drain shall report an error */
+	result = -1;
+	ck_assert_int_eq(ba_transport_pcm_drain(pcm, test_ba_transport_pcm_drain_cb, &result), 0);
+	ba_transport_pcm_drain_cancel(pcm);
+	ck_assert_int_eq(result, ECANCELED);
+	ck_assert_int_eq(pcm->drain.state, BA_TRANSPORT_PCM_DRAIN_IDLE);
+
+	t->thread_enc.id = config.main_thread;
+
+	ba_adapter_unref(a);
+	ba_device_unref(d);
+	ba_transport_unref(t);
+
+} END_TEST
+
 static int test_cascade_free_transport_unref(struct ba_transport *t) {
 	return ba_transport_unref(t), 0;
 }
@@ -207,9 +369,12 @@ int main(void) {
 
 	tcase_add_test(tc, test_ba_adapter);
 	tcase_add_test(tc, test_ba_device);
+	tcase_add_test(tc, test_ba_device_indicator);
 	tcase_add_test(tc, test_ba_transport);
 	tcase_add_test(tc, test_ba_transport_pcm_format);
 	tcase_add_test(tc, test_ba_transport_pcm_volume);
+	tcase_add_test(tc, test_ba_transport_bitrate);
+	tcase_add_test(tc, test_ba_transport_pcm_drain);
 	tcase_add_test(tc, test_cascade_free);
 
 	srunner_run_all(sr, CK_ENV);
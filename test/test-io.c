@@ -20,6 +20,7 @@
 #include "inc/sine.inc"
 #include "../src/a2dp.c"
 #include "../src/a2dp-audio.c"
+#include "../src/a2dp-capture.c"
 #include "../src/at.c"
 #include "../src/audio.c"
 #include "../src/ba-adapter.c"
@@ -39,6 +40,7 @@
 #include "../src/utils.c"
 #include "../src/shared/ffb.c"
 #include "../src/shared/log.c"
+#include "../src/shared/mempool.c"
 #include "../src/shared/rt.c"
 
 unsigned int bluealsa_dbus_pcm_register(struct ba_transport_pcm *pcm, GError **error) {
@@ -455,6 +457,52 @@ START_TEST(test_a2dp_sbc) {
 
 } END_TEST
 
+START_TEST(test_a2dp_start_threshold) {
+
+	struct ba_transport_type ttype = {
+		.profile = BA_TRANSPORT_PROFILE_A2DP_SOURCE,
+		.codec = A2DP_CODEC_SBC };
+	struct ba_transport *t = ba_transport_new_a2dp(device1, ttype, ":test", "/path/sbc",
+			&a2dp_codec_source_sbc, &config_sbc_44100_stereo);
+
+	t->acquire = test_transport_acquire;
+	t->release = test_transport_release_bt_a2dp;
+	t->mtu_write = 153 * 3;
+
+	int bt_fds[2];
+	int pcm_fds[2];
+
+	ck_assert_int_eq(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, bt_fds), 0);
+	ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pcm_fds), 0);
+
+	t->bt_fd = bt_fds[1];
+	t->a2dp.pcm.fd = pcm_fds[1];
+	t->a2dp.pcm.start_threshold = 500;
+
+	/* start the IO thread with the PCM FIFO empty */
+	ck_assert_int_eq(ba_transport_thread_create(&t->thread_enc, a2dp_source_sbc, "encode"), 0);
+	usleep(100000);
+
+	/* write 100 ms of audio - less than the start threshold */
+	static int16_t pcm[4410 * 2];
+	snd_pcm_sine_s16le(pcm, ARRAYSIZE(pcm), 2, 0, 1.0 / 128);
+	ck_assert_int_eq(write(pcm_fds[0], pcm, sizeof(pcm)), sizeof(pcm));
+
+	/* stream shall not be started before the threshold is reached */
+	struct pollfd pfds[] = {{ bt_fds[0], POLLIN, 0 }};
+	ck_assert_int_eq(poll(pfds, ARRAYSIZE(pfds), 250), 0);
+
+	/* but it shall be started when the threshold time has elapsed */
+	ck_assert_int_eq(poll(pfds, ARRAYSIZE(pfds), 1000), 1);
+
+	ck_assert_int_eq(pthread_cancel(t->thread_enc.id), 0);
+	ck_assert_int_eq(pthread_timedjoin(t->thread_enc.id, NULL, 1e6), 0);
+
+	close(pcm_fds[0]);
+	close(bt_fds[0]);
+
+} END_TEST
+
 #if ENABLE_MP3LAME
 START_TEST(test_a2dp_mp3) {
 
@@ -509,6 +557,87 @@ START_TEST(test_a2dp_aac) {
 } END_TEST
 #endif
 
+#if ENABLE_APTX
+START_TEST(test_aptx_encode_block) {
+
+	static int16_t pcm[2 * 1024];
+	uint8_t code_block[1024];
+	uint8_t code_frame[1024];
+	HANDLE_APTX h1, h2;
+	size_t i, len;
+
+	snd_pcm_sine_s16le(pcm, ARRAYSIZE(pcm), 2, 0, 1.0 / 128);
+	ck_assert_ptr_ne(h1 = aptxenc_init(), NULL);
+	ck_assert_ptr_ne(h2 = aptxenc_init(), NULL);
+
+	/* encode the whole signal with a single call */
+	len = sizeof(code_block);
+	ck_assert_int_eq(aptxenc_encode(h1, pcm, ARRAYSIZE(pcm), code_block, &len), ARRAYSIZE(pcm));
+	ck_assert_uint_eq(len, sizeof(code_block));
+
+	/* encode the same signal one code word at a time */
+	for (i = 0; i < ARRAYSIZE(pcm); i += 8) {
+		len = 4;
+		ck_assert_int_eq(aptxenc_encode(h2, &pcm[i], 8, &code_frame[i / 2], &len), 8);
+		ck_assert_uint_eq(len, 4);
+	}
+
+	/* block encoding has to be bit-exact */
+	ck_assert_int_eq(memcmp(code_block, code_frame, sizeof(code_block)), 0);
+
+	/* encoding is limited by the output buffer size */
+	len = 10;
+	ck_assert_int_eq(aptxenc_encode(h1, pcm, ARRAYSIZE(pcm), code_block, &len), 16);
+	ck_assert_uint_eq(len, 8);
+
+	len = 3;
+	ck_assert_int_eq(aptxenc_encode(h1, pcm, ARRAYSIZE(pcm), code_block, &len), -1);
+	ck_assert_int_eq(errno, EINVAL);
+
+	aptxenc_destroy(h1);
+	aptxenc_destroy(h2);
+
+} END_TEST
+#endif
+
+#if ENABLE_APTX_HD
+START_TEST(test_aptx_hd_encode_block) {
+
+	static int16_t pcm_s16[2 * 1024];
+	static int32_t pcm[2 * 1024];
+	uint8_t code_block[1536];
+	uint8_t code_frame[1536];
+	HANDLE_APTX h1, h2;
+	size_t i, len;
+
+	snd_pcm_sine_s16le(pcm_s16, ARRAYSIZE(pcm_s16), 2, 0, 1.0 / 128);
+	for (i = 0; i < ARRAYSIZE(pcm); i++)
+		pcm[i] = pcm_s16[i] * 256;
+
+	ck_assert_ptr_ne(h1 = aptxhdenc_init(), NULL);
+	ck_assert_ptr_ne(h2 = aptxhdenc_init(), NULL);
+
+	/* encode the whole signal with a single call */
+	len = sizeof(code_block);
+	ck_assert_int_eq(aptxhdenc_encode(h1, pcm, ARRAYSIZE(pcm), code_block, &len), ARRAYSIZE(pcm));
+	ck_assert_uint_eq(len, sizeof(code_block));
+
+	/* encode the same signal one code word at a time */
+	for (i = 0; i < ARRAYSIZE(pcm); i += 8) {
+		len = 6;
+		ck_assert_int_eq(aptxhdenc_encode(h2, &pcm[i], 8, &code_frame[i / 8 * 6], &len), 8);
+		ck_assert_uint_eq(len, 6);
+	}
+
+	/* block encoding has to be bit-exact */
+	ck_assert_int_eq(memcmp(code_block, code_frame, sizeof(code_block)), 0);
+
+	aptxhdenc_destroy(h1);
+	aptxhdenc_destroy(h2);
+
+} END_TEST
+#endif
+
 #if ENABLE_APTX
 START_TEST(test_a2dp_aptx) {
 
@@ -711,8 +840,10 @@ int main(int argc, char *argv[]) {
 	tcase_set_timeout(tc, aging_duration +
 			(input_pcm_file != NULL ? 180 : 5));
 
-	if (enabled_codecs & TEST_CODEC_SBC)
+	if (enabled_codecs & TEST_CODEC_SBC) {
 		tcase_add_test(tc, test_a2dp_sbc);
+		tcase_add_test(tc, test_a2dp_start_threshold);
+	}
 #if ENABLE_MP3LAME
 	if (enabled_codecs & TEST_CODEC_MP3)
 		tcase_add_test(tc, test_a2dp_mp3);
@@ -723,12 +854,16 @@ int main(int argc, char *argv[]) {
 		tcase_add_test(tc, test_a2dp_aac);
 #endif
 #if ENABLE_APTX
-	if (enabled_codecs & TEST_CODEC_APTX)
+	if (enabled_codecs & TEST_CODEC_APTX) {
+		tcase_add_test(tc, test_aptx_encode_block);
 		tcase_add_test(tc, test_a2dp_aptx);
+	}
 #endif
 #if ENABLE_APTX_HD
-	if (enabled_codecs & TEST_CODEC_APTX_HD)
+	if (enabled_codecs & TEST_CODEC_APTX_HD) {
+		tcase_add_test(tc, test_aptx_hd_encode_block);
 		tcase_add_test(tc, test_a2dp_aptx_hd);
+	}
 #endif
 #if ENABLE_LDAC
 	config.ldac_abr = true;
@@ -16,6 +16,7 @@
 #include "../src/shared/defs.h"
 #include "../src/shared/ffb.c"
 #include "../src/shared/log.c"
+#include "../src/shared/mempool.c"
 
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 
@@ -29,6 +29,8 @@
 #include "../src/hci.c"
 #include "../src/utils.c"
 #include "../src/shared/log.c"
+#include "../src/shared/mempool.c"
+#include "../src/shared/rt.c"
 
 static struct ba_adapter *adapter = NULL;
 static struct ba_device *device = NULL;
@@ -54,9 +56,13 @@ unsigned int bluealsa_dbus_rfcomm_register(struct ba_rfcomm *r, GError **error)
 	debug("%s: %p", __func__, (void *)r); (void)error; return 0; }
 void bluealsa_dbus_rfcomm_update(struct ba_rfcomm *r, unsigned int mask) {
 	debug("%s: %p %#x", __func__, (void *)r, mask); }
+void bluealsa_dbus_rfcomm_indicator_changed(struct ba_rfcomm *r,
+		const struct ba_device_indicator *event) {
+	debug("%s: %p %d=%d", __func__, (void *)r, event->ind, event->value); }
 void bluealsa_dbus_rfcomm_unregister(struct ba_rfcomm *r) {
 	debug("%s: %p", __func__, (void *)r); }
 int a2dp_audio_thread_create(struct ba_transport *t) { (void)t; return -1; }
+void a2dp_capture_close(struct a2dp_capture *c) { (void)c; }
 void *sco_thread(struct ba_transport_thread *th) { return sleep(3600), th; }
 bool bluez_a2dp_set_configuration(const char *current_dbus_sep_path,
 		const struct a2dp_sep *sep, GError **error) {
@@ -15,6 +15,7 @@
 #include "../src/shared/defs.h"
 #include "../src/shared/ffb.c"
 #include "../src/shared/log.c"
+#include "../src/shared/mempool.c"
 #include "../src/shared/rt.c"
 
 START_TEST(test_g_dbus_bluez_object_path_to_hci_dev_id) {
@@ -172,6 +173,24 @@ START_TEST(test_difftimespec) {
 
 } END_TEST
 
+START_TEST(test_asrsync_get_overdue_msec) {
+
+	struct asrsync asrs;
+
+	asrsync_init(&asrs, 48000);
+	ck_assert_uint_eq(asrsync_get_overdue_msec(&asrs), 0);
+
+	/* one second of audio transferred in no time */
+	asrs.frames = 48000;
+	ck_assert_uint_eq(asrsync_get_overdue_msec(&asrs), 0);
+
+	/* one second of audio transferred in three seconds */
+	asrs.ts0.tv_sec -= 3;
+	ck_assert_uint_ge(asrsync_get_overdue_msec(&asrs), 2000);
+	ck_assert_uint_lt(asrsync_get_overdue_msec(&asrs), 2100);
+
+} END_TEST
+
 START_TEST(test_fifo_buffer) {
 
 	ffb_t ffb_u8 = { 0 };
@@ -230,6 +249,95 @@ START_TEST(test_fifo_buffer) {
 
 } END_TEST
 
+START_TEST(test_mempool) {
+
+	struct mempool_stats stats;
+	void *ptr1, *ptr2, *ptr3;
+
+	mempool_trim();
+	mempool_get_stats(&stats);
+	const size_t hits = stats.hits;
+	const size_t misses = stats.misses;
+	const size_t allocated = stats.allocated;
+	const size_t requested = stats.requested;
+
+	/* allocation is rounded up to the size class */
+	ck_assert_ptr_ne(ptr1 = mempool_alloc(100), NULL);
+	mempool_get_stats(&stats);
+	ck_assert_int_eq(stats.misses, misses + 1);
+	ck_assert_int_eq(stats.requested, requested + 100);
+	ck_assert_int_eq(stats.allocated, allocated + 128);
+	ck_assert_int_eq(stats.cached, 0);
+
+	/* freed block shall be recycled */
+	mempool_free(ptr1);
+	mempool_get_stats(&stats);
+	ck_assert_int_eq(stats.allocated, allocated);
+	ck_assert_int_eq(stats.cached, 128);
+	ck_assert_ptr_eq(ptr2 = mempool_alloc0(120), ptr1);
+	ck_assert_int_eq(((uint8_t *)ptr2)[119], 0);
+	mempool_get_stats(&stats);
+	ck_assert_int_eq(stats.hits, hits + 1);
+	ck_assert_int_eq(stats.cached, 0);
+
+	/* in-place reallocation within the block capacity */
+	memcpy(ptr2, "BlueALSA", 8);
+	ck_assert_ptr_eq(mempool_realloc(ptr2, 128), ptr2);
+	ck_assert_ptr_ne(ptr2 = mempool_realloc(ptr2, 1000), NULL);
+	ck_assert_int_eq(memcmp(ptr2, "BlueALSA", 8), 0);
+	mempool_get_stats(&stats);
+	ck_assert_int_eq(stats.requested, requested + 1000);
+	ck_assert_int_eq(stats.allocated, allocated + 1024);
+	ck_assert_int_eq(stats.cached, 128);
+
+	/* blocks bigger than the biggest class are not cached */
+	ck_assert_ptr_ne(ptr3 = mempool_alloc(1024 * 1024), NULL);
+	mempool_free(ptr3);
+	mempool_get_stats(&stats);
+	ck_assert_int_eq(stats.cached, 128);
+	ck_assert_uint_ge(stats.peak, allocated + 1024 + 128 + 1024 * 1024);
+
+	mempool_free(ptr2);
+	mempool_free(NULL);
+	mempool_trim();
+	mempool_get_stats(&stats);
+	ck_assert_int_eq(stats.requested, requested);
+	ck_assert_int_eq(stats.allocated, allocated);
+	ck_assert_int_eq(stats.cached, 0);
+
+} END_TEST
+
+START_TEST(test_log_async) {
+
+	char buffer[1024] = "";
+	int fds[2];
+	int i;
+
+	ck_assert_int_eq(pipe(fds), 0);
+	ck_assert_int_ne(dup2(fds[1], STDERR_FILENO), -1);
+
+	log_open("test", false, false);
+	ck_assert_int_eq(log_async_start(), 0);
+
+	for (i = 0; i < 10; i++)
+		log_message(LOG_WARNING, "Missing RTP packet: %d", 7);
+	for (i = 0; i < 2; i++)
+		log_message(LOG_WARNING, "Missing RTP packet: %d", i);
+	log_message(LOG_ERR, "Missing RTP packet: %d", 1);
+
+	log_async_flush();
+	fflush(stderr);
+
+	ck_assert_int_gt(read(fds[0], buffer, sizeof(buffer) - 1), 0);
+	ck_assert_str_eq(buffer,
+			"test: W: Missing RTP packet: 7\n"
+			"test: W: Missing RTP packet: 7 (last message repeated 9 times)\n"
+			"test: W: Missing RTP packet: 0\n"
+			"test: W: Missing RTP packet: 1\n"
+			"test: E: Missing RTP packet: 1\n");
+
+} END_TEST
+
 int main(void) {
 
 	Suite *s = suite_create(__FILE__);
@@ -244,7 +352,10 @@ int main(void) {
 	tcase_add_test(tc, test_g_variant_sanitize_object_path);
 	tcase_add_test(tc, test_batostr_);
 	tcase_add_test(tc, test_difftimespec);
+	tcase_add_test(tc, test_asrsync_get_overdue_msec);
 	tcase_add_test(tc, test_fifo_buffer);
+	tcase_add_test(tc, test_mempool);
+	tcase_add_test(tc, test_log_async);
 
 	srunner_run_all(sr, CK_ENV);
 	int nf = srunner_ntests_failed(sr);
@@ -14,11 +14,13 @@
 
 #include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <dbus/dbus.h>
@@ -32,6 +34,13 @@
 #define cli_print_error(M, ...) if (!quiet) { error(M, ##__VA_ARGS__); }
 #define cmd_print_error(M, ...) if (!quiet) { error("CMD \"%s\": " M, argv[0], ##__VA_ARGS__); }
 
+/**
+ * Output format of the streaming commands. */
+enum output_format {
+	OUTPUT_FORMAT_TEXT,
+	OUTPUT_FORMAT_JSON,
+};
+
 static struct ba_dbus_ctx dbus_ctx;
 static char dbus_ba_service[32] = BLUEALSA_SERVICE;
 static bool quiet = false;
@@ -196,6 +205,152 @@ static void print_mute(struct ba_pcm *pcm) {
 		printf("Muted: %c\n", pcm->volume.ch1_muted ? 'Y' : 'N');
 }
 
+static bool parse_output_format(const char *name, enum output_format *format) {
+	if (strcasecmp(name, "text") == 0)
+		*format = OUTPUT_FORMAT_TEXT;
+	else if (strcasecmp(name, "json") == 0)
+		*format = OUTPUT_FORMAT_JSON;
+	else
+		return false;
+	return true;
+}
+
+static void print_json_string(const char *str) {
+	putchar('"');
+	for (; *str != '\0'; str++)
+		switch (*str) {
+		case '"':
+		case '\\':
+			printf("\\%c", *str);
+			break;
+		case '\n':
+			printf("\\n");
+			break;
+		case '\t':
+			printf("\\t");
+			break;
+		default:
+			if ((unsigned char)*str < 0x20)
+				printf("\\u%04x", *str);
+			else
+				putchar(*str);
+		}
+	putchar('"');
+}
+
+/**
+ * Print D-Bus message argument as a JSON value.
+ *
+ * Dictionaries are printed as JSON objects, while all other containers
+ * are printed as JSON arrays. Non-string dictionary keys are converted
+ * to strings. */
+static void print_json_value(DBusMessageIter *iter) {
+
+	DBusMessageIter iter_sub;
+	const char *str;
+	dbus_bool_t b;
+	unsigned char u8;
+	dbus_uint16_t u16;
+	dbus_int16_t i16;
+	dbus_uint32_t u32;
+	dbus_int32_t i32;
+	dbus_uint64_t u64;
+	dbus_int64_t i64;
+	double d;
+	int i;
+
+	switch (dbus_message_iter_get_arg_type(iter)) {
+	case DBUS_TYPE_STRING:
+	case DBUS_TYPE_OBJECT_PATH:
+	case DBUS_TYPE_SIGNATURE:
+		dbus_message_iter_get_basic(iter, &str);
+		print_json_string(str);
+		break;
+	case DBUS_TYPE_BOOLEAN:
+		dbus_message_iter_get_basic(iter, &b);
+		printf("%s", b ? "true" : "false");
+		break;
+	case DBUS_TYPE_BYTE:
+		dbus_message_iter_get_basic(iter, &u8);
+		printf("%u", u8);
+		break;
+	case DBUS_TYPE_UINT16:
+		dbus_message_iter_get_basic(iter, &u16);
+		printf("%u", u16);
+		break;
+	case DBUS_TYPE_INT16:
+		dbus_message_iter_get_basic(iter, &i16);
+		printf("%d", i16);
+		break;
+	case DBUS_TYPE_UINT32:
+		dbus_message_iter_get_basic(iter, &u32);
+		printf("%u", u32);
+		break;
+	case DBUS_TYPE_INT32:
+	case DBUS_TYPE_UNIX_FD:
+		dbus_message_iter_get_basic(iter, &i32);
+		printf("%d", i32);
+		break;
+	case DBUS_TYPE_UINT64:
+		dbus_message_iter_get_basic(iter, &u64);
+		printf("%" PRIu64, (uint64_t)u64);
+		break;
+	case DBUS_TYPE_INT64:
+		dbus_message_iter_get_basic(iter, &i64);
+		printf("%" PRId64, (int64_t)i64);
+		break;
+	case DBUS_TYPE_DOUBLE:
+		dbus_message_iter_get_basic(iter, &d);
+		printf("%g", d);
+		break;
+	case DBUS_TYPE_VARIANT:
+		dbus_message_iter_recurse(iter, &iter_sub);
+		print_json_value(&iter_sub);
+		break;
+	case DBUS_TYPE_ARRAY:
+		dbus_message_iter_recurse(iter, &iter_sub);
+		if (dbus_message_iter_get_element_type(iter) == DBUS_TYPE_DICT_ENTRY) {
+			putchar('{');
+			for (i = 0; dbus_message_iter_get_arg_type(&iter_sub) != DBUS_TYPE_INVALID;
+					dbus_message_iter_next(&iter_sub), i++) {
+				DBusMessageIter iter_entry;
+				dbus_message_iter_recurse(&iter_sub, &iter_entry);
+				if (i > 0)
+					putchar(',');
+				if (dbus_message_iter_get_arg_type(&iter_entry) == DBUS_TYPE_STRING ||
+						dbus_message_iter_get_arg_type(&iter_entry) == DBUS_TYPE_OBJECT_PATH)
+					print_json_value(&iter_entry);
+				else {
+					putchar('"');
+					print_json_value(&iter_entry);
+					putchar('"');
+				}
+				putchar(':');
+				dbus_message_iter_next(&iter_entry);
+				print_json_value(&iter_entry);
+			}
+			putchar('}');
+			break;
+		}
+		/* fall-through */
+	case DBUS_TYPE_STRUCT:
+		if (dbus_message_iter_get_arg_type(iter) == DBUS_TYPE_STRUCT)
+			dbus_message_iter_recurse(iter, &iter_sub);
+		putchar('[');
+		for (i = 0; dbus_message_iter_get_arg_type(&iter_sub) != DBUS_TYPE_INVALID;
+				dbus_message_iter_next(&iter_sub), i++) {
+			if (i > 0)
+				putchar(',');
+			print_json_value(&iter_sub);
+		}
+		putchar(']');
+		break;
+	default:
+		printf("null");
+	}
+
+}
+
 static int cmd_list_pcms(int argc, char *argv[]) {
 
 	if (argc != 1) {
@@ -513,9 +668,48 @@ finish:
 	return EXIT_SUCCESS;
 }
 
+static void print_properties_changed(const char *path, DBusMessageIter *iter,
+		enum output_format format) {
+
+	const char *interface;
+	dbus_message_iter_get_basic(iter, &interface);
+	dbus_message_iter_next(iter);
+
+	if (format == OUTPUT_FORMAT_JSON) {
+		printf("{\"event\":\"PropertiesChanged\",\"path\":");
+		print_json_string(path);
+		printf(",\"interface\":");
+		print_json_string(interface);
+		printf(",\"properties\":");
+		print_json_value(iter);
+		printf("}\n");
+		return;
+	}
+
+	DBusMessageIter iter_props;
+	for (dbus_message_iter_recurse(iter, &iter_props);
+			dbus_message_iter_get_arg_type(&iter_props) == DBUS_TYPE_DICT_ENTRY;
+			dbus_message_iter_next(&iter_props)) {
+
+		DBusMessageIter iter_entry;
+		const char *property;
+
+		dbus_message_iter_recurse(&iter_props, &iter_entry);
+		dbus_message_iter_get_basic(&iter_entry, &property);
+		dbus_message_iter_next(&iter_entry);
+
+		printf("PropertyChanged %s %s ", path, property);
+		print_json_value(&iter_entry);
+		printf("\n");
+
+	}
+
+}
+
 static DBusHandlerResult dbus_signal_handler(DBusConnection *conn, DBusMessage *message, void *data) {
 	(void)conn;
-	(void)data;
+
+	const enum output_format format = *(enum output_format *)data;
 
 	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_SIGNAL)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
@@ -532,7 +726,18 @@ static DBusHandlerResult dbus_signal_handler(DBusConnection *conn, DBusMessage *
 			if (dbus_message_iter_init(message, &iter) &&
 					dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_OBJECT_PATH) {
 				dbus_message_iter_get_basic(&iter, &path);
-				printf("PCMAdded %s\n", path);
+				if (format == OUTPUT_FORMAT_JSON) {
+					printf("{\"event\":\"PCMAdded\",\"path\":");
+					print_json_string(path);
+					if (dbus_message_iter_next(&iter)) {
+						printf(",\"properties\":");
+						print_json_value(&iter);
+					}
+					printf("}\n");
+				}
+				else
+					printf("PCMAdded %s\n", path);
+				fflush(stdout);
 				return DBUS_HANDLER_RESULT_HANDLED;
 			}
 
@@ -540,18 +745,56 @@ static DBusHandlerResult dbus_signal_handler(DBusConnection *conn, DBusMessage *
 			if (dbus_message_iter_init(message, &iter) &&
 					dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_OBJECT_PATH) {
 				dbus_message_iter_get_basic(&iter, &path);
-				printf("PCMRemoved %s\n", path);
+				if (format == OUTPUT_FORMAT_JSON) {
+					printf("{\"event\":\"PCMRemoved\",\"path\":");
+					print_json_string(path);
+					printf("}\n");
+				}
+				else
+					printf("PCMRemoved %s\n", path);
+				fflush(stdout);
 				return DBUS_HANDLER_RESULT_HANDLED;
 			}
 
 	}
 
+	if (strcmp(interface, DBUS_INTERFACE_PROPERTIES) == 0 &&
+			strcmp(signal, "PropertiesChanged") == 0)
+		if (dbus_message_has_signature(message, "sa{sv}as") &&
+				dbus_message_iter_init(message, &iter)) {
+			print_properties_changed(dbus_message_get_path(message), &iter, format);
+			fflush(stdout);
+			return DBUS_HANDLER_RESULT_HANDLED;
+		}
+
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
 static int cmd_monitor(int argc, char *argv[]) {
 
-	if (argc != 1) {
+	static enum output_format format = OUTPUT_FORMAT_TEXT;
+
+	int opt;
+	const char *opts = "f:";
+	const struct option longopts[] = {
+		{"format", required_argument, NULL, 'f'},
+		{ 0 },
+	};
+
+	optind = 0;
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'f' /* --format=FMT */ :
+			if (!parse_output_format(optarg, &format)) {
+				cmd_print_error("Invalid output format: %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+
+	if (argc != optind) {
 		cmd_print_error("Invalid number of arguments");
 		return EXIT_FAILURE;
 	}
@@ -560,8 +803,10 @@ static int cmd_monitor(int argc, char *argv[]) {
 			dbus_ba_service, NULL, BLUEALSA_INTERFACE_MANAGER, "PCMAdded", NULL);
 	bluealsa_dbus_connection_signal_match_add(&dbus_ctx,
 			dbus_ba_service, NULL, BLUEALSA_INTERFACE_MANAGER, "PCMRemoved", NULL);
+	bluealsa_dbus_connection_signal_match_add(&dbus_ctx,
+			dbus_ba_service, NULL, DBUS_INTERFACE_PROPERTIES, "PropertiesChanged", NULL);
 
-	if (!dbus_connection_add_filter(dbus_ctx.conn, dbus_signal_handler, NULL, NULL)) {
+	if (!dbus_connection_add_filter(dbus_ctx.conn, dbus_signal_handler, &format, NULL)) {
 		cmd_print_error("Couldn't add D-Bus filter");
 		return EXIT_FAILURE;
 	}
@@ -572,6 +817,191 @@ static int cmd_monitor(int argc, char *argv[]) {
 	return EXIT_SUCCESS;
 }
 
+/**
+ * PCM statistics sample used by the top command. */
+struct top_sample {
+	char pcm_path[128];
+	struct ba_pcm_stats stats;
+};
+
+static const struct top_sample *top_find_sample(const struct top_sample *samples,
+		size_t len, const char *pcm_path) {
+	size_t i;
+	for (i = 0; i < len; i++)
+		if (strcmp(samples[i].pcm_path, pcm_path) == 0)
+			return &samples[i];
+	return NULL;
+}
+
+/**
+ * Get the rate of change of the given counter.
+ *
+ * Counters might be reset when the transport is re-created or IO threads
+ * are restarted. In such case, the rate is reported as zero. */
+static double top_rate(uint64_t now, uint64_t prev, double interval) {
+	return now >= prev ? (now - prev) / interval : 0;
+}
+
+static void top_print(const struct ba_pcm *pcms, const struct top_sample *samples,
+		size_t len, const struct top_sample *samples_prev, size_t samples_prev_len,
+		double interval, enum output_format format) {
+
+	size_t i;
+
+	if (format == OUTPUT_FORMAT_JSON) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		printf("{\"timestamp\":%ld.%03ld,\"interval\":%.3f,\"pcms\":[",
+				(long)ts.tv_sec, ts.tv_nsec / 1000000, interval);
+	}
+	else
+		printf("%10s %6s %8s %9s %6s %8s %-8s %s\n", "FRAMES/s", "CPU%", "QUEUE",
+				"UNDERRUNS", "LOST", "DELAY", "CODEC", "PCM");
+
+	for (i = 0; i < len; i++) {
+
+		const struct ba_pcm_stats *stats = &samples[i].stats;
+		const struct top_sample *prev;
+		double frames_rate = 0, cpu = 0, rx_rate = 0, tx_rate = 0;
+
+		if ((prev = top_find_sample(samples_prev, samples_prev_len, pcms[i].pcm_path)) != NULL) {
+			frames_rate = top_rate(stats->frames, prev->stats.frames, interval);
+			cpu = top_rate(stats->cpu_time, prev->stats.cpu_time, interval) / 1e7;
+			rx_rate = top_rate(stats->rx_bytes, prev->stats.rx_bytes, interval);
+			tx_rate = top_rate(stats->tx_bytes, prev->stats.tx_bytes, interval);
+		}
+
+		if (format == OUTPUT_FORMAT_JSON) {
+			printf("%s{\"path\":", i > 0 ? "," : "");
+			print_json_string(pcms[i].pcm_path);
+			printf(",\"transport\":\"%s\",\"mode\":\"%s\",\"codec\":",
+					transport_code_to_string(pcms[i].transport),
+					pcm_mode_to_string(pcms[i].mode));
+			print_json_string(pcms[i].codec);
+			printf(",\"frames_per_sec\":%.0f,\"cpu_percent\":%.1f"
+					",\"rx_bytes_per_sec\":%.0f,\"tx_bytes_per_sec\":%.0f"
+					",\"queued_bytes\":%u,\"underruns\":%u,\"lost_packets\":%u"
+					",\"delay_ms\":%.1f}",
+					frames_rate, cpu, rx_rate, tx_rate, stats->queued_bytes,
+					stats->underruns, stats->lost_packets, (double)pcms[i].delay / 10);
+		}
+		else
+			printf("%10.0f %6.1f %8u %9u %6u %8.1f %-8s %s\n", frames_rate, cpu,
+					stats->queued_bytes, stats->underruns, stats->lost_packets,
+					(double)pcms[i].delay / 10, pcms[i].codec, pcms[i].pcm_path);
+
+	}
+
+	if (format == OUTPUT_FORMAT_JSON)
+		printf("]}\n");
+	else
+		printf("\n");
+
+	fflush(stdout);
+}
+
+static int cmd_top(int argc, char *argv[]) {
+
+	enum output_format format = OUTPUT_FORMAT_TEXT;
+	double interval = 1.0;
+	unsigned int count = 0;
+
+	int opt;
+	const char *opts = "d:f:n:";
+	const struct option longopts[] = {
+		{"delay", required_argument, NULL, 'd'},
+		{"format", required_argument, NULL, 'f'},
+		{"iterations", required_argument, NULL, 'n'},
+		{ 0 },
+	};
+
+	optind = 0;
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'd' /* --delay=SEC */ :
+			if ((interval = atof(optarg)) < 0.1) {
+				cmd_print_error("Invalid refresh interval [>= 0.1]: %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'f' /* --format=FMT */ :
+			if (!parse_output_format(optarg, &format)) {
+				cmd_print_error("Invalid output format: %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'n' /* --iterations=NB */ :
+			count = atoi(optarg);
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+
+	if (argc != optind) {
+		cmd_print_error("Invalid number of arguments");
+		return EXIT_FAILURE;
+	}
+
+	struct top_sample *samples_prev = NULL;
+	size_t samples_prev_len = 0;
+	struct timespec ts_prev = { 0 };
+	unsigned int i = 0;
+
+	for (;;) {
+
+		struct ba_pcm *pcms = NULL;
+		struct top_sample *samples = NULL;
+		size_t j, len = 0;
+		struct timespec ts;
+
+		DBusError err = DBUS_ERROR_INIT;
+		if (!bluealsa_dbus_get_pcms(&dbus_ctx, &pcms, &len, &err)) {
+			cmd_print_error("Couldn't get BlueALSA PCM list: %s", err.message);
+			free(samples_prev);
+			return EXIT_FAILURE;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+
+		if (len > 0 && (samples = calloc(len, sizeof(*samples))) == NULL) {
+			cmd_print_error("%s", strerror(ENOMEM));
+			free(samples_prev);
+			free(pcms);
+			return EXIT_FAILURE;
+		}
+
+		for (j = 0; j < len; j++) {
+			strcpy(samples[j].pcm_path, pcms[j].pcm_path);
+			/* PCM might be removed in the meantime */
+			bluealsa_dbus_pcm_get_stats(&dbus_ctx, pcms[j].pcm_path,
+					&samples[j].stats, NULL);
+		}
+
+		/* The first sample is used as a reference point only. */
+		if (ts_prev.tv_sec != 0 || ts_prev.tv_nsec != 0) {
+			const double elapsed = (ts.tv_sec - ts_prev.tv_sec) +
+				(ts.tv_nsec - ts_prev.tv_nsec) / 1e9;
+			top_print(pcms, samples, len, samples_prev, samples_prev_len, elapsed, format);
+			i++;
+		}
+
+		free(samples_prev);
+		samples_prev = samples;
+		samples_prev_len = len;
+		ts_prev = ts;
+		free(pcms);
+
+		if (count != 0 && i >= count)
+			break;
+
+		usleep(interval * 1000000);
+
+	}
+
+	free(samples_prev);
+	return EXIT_SUCCESS;
+}
+
 static struct command {
 	const char *name;
 	int (*func)(int argc, char *arg[]);
@@ -584,7 +1014,8 @@ static struct command {
 	{ "volume", cmd_volume, "<pcm-path> [<val>] [<val>]", "Set audio volume" },
 	{ "mute", cmd_mute, "<pcm-path> [y|n] [y|n]", "Mute/unmute audio" },
 	{ "soft-volume", cmd_softvol, "<pcm-path> [y|n]", "Enable/disable SoftVolume property" },
-	{ "monitor", cmd_monitor, "", "Display PCMAdded and PCMRemoved signals" },
+	{ "monitor", cmd_monitor, "[-f FMT]", "Display PCM changes and property updates" },
+	{ "top", cmd_top, "[-d SEC] [-n NB] [-f FMT]", "Display PCM runtime statistics" },
 	{ "open", cmd_open, "<pcm-path>", "Transfer raw PCM via stdin or stdout" },
 };
 
@@ -608,6 +1039,9 @@ static void usage(const char *progname) {
 	       "attribute is printed.\n");
 	printf("   3. The codec command requires BlueZ version >= 5.52 "
 	       "for SEP support.\n");
+	printf("   4. The monitor and top commands accept \"text\" (default) "
+	       "or \"json\" as FMT. In the JSON format, one object is printed "
+	       "per line.\n");
 }
 
 int main(int argc, char *argv[]) {
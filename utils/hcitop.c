@@ -13,9 +13,14 @@
 #endif
 
 #include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include <ncurses.h>
 #include <bsd/stdlib.h>
@@ -23,6 +28,23 @@
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
 #include <bluetooth/hci_lib.h>
+#include <dbus/dbus.h>
+
+#include "shared/dbus-client.h"
+
+/* maximal number of connections per HCI device */
+#define HCI_MAX_CONN 16
+
+/**
+ * BlueALSA transport statistics sample. */
+struct pcm_sample {
+	char pcm_path[128];
+	struct ba_pcm_stats stats;
+};
+
+/* BlueALSA D-Bus connection (if available) */
+static struct ba_dbus_ctx dbus_ctx;
+static bool dbus_ctx_ok = false;
 
 static const struct {
 	unsigned int bit;
@@ -78,6 +100,238 @@ static unsigned int get_average_rate(unsigned int *array, size_t size) {
 	return x + y / size;
 }
 
+static int get_conninfo(int dev_id, struct hci_conn_info ci[HCI_MAX_CONN]) {
+
+	struct hci_conn_list_req *cl;
+	int sk, num = -1;
+
+	if ((sk = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC, BTPROTO_HCI)) == -1)
+		return -1;
+
+	if ((cl = malloc(sizeof(*cl) + HCI_MAX_CONN * sizeof(*ci))) == NULL)
+		goto final;
+
+	cl->dev_id = dev_id;
+	cl->conn_num = HCI_MAX_CONN;
+
+	if (ioctl(sk, HCIGETCONNLIST, cl) == 0) {
+		memcpy(ci, cl->conn_info, cl->conn_num * sizeof(*ci));
+		num = cl->conn_num;
+	}
+
+	free(cl);
+
+final:
+	close(sk);
+	return num;
+}
+
+static const char *link_type2str(uint8_t type) {
+	switch (type) {
+	case SCO_LINK:
+		return "SCO";
+	case ACL_LINK:
+		return "ACL";
+	case ESCO_LINK:
+		return "eSCO";
+	case LE_LINK:
+		return "LE";
+	default:
+		return "?";
+	}
+}
+
+static const char *pcm_transport2str(unsigned int transport) {
+	switch (transport) {
+	case BA_PCM_TRANSPORT_A2DP_SOURCE:
+		return "A2DP-source";
+	case BA_PCM_TRANSPORT_A2DP_SINK:
+		return "A2DP-sink";
+	case BA_PCM_TRANSPORT_HFP_AG:
+		return "HFP-AG";
+	case BA_PCM_TRANSPORT_HFP_HF:
+		return "HFP-HF";
+	case BA_PCM_TRANSPORT_HSP_AG:
+		return "HSP-AG";
+	case BA_PCM_TRANSPORT_HSP_HS:
+		return "HSP-HS";
+	default:
+		return "?";
+	}
+}
+
+/**
+ * Get BlueALSA transport statistics.
+ *
+ * Both SCO PCMs (speaker and microphone) share the same transport, so
+ * only the first PCM of every transport is taken into account.
+ *
+ * @return The number of returned PCMs or -1 if BlueALSA is not available. */
+static ssize_t get_ba_pcms(struct ba_pcm **pcms, struct pcm_sample **samples) {
+
+	struct ba_pcm *_pcms = NULL;
+	size_t i, ii, len = 0;
+
+	if (!dbus_ctx_ok ||
+			!bluealsa_dbus_get_pcms(&dbus_ctx, &_pcms, &len, NULL))
+		return -1;
+
+	struct pcm_sample *_samples;
+	if ((_samples = calloc(len + 1, sizeof(*_samples))) == NULL) {
+		free(_pcms);
+		return -1;
+	}
+
+	for (i = ii = 0; i < len; i++) {
+
+		size_t j;
+		for (j = 0; j < ii; j++)
+			if (strcmp(_pcms[j].device_path, _pcms[i].device_path) == 0 &&
+					_pcms[j].transport == _pcms[i].transport)
+				break;
+		if (j < ii)
+			continue;
+
+		if (!bluealsa_dbus_pcm_get_stats(&dbus_ctx, _pcms[i].pcm_path,
+					&_samples[ii].stats, NULL))
+			continue;
+
+		strcpy(_samples[ii].pcm_path, _pcms[i].pcm_path);
+		_pcms[ii++] = _pcms[i];
+
+	}
+
+	*pcms = _pcms;
+	*samples = _samples;
+	return ii;
+}
+
+static const struct ba_hci *find_ba_hci(const struct ba_hci *hcis,
+		size_t len, const char *name) {
+	size_t i;
+	for (i = 0; i < len; i++)
+		if (strcmp(hcis[i].name, name) == 0)
+			return &hcis[i];
+	return NULL;
+}
+
+static const struct pcm_sample *find_pcm_sample(const struct pcm_sample *samples,
+		size_t len, const char *pcm_path) {
+	size_t i;
+	for (i = 0; i < len; i++)
+		if (strcmp(samples[i].pcm_path, pcm_path) == 0)
+			return &samples[i];
+	return NULL;
+}
+
+/**
+ * Print per-connection view.
+ *
+ * For every HCI connection print link type, RSSI and link quality (ACL
+ * links only). Then, for every BlueALSA transport associated with given
+ * remote device print codec, BT throughput and socket queue depth.
+ *
+ * @return The number of printed rows. */
+static int print_connections(int row, const struct hci_dev_info *devices,
+		int count, unsigned int delay_ms) {
+
+	static struct pcm_sample *samples_prev = NULL;
+	static size_t samples_prev_len = 0;
+
+	const char *template_top = "%5s %17s %6s %4s %5s %4s %-11s %-8s %8s %8s %8s";
+	const char *template_row = "%5s %17s %6u %4s %5s %4s %-11s %-8s %8s %8s %8s";
+	const int row0 = row;
+
+	attron(A_REVERSE);
+	mvprintw(row++, 0, template_top, "HCI", "ADDRESS", "HANDLE", "TYPE",
+			"RSSI", "LQ", "TRANSPORT", "CODEC", "RX/s", "TX/s", "QUEUE");
+	attroff(A_REVERSE);
+
+	struct pcm_sample *samples = NULL;
+	struct ba_pcm *pcms = NULL;
+	ssize_t pcms_len;
+
+	if ((pcms_len = get_ba_pcms(&pcms, &samples)) == -1)
+		pcms_len = 0;
+
+	int i;
+	for (i = 0; i < count; i++) {
+
+		struct hci_conn_info conns[HCI_MAX_CONN];
+		int dd = hci_open_dev(devices[i].dev_id);
+		int j, num;
+
+		if ((num = get_conninfo(devices[i].dev_id, conns)) == -1)
+			num = 0;
+
+		for (j = 0; j < num; j++) {
+
+			const struct hci_conn_info *ci = &conns[j];
+			char addr[18], rssi_str[6] = "-", lq_str[5] = "-";
+
+			ba2str(&ci->bdaddr, addr);
+
+			if (dd != -1 && ci->type == ACL_LINK) {
+				int8_t rssi;
+				uint8_t lq;
+				if (hci_read_rssi(dd, ci->handle, &rssi, 100) == 0)
+					snprintf(rssi_str, sizeof(rssi_str), "%d", rssi);
+				if (hci_read_link_quality(dd, ci->handle, &lq, 100) == 0)
+					snprintf(lq_str, sizeof(lq_str), "%u", lq);
+			}
+
+			mvprintw(row++, 0, template_row, devices[i].name, addr, ci->handle,
+					link_type2str(ci->type), rssi_str, lq_str, "", "", "", "", "");
+
+			/* BlueALSA transports are bound to the ACL link */
+			if (ci->type != ACL_LINK)
+				continue;
+
+			ssize_t k;
+			for (k = 0; k < pcms_len; k++) {
+
+				if (bacmp(&pcms[k].addr, &ci->bdaddr) != 0)
+					continue;
+
+				const struct pcm_sample *prev = find_pcm_sample(samples_prev,
+						samples_prev_len, samples[k].pcm_path);
+				unsigned int rate_rx = 0, rate_tx = 0;
+				char rx_rate[9], tx_rate[9], queue[9];
+
+				/* counters might be reset when transport is re-created */
+				if (prev != NULL && delay_ms > 0 &&
+						samples[k].stats.rx_bytes >= prev->stats.rx_bytes &&
+						samples[k].stats.tx_bytes >= prev->stats.tx_bytes) {
+					rate_rx = (samples[k].stats.rx_bytes - prev->stats.rx_bytes) * 1000 / delay_ms;
+					rate_tx = (samples[k].stats.tx_bytes - prev->stats.tx_bytes) * 1000 / delay_ms;
+				}
+
+				humanize_number(rx_rate, sizeof(rx_rate), rate_rx, "B", HN_AUTOSCALE, 0);
+				humanize_number(tx_rate, sizeof(tx_rate), rate_tx, "B", HN_AUTOSCALE, 0);
+				humanize_number(queue, sizeof(queue), samples[k].stats.queued_bytes,
+						"B", HN_AUTOSCALE, 0);
+
+				mvprintw(row++, 0, "%5s %17s %6s %4s %5s %4s %-11s %-8s %8s %8s %8s",
+						"", "", "", "", "", "", pcm_transport2str(pcms[k].transport),
+						pcms[k].codec, rx_rate, tx_rate, queue);
+
+			}
+
+		}
+
+		if (dd != -1)
+			hci_close_dev(dd);
+
+	}
+
+	free(samples_prev);
+	samples_prev = samples;
+	samples_prev_len = pcms_len;
+	free(pcms);
+
+	return row - row0;
+}
+
 static void sprint_hci_flags(char *str, unsigned int flags) {
 
 	size_t i;
@@ -91,14 +345,17 @@ static void sprint_hci_flags(char *str, unsigned int flags) {
 int main(int argc, char *argv[]) {
 
 	int opt;
-	const char *opts = "hVd:";
+	const char *opts = "hVB:d:";
 	const struct option longopts[] = {
 		{ "help", no_argument, NULL, 'h' },
 		{ "version", no_argument, NULL, 'V' },
+		{ "dbus", required_argument, NULL, 'B' },
 		{ "delay", required_argument, NULL, 'd' },
 		{ 0, 0, 0, 0 },
 	};
 
+	char dbus_ba_service[32] = BLUEALSA_SERVICE;
+
 	int delay_sec = 1;
 	int delay_msec = 0;
 
@@ -108,6 +365,7 @@ int main(int argc, char *argv[]) {
 			printf("usage: %s [ -d sec ]\n"
 					"  -h, --help\t\tprint this help and exit\n"
 					"  -V, --version\t\tprint version and exit\n"
+					"  -B, --dbus=NAME\tBlueALSA service name suffix\n"
 					"  -d, --delay=SEC\tdelay time interval\n",
 					argv[0]);
 			return EXIT_SUCCESS;
@@ -116,6 +374,10 @@ int main(int argc, char *argv[]) {
 			printf("%s\n", PACKAGE_VERSION);
 			return EXIT_SUCCESS;
 
+		case 'B' /* --dbus=NAME */ :
+			snprintf(dbus_ba_service, sizeof(dbus_ba_service), BLUEALSA_SERVICE ".%s", optarg);
+			break;
+
 		case 'd' /* --delay=SEC */ :
 			delay_sec = atoi(optarg);
 			delay_msec = (int)((atof(optarg) - delay_sec) * 10) * 100;
@@ -138,6 +400,10 @@ int main(int argc, char *argv[]) {
 	memset(byte_rx, 0, sizeof(byte_rx));
 	memset(byte_tx, 0, sizeof(byte_tx));
 
+	/* Transport statistics are optional - BlueALSA might not be running. */
+	dbus_threads_init_default();
+	dbus_ctx_ok = bluealsa_dbus_connection_ctx_init(&dbus_ctx, dbus_ba_service, NULL);
+
 	initscr();
 	cbreak();
 	noecho();
@@ -145,14 +411,21 @@ int main(int argc, char *argv[]) {
 
 	for (ii = 1;; ii++) {
 
-		const char *template_top = "%5s %9s %8s %8s %8s %8s";
-		const char *template_row = "%5s %9s %8s %8s %8s %8s";
+		const char *template_top = "%5s %9s %8s %8s %8s %8s %8s %8s";
+		const char *template_row = "%5s %9s %8s %8s %8s %8s %8s %8s";
+		struct ba_hci *hcis = NULL;
+		size_t hcis_len = 0;
 		int i, count;
 
 		attron(A_REVERSE);
-		mvprintw(0, 0, template_top, "HCI", "FLAGS", "RX", "TX", "RX/s", "TX/s");
+		mvprintw(0, 0, template_top, "HCI", "FLAGS", "RX", "TX", "RX/s", "TX/s",
+				"LOAD", "LIMIT");
 		attroff(A_REVERSE);
 
+		/* aggregate bitrate of BlueALSA transports per adapter */
+		if (dbus_ctx_ok)
+			bluealsa_dbus_get_adapters(&dbus_ctx, &hcis, &hcis_len, NULL);
+
 		count = get_devinfo(devices);
 		for (i = 0; i < HCI_MAX_DEV; i++) {
 
@@ -180,15 +453,34 @@ int main(int argc, char *argv[]) {
 
 			char rx[7], rx_rate[9];
 			char tx[7], tx_rate[9];
+			char load[9] = "-", limit[9] = "-";
 
 			humanize_number(rx, sizeof(rx), byte_rx[i][0], "B", HN_AUTOSCALE, 0);
 			humanize_number(tx, sizeof(tx), byte_tx[i][0], "B", HN_AUTOSCALE, 0);
 			humanize_number(rx_rate, sizeof(rx_rate), rate_rx, "B", HN_AUTOSCALE, 0);
 			humanize_number(tx_rate, sizeof(tx_rate), rate_tx, "B", HN_AUTOSCALE, 0);
 
-			mvprintw(i + 1, 0, template_row, devices[i].name, flags, rx, tx, rx_rate, tx_rate);
+			const struct ba_hci *hci;
+			if ((hci = find_ba_hci(hcis, hcis_len, devices[i].name)) != NULL) {
+				humanize_number(load, sizeof(load), hci->bitrate, "b",
+						HN_AUTOSCALE, HN_DIVISOR_1000);
+				if (hci->bitrate_limit != 0)
+					humanize_number(limit, sizeof(limit), hci->bitrate_limit, "b",
+							HN_AUTOSCALE, HN_DIVISOR_1000);
+			}
+
+			mvprintw(i + 1, 0, template_row, devices[i].name, flags, rx, tx, rx_rate, tx_rate,
+					load, limit);
 		}
 
+		free(hcis);
+
+		/* clear rows left over from the previous iteration */
+		move(count + 1, 0);
+		clrtobot();
+
+		print_connections(count + 2, devices, count, delay_sec * 1000 + delay_msec);
+
 		timeout(delay_sec * 1000 + delay_msec);
 		if (getch() == 'q')
 			break;
@@ -196,5 +488,9 @@ int main(int argc, char *argv[]) {
 	}
 
 	endwin();
+
+	if (dbus_ctx_ok)
+		bluealsa_dbus_connection_ctx_free(&dbus_ctx);
+
 	return EXIT_SUCCESS;
 }